@@ -0,0 +1,49 @@
+#ifndef _BUTTONEVENTS_H
+#define _BUTTONEVENTS_H
+
+#include <cstddef>
+#include <atomic>
+#include <map>
+#include <stdint.h>
+
+#include "spscqueue.h"
+
+// Edges kept until the consumer polls them (~10 s of two handed mashing at 100 Hz)
+#define BUTTON_EVENT_QUEUE_SIZE 1024
+
+// A press or release of one button
+struct ButtonEvent
+{
+    uint64_t timestamp;  // Report timestamp (usec) of the first report showing the change
+    int      controller; // Wiimote the button belongs to (CWiimote::GetID())
+    uint16_t button;     // One WIIMOTE_BUTTON_* bit (CButtons::BUTTON_* values)
+    bool     pressed;    // Press or release
+};
+
+// Turns the button fields of wiimote reports into timestamped edges, queued without locks.
+// Feed() runs on the controller thread for every report, so edges carry the exact report
+// time however late the consumer gets to them; Poll() runs on a single consumer thread.
+// Each controller is diffed against its own previous report.
+struct ButtonEventQueue
+{
+    std::atomic<uint32_t> dropped; // Edges lost to a full queue
+
+    ButtonEventQueue() : dropped(0) { }
+
+    // Controller thread: btns, btns_held and btns_released of a report of controller
+    void Feed(uint64_t timestamp, int controller, uint16_t buttons, uint16_t held, uint16_t released);
+
+    // Consumer thread: pops the next edge, oldest first
+    bool Poll(ButtonEvent* event) { return events.Pop(event); }
+
+private:
+    void Push(uint64_t timestamp, int controller, uint16_t buttons, bool pressed);
+
+    std::map<int, uint16_t>                         state; // Buttons down after the last report, per controller
+    SPSCQueue<ButtonEvent, BUTTON_EVENT_QUEUE_SIZE> events;
+};
+
+// Short name of a WIIMOTE_BUTTON_* bit ("A", "HOME", ...)
+const char* Button_Name(uint16_t button);
+
+#endif // _BUTTONEVENTS_H
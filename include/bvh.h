@@ -0,0 +1,94 @@
+#ifndef _BVH_H
+#define _BVH_H
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#define BVH_NULL_NODE (-1)
+
+// Leaves are stored enlarged by this fraction of their size on every side, so objects
+// moving a little every frame do not touch the tree
+#define BVH_FAT_MARGIN 0.1f
+
+// Axis aligned box
+struct BVHBounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// World bounds of local bounds placed by a model matrix
+BVHBounds BVH_Transform(const BVHBounds& local, const glm::mat4& model);
+
+// View frustum as 6 inward facing planes (xyz . p + w >= 0 inside)
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+// Frustum of a projection * view matrix (OpenGL clip space)
+void Frustum_FromMatrix(const glm::mat4& clip, Frustum* frustum);
+
+// Frustum query counters
+struct CullStats
+{
+    size_t tested; // Box against frustum tests, nodes and leaves
+    size_t culled; // Objects outside the frustum
+    size_t drawn;  // Objects inside or crossing the frustum
+};
+
+// Dynamic AABB tree (as in Box2D's b2DynamicTree): leaves are inserted next to the sibling
+// that grows the surface area the least, and AVL rotations keep the tree balanced as
+// objects come, go and move. Leaf ids stay valid until the leaf is removed.
+class DynamicBVH
+{
+public:
+    DynamicBVH();
+
+    // Adds a leaf, returning its id
+    int32_t Insert(const BVHBounds& bounds, uint32_t user_data);
+    void    Remove(int32_t leaf);
+
+    // Updates the bounds of a leaf. Returns true when it had to be reinserted.
+    bool Move(int32_t leaf, const BVHBounds& bounds);
+
+    uint32_t UserData(int32_t leaf) const { return nodes[leaf].user_data; }
+    size_t   Size() const                 { return num_leaves; }
+    int32_t  Height() const               { return root == BVH_NULL_NODE ? 0 : nodes[root].height; }
+
+    // Appends the user data of every leaf crossing the frustum. Subtrees outside a plane are
+    // skipped, and subtrees fully inside are taken without further tests.
+    void Query(const Frustum& frustum, std::vector<uint32_t>* visible, CullStats* stats) const;
+
+private:
+    struct Node
+    {
+        BVHBounds bounds;
+        int32_t   parent; // Next free node while on the free list
+        int32_t   left;
+        int32_t   right;
+        int32_t   height; // Leaves are 0, free nodes -1
+        uint32_t  user_data;
+
+        bool IsLeaf() const { return left == BVH_NULL_NODE; }
+    };
+
+    int32_t AllocateNode();
+    void    FreeNode(int32_t node);
+    void    InsertLeaf(int32_t leaf);
+    void    RemoveLeaf(int32_t leaf);
+    void    Refit(int32_t node);
+    int32_t Balance(int32_t node);
+
+    std::vector<Node> nodes;
+    int32_t           root;
+    int32_t           free_list;
+    size_t            num_leaves;
+};
+
+#endif // _BVH_H
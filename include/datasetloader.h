@@ -0,0 +1,15 @@
+#ifndef _DATASETLOADER_H
+#define _DATASETLOADER_H
+
+#include <string>
+
+#include "dataset.h"
+#include "threadpool.h"
+
+// Loads a WiiC log into dataset (replacing its trainings), like Dataset::loadDataset().
+// The file is memory mapped, training boundaries are found in a first pass and then
+// the trainings are parsed in parallel on the pool. The loaded flag of Dataset is private,
+// so dataset->isValid() stays false after a load: callers check the return value instead.
+bool Dataset_LoadParallel(Dataset* dataset, const std::string& filename, ThreadPool& pool = ThreadPool::Global());
+
+#endif // _DATASETLOADER_H
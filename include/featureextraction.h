@@ -0,0 +1,63 @@
+#ifndef _FEATUREEXTRACTION_H
+#define _FEATUREEXTRACTION_H
+
+#include <cstddef>
+#include <vector>
+
+#include "dataset.h"
+#include "threadpool.h"
+
+// Sensor channels of a training
+enum FeatureChannel
+{
+    CHANNEL_ACC_X = 0,
+    CHANNEL_ACC_Y,
+    CHANNEL_ACC_Z,
+    CHANNEL_GYRO_ROLL,
+    CHANNEL_GYRO_PITCH,
+    CHANNEL_GYRO_YAW,
+    NUM_FEATURE_CHANNELS
+};
+
+// Per channel features: mean, variance, energy, zero crossings, peaks and FFT band powers
+#define FEATURE_FFT_SIZE 64
+#define FEATURE_FFT_BANDS 4
+#define FEATURES_PER_CHANNEL (5 + FEATURE_FFT_BANDS)
+
+// Row layout: FEATURES_PER_CHANNEL values for each channel, then the duration (seconds)
+#define FEATURES_PER_TRAINING (NUM_FEATURE_CHANNELS * FEATURES_PER_CHANNEL + 1)
+
+// A training split into one contiguous array per channel
+struct TrainingChannels
+{
+    std::vector<float> values[NUM_FEATURE_CHANNELS];
+    unsigned long      duration; // msec between the first and last sample
+
+    // Refills the arrays from the samples of a training
+    void Load(const Training* training);
+};
+
+// Row-major matrix with one feature row (and class label) per training
+struct FeatureMatrix
+{
+    size_t             rows;
+    size_t             cols;
+    std::vector<float> data;
+    std::vector<int>   labels;
+
+    FeatureMatrix() : rows(0), cols(FEATURES_PER_TRAINING) { }
+
+    float*       Row(size_t i)       { return &data[i * cols]; }
+    const float* Row(size_t i) const { return &data[i * cols]; }
+};
+
+// Computes the feature row of a single training
+void Features_Compute(const TrainingChannels& channels, float* row);
+
+// Appends one row per training of the dataset, labeled with label, computing rows in parallel
+void Features_AppendDataset(const Dataset& dataset, int label, FeatureMatrix* features, ThreadPool& pool = ThreadPool::Global());
+
+// Name of a feature column (e.g. "acc_x.variance")
+const char* Features_ColumnName(size_t column, char* buffer, size_t buffer_size);
+
+#endif // _FEATUREEXTRACTION_H
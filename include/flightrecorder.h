@@ -0,0 +1,36 @@
+#ifndef _FLIGHTRECORDER_H
+#define _FLIGHTRECORDER_H
+
+#include <stdint.h>
+
+// Always-on recorder keeping the last seconds of sensor reports, fused poses and frame
+// times in fixed size rings. Recording is a couple of stores and never blocks; dumps
+// (hotkey, SIGUSR1 or detected anomalies) are written by a background thread in the
+// WiiC dataset format, with poses and frames in a "<dump>.poses" companion file.
+
+// Seconds kept and upper bound of the report/frame rates used to size the rings
+#define FLIGHT_RECORDER_SECONDS 30
+#define FLIGHT_RECORDER_MAX_RATE 256
+
+// Anomalies: report gaps longer than this (usec) or gyro rates above this (deg/s)
+#define FLIGHT_RECORDER_GAP_THRESHOLD 250000
+#define FLIGHT_RECORDER_RATE_THRESHOLD 1800.0f
+
+// Starts the dump thread and installs the SIGUSR1 handler
+void FlightRecorder_Start(const char* device_address);
+void FlightRecorder_Stop();
+
+// Microseconds on the clock used by WiiC report timestamps (gettimeofday)
+uint64_t FlightRecorder_Now();
+
+// Recording (sensor thread)
+void FlightRecorder_RecordReport(uint64_t timestamp, float roll_rate, float pitch_rate, float yaw_rate, float accel_x, float accel_y, float accel_z);
+void FlightRecorder_RecordPose(uint64_t timestamp, float w, float x, float y, float z);
+
+// Recording (render thread)
+void FlightRecorder_RecordFrame(uint64_t timestamp);
+
+// Asks the dump thread to write the rings to disk. Never blocks, callable from any thread.
+void FlightRecorder_TriggerDump(const char* reason);
+
+#endif // _FLIGHTRECORDER_H
@@ -0,0 +1,63 @@
+#ifndef _FRAMEPACING_H
+#define _FRAMEPACING_H
+
+#include <cstddef>
+#include <atomic>
+#include <stdint.h>
+
+// Frames whose CPU work (start to submission) predicts the next one: the slowest of them is taken
+#define FRAME_PACING_HISTORY 32
+
+// Slack (usec) left between the predicted end of a frame and the refresh it aims for
+#define FRAME_PACING_MARGIN 2000
+
+// Latest fused pose, published by the controller thread for every report and read by the
+// render thread as late as it can. A sequence lock: the writer never waits, and a reader
+// retries the rare read torn by a write.
+struct PoseLatch
+{
+    PoseLatch() : sequence(0), timestamp(0) { for (int i = 0; i < 4; ++i) orientation[i] = 0.0f; }
+
+    // Single writer: the orientation quaternion of the report at timestamp (usec)
+    void Publish(uint64_t time, float w, float x, float y, float z);
+
+    // Any thread: the last published orientation (w, x, y, z), returns its report timestamp
+    uint64_t Read(float pose[4]) const;
+
+private:
+    std::atomic<uint32_t> sequence;       // Odd while a write is in progress
+    std::atomic<uint64_t> timestamp;
+    std::atomic<float>    orientation[4];
+};
+
+// Starts frames as late as their predicted CPU work allows, so the work lands just before the
+// refresh it is shown at and the pose latched at draw time is as fresh as it can be. Frames are
+// only delayed within their refresh interval, so the frame rate does not drop (the prediction
+// grows back at once after a slow frame).
+class FramePacer
+{
+public:
+    FramePacer() : interval(0), last_present(0), next(0), count(0) { }
+
+    // Refresh interval (usec) of the display, 0 never waits
+    void SetInterval(uint64_t refresh_interval) { interval = refresh_interval; }
+
+    // Sleeps until the latest start that still makes the refresh after the last present,
+    // returns the time waited (usec)
+    uint64_t WaitForDeadline();
+
+    // Frame start, the time its commands were submitted, and the time its swap returned
+    void FramePresented(uint64_t frame_start, uint64_t submitted, uint64_t presented);
+
+    // Predicted CPU work of the next frame (usec)
+    uint64_t PredictedWork() const;
+
+private:
+    uint64_t interval;
+    uint64_t last_present;
+    uint64_t work[FRAME_PACING_HISTORY]; // Start to submission of the last frames, a ring
+    size_t   next;
+    size_t   count;
+};
+
+#endif // _FRAMEPACING_H
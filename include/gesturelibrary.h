@@ -0,0 +1,105 @@
+#ifndef _GESTURELIBRARY_H
+#define _GESTURELIBRARY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "gesturerecognizer.h"
+#include "mappedfile.h"
+
+// Compact binary gesture library, memory mapped as is at startup:
+//
+//   GestureLibraryHeader
+//   class names         char[num_classes][GESTURE_NAME_SIZE]
+//   labels              int32[num_templates]
+//   embeddings          float[num_templates][GESTURE_EMBEDDING_SIZE]
+//   k-d tree            GestureLibraryNode[num_nodes]
+//   sequences           float[num_templates][GESTURE_SEQUENCE_SIZE]
+//   upper, lower        envelopes, same layout as the sequences
+//
+// Sections start on 64 byte boundaries. Templates are stored in k-d tree leaf order.
+#define GESTURE_LIBRARY_MAGIC 0x4C47574D // "MWGL"
+#define GESTURE_LIBRARY_VERSION 3
+#define GESTURE_NAME_SIZE 32
+
+// Embedding: per channel means over GESTURE_EMBEDDING_SEGMENTS equal spans of the
+// resampled trajectory (piecewise aggregate approximation)
+#define GESTURE_EMBEDDING_SEGMENTS 4
+#define GESTURE_EMBEDDING_SIZE (GESTURE_EMBEDDING_SEGMENTS * NUM_FEATURE_CHANNELS)
+
+// Templates per k-d tree leaf, candidates proposed per query and leaves visited to find them
+#define GESTURE_LIBRARY_LEAF_SIZE 8
+#define GESTURE_LIBRARY_CANDIDATES 32
+#define GESTURE_LIBRARY_MAX_LEAVES 24
+
+struct GestureLibraryHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sequence_size;  // GESTURE_SEQUENCE_SIZE
+    uint32_t embedding_size; // GESTURE_EMBEDDING_SIZE
+    uint32_t num_classes;
+    uint32_t num_templates;
+    uint32_t num_nodes;
+    uint32_t band;           // Band the envelopes were computed over
+    uint32_t classes_hash;   // FNV-1a of the full class names, to notice removed datasets
+};
+
+// k-d tree node. Leaves (dimension -1) cover templates [begin, end).
+struct GestureLibraryNode
+{
+    int32_t dimension;
+    float   split;
+    int32_t left, right;
+    int32_t begin, end;
+};
+
+// Read-only view of a mapped library
+struct GestureLibrary
+{
+    MappedFile                  file;
+    const GestureLibraryHeader* header;
+    const char*                 names;
+    const int32_t*              labels;
+    const float*                embeddings;
+    const GestureLibraryNode*   nodes;
+    const float*                sequences;
+    const float*                upper;
+    const float*                lower;
+
+    GestureLibrary() : header(NULL) { }
+
+    // Maps a library file, checking its header, size, tree and labels
+    bool Open(const char* filename);
+    void Close();
+
+    size_t      Size() const          { return header ? header->num_templates : 0; }
+    size_t      NumClasses() const    { return header ? header->num_classes : 0; }
+    const char* Name(int label) const { return names + label * GESTURE_NAME_SIZE; }
+    GestureTemplates Templates() const;
+
+    // Approximate nearest templates in embedding space (best bin first over the k-d tree)
+    void Candidates(const float* embedding, size_t count, size_t max_leaves, std::vector<std::pair<float, int> >* candidates) const;
+
+    // Classifies a gesture: k-d tree candidates, then exact DTW over them
+    bool Classify(const GestureSequence& sequence, GestureMatch* match) const;
+};
+
+// Embedding of a resampled gesture, GESTURE_EMBEDDING_SIZE floats
+void GestureLibrary_Embed(const float* sequence, float* embedding);
+
+// Builds the index and writes a library file
+bool GestureLibrary_Write(const char* filename, const std::vector<GestureSequence>& sequences,
+                          const std::vector<int>& labels, const std::vector<std::string>& names, size_t band = GESTURE_BAND);
+
+// Loads a directory of "<class name>.log" datasets, one class per file, labelled in name order
+bool GestureLibrary_LoadDirectory(const char* directory, std::vector<GestureSequence>* sequences, std::vector<int>* labels,
+                                  std::vector<std::string>* names, ThreadPool& pool = ThreadPool::Global());
+
+// Rebuilds the library from a directory of datasets when it is missing, outdated, older
+// than any of them, or built from another set of them
+bool GestureLibrary_Update(const char* directory, const char* filename, ThreadPool& pool = ThreadPool::Global());
+
+#endif // _GESTURELIBRARY_H
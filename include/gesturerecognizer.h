@@ -0,0 +1,118 @@
+#ifndef _GESTURERECOGNIZER_H
+#define _GESTURERECOGNIZER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "dataset.h"
+#include "featureextraction.h"
+#include "threadpool.h"
+
+// Gestures are resampled to a fixed amount of frames. Each frame holds the six sensor
+// channels (scaled so 1 g and 100 deg/s weigh the same) padded to GESTURE_FRAME_STRIDE.
+#define GESTURE_LENGTH 64
+#define GESTURE_FRAME_STRIDE 8
+#define GESTURE_SEQUENCE_SIZE (GESTURE_LENGTH * GESTURE_FRAME_STRIDE)
+#define GESTURE_ACC_SCALE 1.0f
+#define GESTURE_GYRO_SCALE 0.01f
+
+// Sakoe-Chiba band half width (frames)
+#define GESTURE_BAND 6
+
+// A resampled gesture, GESTURE_LENGTH frames of GESTURE_FRAME_STRIDE floats
+struct GestureSequence
+{
+    std::vector<float> frames;
+
+    GestureSequence() : frames(GESTURE_SEQUENCE_SIZE, 0.0f) { }
+
+    // Resamples the channels of a training
+    void Load(const TrainingChannels& channels);
+
+    float*       Data()                { return &frames[0]; }
+    const float* Data() const          { return &frames[0]; }
+    float*       Frame(size_t i)       { return &frames[i * GESTURE_FRAME_STRIDE]; }
+    const float* Frame(size_t i) const { return &frames[i * GESTURE_FRAME_STRIDE]; }
+};
+
+// Outcome of a classification
+struct GestureMatch
+{
+    int    label;      // Class of the nearest template (-1 if there are no templates)
+    int    index;      // Nearest template
+    float  distance;   // DTW distance to it
+    float  confidence; // Lower bound of 1 - distance / distance to the nearest other class
+
+    // Work done (templates, lower bounds that pruned them, full DTWs computed)
+    size_t candidates;
+    size_t pruned_keogh;
+    size_t pruned_improved;
+    size_t computed;
+};
+
+// Read-only view of templates stored contiguously (GESTURE_SEQUENCE_SIZE floats each),
+// with their envelopes over the band
+struct GestureTemplates
+{
+    const float* sequences;
+    const float* upper;
+    const float* lower;
+    const int*   labels;
+    size_t       count;
+    size_t       band;
+
+    const float* Sequence(size_t i) const { return sequences + i * GESTURE_SEQUENCE_SIZE; }
+    const float* Upper(size_t i)    const { return upper + i * GESTURE_SEQUENCE_SIZE; }
+    const float* Lower(size_t i)    const { return lower + i * GESTURE_SEQUENCE_SIZE; }
+};
+
+// Nearest neighbour DTW classifier over stored templates. Candidates are visited in
+// LB_Keogh order and discarded by LB_Keogh, then LB_Improved, then an early abandoning
+// banded DTW, so most of them never reach the full O(length * band) computation.
+struct GestureRecognizer
+{
+    std::vector<float> sequences; // Templates and their envelopes, contiguous
+    std::vector<float> upper;
+    std::vector<float> lower;
+    std::vector<int>   labels;
+    size_t             band;     // Sakoe-Chiba band half width, set before adding templates
+
+    GestureRecognizer(size_t band = GESTURE_BAND) : band(band) { }
+
+    // Adds a template of class label
+    void AddTemplate(const GestureSequence& sequence, int label);
+    void AddTraining(const Training* training, int label);
+
+    // Adds every training of the dataset, resampling them in parallel
+    void AddDataset(const Dataset& dataset, int label, ThreadPool& pool = ThreadPool::Global());
+
+    void Clear();
+    size_t Size() const { return labels.size(); }
+    GestureTemplates Templates() const;
+
+    // Classifies a gesture against the templates
+    bool Classify(const GestureSequence& sequence, GestureMatch* match) const;
+    bool Classify(const Training* training, GestureMatch* match) const;
+};
+
+// Resamples every training of a dataset in parallel
+void Gesture_LoadDataset(const Dataset& dataset, std::vector<GestureSequence>* sequences, ThreadPool& pool = ThreadPool::Global());
+
+// Upper and lower envelopes of a sequence over a window of band frames on each side
+void Gesture_Envelope(const float* sequence, size_t band, float* upper, float* lower);
+
+// Squared distance of x outside the envelope, abandoning once it exceeds limit
+float Gesture_LowerBoundKeogh(const float* x, const float* upper, const float* lower, float limit);
+
+// DTW distance (sum of squared frame distances) inside a Sakoe-Chiba band. Once every path
+// through a row, plus tail_bound[row + 1] (lower bound of the rows left, may be NULL),
+// exceeds limit it returns that lower bound instead.
+float Gesture_DTW(const float* a, const float* b, size_t band, float limit, const float* tail_bound = NULL);
+
+// Nearest neighbour among the candidates (template indices), visited in the given order.
+// When the keys are LB_Keogh values (sorted) the search stops at the first key above the
+// best distance; otherwise every candidate is checked against its lower bounds.
+void Gesture_MatchCandidates(const GestureTemplates& templates, const float* query,
+                             const std::vector<std::pair<float, int> >& candidates, bool keys_are_bounds, GestureMatch* match);
+
+#endif // _GESTURERECOGNIZER_H
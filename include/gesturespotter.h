@@ -0,0 +1,105 @@
+#ifndef _GESTURESPOTTER_H
+#define _GESTURESPOTTER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "gesturerecognizer.h"
+#include "gesturelibrary.h"
+#include "spscqueue.h"
+
+// Default spotting threshold: mean squared frame distance along the warping path
+#define GESTURE_SPOTTING_THRESHOLD 0.08f
+
+// Reports kept to map match starts back to report timestamps (~10 s at 100 Hz)
+#define GESTURE_SPOTTING_HISTORY 1024
+
+// Shortlisting of indexed templates: every GESTURE_SPOTTING_INTERVAL samples, the recent
+// windows of GESTURE_SPOTTING_MIN_WINDOW to GESTURE_SPOTTING_MAX_WINDOW samples (doubling)
+// each propose GESTURE_SPOTTING_CANDIDATES templates, which are then matched for
+// GESTURE_SPOTTING_LINGER samples. A newly shortlisted template replays the last
+// GESTURE_SPOTTING_MAX_WINDOW samples, so gestures that began before it are still found.
+#define GESTURE_SPOTTING_INTERVAL 8
+#define GESTURE_SPOTTING_MIN_WINDOW 48
+#define GESTURE_SPOTTING_MAX_WINDOW 192
+#define GESTURE_SPOTTING_CANDIDATES 32
+#define GESTURE_SPOTTING_LINGER 64
+
+// A gesture found in the live stream
+struct GestureEvent
+{
+    int      label;      // Class of the matching template
+    int      index;      // Matching template
+    uint64_t start;      // Report timestamps (usec) of the first and last matched sample
+    uint64_t end;
+    float    distance;   // Subsequence DTW distance
+    float    confidence; // 1 - distance / threshold distance
+};
+
+// Streaming subsequence DTW (SPRING, Sakurai et al. 2007) over many templates at once.
+// Each sample updates one DTW column per matched template (four templates per SSE lane
+// group), and a match is reported once no later sample can improve it. Templates added one
+// by one are always matched. Those of an indexed library are only matched while the k-d tree
+// shortlists them from the embeddings of the recent windows, so the work per sample is bounded
+// by the shortlist rather than the library size (a template the index misses is not spotted).
+// Feed() runs on the sensor thread with the reports of a single controller (the
+// DTW columns follow one trajectory), and Poll() on a single consumer thread.
+struct GestureSpotter
+{
+    // Templates interleaved four at a time: values[frame][channel][lane]
+    struct Block
+    {
+        float   values[GESTURE_LENGTH][NUM_FEATURE_CHANNELS][4];
+        float   distance[GESTURE_LENGTH + 1][4]; // Current DTW column
+        int32_t start[GESTURE_LENGTH + 1][4];    // Start sample of the best path to each cell
+        float   best_distance[4];                // Pending match (SPRING d_min, t_s, t_e)
+        int32_t best_start[4];
+        int32_t best_end[4];
+        int     label[4];                        // -1 on unused lanes
+        int     index[4];
+        int32_t active_until;                    // Last sample it is matched at (INT32_MAX: always)
+    };
+
+    std::vector<Block>       blocks;
+    std::vector<std::string> names;    // Class names, by label
+    size_t                   count;    // Templates
+    float                    threshold; // GESTURE_SPOTTING_THRESHOLD
+
+    GestureSpotter() : count(0), threshold(GESTURE_SPOTTING_THRESHOLD), library(NULL), samples(0), stream_start(1) { }
+
+    // Adds a template of class label, always matched
+    void AddTemplate(const GestureSequence& sequence, int label);
+
+    // Adds every template of a gesture library. The first library added is indexed: it
+    // must stay open while the spotter is fed.
+    void AddLibrary(const GestureLibrary& library);
+
+    // Sensor thread: consumes one report (raw gravity vector in g, raw rates in deg/s)
+    void Feed(uint64_t timestamp, float accel_x, float accel_y, float accel_z, float roll_rate, float pitch_rate, float yaw_rate);
+
+    // Sensor thread: the stream switches to another controller, partial matches are dropped
+    void Restart();
+
+    // Consumer thread: pops the next spotted gesture
+    bool Poll(GestureEvent* event) { return events.Pop(event); }
+
+private:
+    void Append(const float* sequence, int label);
+    void Shortlist(int32_t t);
+    void Activate(Block& block, int32_t t);
+    void Update(Block& block, const float* x, int32_t t);
+    void Report(Block& block, int lane);
+
+    const GestureLibrary*       library;        // Indexed library
+    std::vector<int32_t>        library_blocks; // Block of each of its templates
+    uint32_t                    samples;
+    int32_t                     stream_start;   // First sample of the current controller
+    uint64_t                    timestamps[GESTURE_SPOTTING_HISTORY];
+    float                       features[GESTURE_SPOTTING_HISTORY][NUM_FEATURE_CHANNELS]; // Scaled samples
+    std::vector<int32_t>        last_end; // Per class, to report overlapping matches once
+    SPSCQueue<GestureEvent, 64> events;
+};
+
+#endif // _GESTURESPOTTER_H
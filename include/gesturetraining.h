@@ -0,0 +1,54 @@
+#ifndef _GESTURETRAINING_H
+#define _GESTURETRAINING_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "gesturerecognizer.h"
+
+// Parameters of a trained recognizer
+struct GestureTrainingParameters
+{
+    size_t band;                // Sakoe-Chiba band half width
+    size_t templates_per_class; // Templates kept per class (0 = all of them)
+};
+
+// Cross-validation results of one parameter set
+struct GestureEvaluation
+{
+    GestureTrainingParameters parameters;
+    size_t                    classes;
+    std::vector<size_t>       confusion;    // Queries by [actual class * classes + predicted class]
+    std::vector<size_t>       unclassified; // Queries per actual class that got no prediction
+    std::vector<double>       latency;      // Classification time per actual class, summed (ms)
+    std::vector<double>       worst;        // Slowest classification per actual class (ms)
+    size_t                    queries;      // Queries over every fold
+    size_t                    templates;    // Templates per fold, averaged
+
+    size_t Correct() const;
+    float  Accuracy() const { return queries ? (float)Correct() / queries : 0.0f; }
+    double MeanLatency() const;
+
+    // Prints the confusion matrix and the per class accuracy and latency
+    void Print(const std::vector<std::string>& names) const;
+};
+
+// Templates kept for the parameters: up to templates_per_class per class, spread over the
+// variations of the class (farthest point traversal under DTW from the member nearest to
+// the class mean). Classes are reduced in parallel. Returns indices into sequences.
+void GestureTraining_Select(const std::vector<GestureSequence>& sequences, const std::vector<int>& labels, const std::vector<size_t>& members,
+                            const GestureTrainingParameters& parameters, std::vector<size_t>* selected, ThreadPool& pool = ThreadPool::Global());
+
+// Builds a recognizer from the selected templates of the given members
+void GestureTraining_Build(const std::vector<GestureSequence>& sequences, const std::vector<int>& labels, const std::vector<size_t>& members,
+                           const GestureTrainingParameters& parameters, GestureRecognizer* recognizer, ThreadPool& pool = ThreadPool::Global());
+
+// Stratified k-fold cross-validation of every parameter set. All folds of all sets are
+// trained and tested at once, with nested parallel loops over the pool. Returns the index
+// of the most accurate set (the fastest one among ties).
+size_t GestureTraining_CrossValidate(const std::vector<GestureSequence>& sequences, const std::vector<int>& labels, size_t classes,
+                                     const std::vector<GestureTrainingParameters>& parameters, size_t folds,
+                                     std::vector<GestureEvaluation>* evaluations, ThreadPool& pool = ThreadPool::Global());
+
+#endif // _GESTURETRAINING_H
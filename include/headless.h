@@ -0,0 +1,61 @@
+#ifndef _HEADLESS_H
+#define _HEADLESS_H
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+// Offscreen rendering without a window system: an OpenGL 3.3 core context on EGL, drawing
+// into a framebuffer object of the given size. The display is Mesa's surfaceless platform
+// when the EGL library has it (no X server, no GPU), else the default display, with a
+// pbuffer when contexts cannot be made current without a surface. software forces Mesa's
+// software rasterizer (llvmpipe).
+bool Headless_Init(int width, int height, bool software);
+void Headless_Shutdown();
+
+// Simulated time per headless frame, and between controller reports (a wiimote with
+// MotionPlus reports at ~100 Hz)
+#define HEADLESS_FRAME_INTERVAL  16667 // usec
+#define HEADLESS_REPORT_INTERVAL 10000 // usec
+
+// A controller report, in the units HandleEvent() reads from the wiimote
+struct HeadlessReport
+{
+    uint64_t timestamp;                       // usec from the start of the run
+    float    roll_rate, pitch_rate, yaw_rate; // deg/s
+    float    accel_x, accel_y, accel_z;       // g
+};
+
+// Controller input of a headless run. "synthetic" generates a tumbling motion at the report
+// rate; any other source is a WiiC log whose GYRO samples are replayed (with the latest ACC
+// sample) at their recorded times, looping at its end.
+class HeadlessInput
+{
+public:
+    HeadlessInput() : synthetic(true), duration(0), cursor(0), offset(0), next_time(0) { }
+
+    bool Open(const char* source);
+
+    // Takes the next report due by a time (usec from the start), false when there is none
+    bool Next(uint64_t until, HeadlessReport* report);
+
+private:
+    bool                        synthetic;
+    std::vector<HeadlessReport> reports;   // Replayed log
+    uint64_t                    duration;  // Of one pass over the log
+    size_t                      cursor;
+    uint64_t                    offset;    // Start of the current pass
+    uint64_t                    next_time; // Of the next synthetic report
+};
+
+// Time spent on a headless frame
+struct HeadlessFrame
+{
+    double cpu_ms;   // Until every command was submitted
+    double frame_ms; // Until the GPU finished them (glFinish)
+};
+
+// Writes frame timings as CSV (frame, cpu_ms, frame_ms) and prints their summary
+bool Headless_WriteTimings(const char* filename, const std::vector<HeadlessFrame>& frames);
+
+#endif // _HEADLESS_H
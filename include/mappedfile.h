@@ -0,0 +1,23 @@
+#ifndef _MAPPEDFILE_H
+#define _MAPPEDFILE_H
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file
+struct MappedFile
+{
+    const char* data;
+    size_t      size;
+
+    MappedFile() : data(NULL), size(0) { }
+    ~MappedFile() { Close(); }
+
+    bool Open(const char* filename);
+    void Close();
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+#endif // _MAPPEDFILE_H
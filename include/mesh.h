@@ -0,0 +1,100 @@
+#ifndef _MESH_H
+#define _MESH_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <tiny_obj_loader.h>
+
+// Post-transform vertex cache size assumed by the optimizer and the ACMR figures
+#define MESH_VERTEX_CACHE_SIZE 16
+
+// Levels of detail per part, the full mesh included. Every level targets half the triangles
+// of the previous one, and is dropped when it removes less than MESH_LOD_MIN_REDUCTION of them.
+#define MESH_MAX_LODS 4
+#define MESH_LOD_MIN_REDUCTION 0.2f
+
+// A welded vertex: every corner with the same attributes shares one
+struct MeshVertex
+{
+    float position[3];
+    float normal[3];
+    float texcoord[2];
+};
+
+// Interleaved vertex as uploaded to the GPU (16 bytes, 40 for separate float vec4/vec4/vec2)
+struct PackedVertex
+{
+    uint16_t position[3]; // GL_UNSIGNED_SHORT normalized, within the mesh bounds
+    uint16_t padding;
+    uint32_t normal;      // GL_INT_2_10_10_10_REV normalized
+    uint16_t texcoord[2]; // GL_HALF_FLOAT
+};
+
+// Axis aligned mesh bounds. Packed positions are relative to them:
+// position = min + (max - min) * packed / 65535
+struct MeshBounds
+{
+    float min[3];
+    float max[3];
+};
+
+// Index range of one level of detail
+struct MeshLOD
+{
+    uint32_t first_index;
+    uint32_t num_indices;
+    float    error; // Geometric error, relative to the radius of the part bounds (0 for the full mesh)
+};
+
+// Index ranges of one OBJ shape, from the full mesh (lods[0]) to the coarsest level
+struct MeshPart
+{
+    std::string name;
+    uint32_t    num_lods;
+    MeshLOD     lods[MESH_MAX_LODS];
+};
+
+// Indexed triangle mesh
+struct Mesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t>   indices;
+    std::vector<MeshPart>   parts;
+    bool                    has_normals;
+    bool                    has_texcoords;
+
+    Mesh() : has_normals(false), has_texcoords(false) { }
+};
+
+// Builds an indexed mesh from triangulated OBJ shapes, welding identical position/normal/uv
+// tuples into one vertex through a hash table
+void Mesh_Build(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, Mesh* mesh);
+
+// Appends up to max_lods - 1 coarser levels to every part, collapsing edges by quadric error
+// (Garland and Heckbert 1997) over the existing vertices. Positions on open borders and on
+// attribute seams (where vertices split on normals or texture coordinates) never move, and
+// collapses turning a triangle normal by more than ~75 degrees are rejected.
+void Mesh_BuildLODs(Mesh* mesh, size_t max_lods = MESH_MAX_LODS);
+
+// Reorders the triangles of every part and level for post-transform cache hits (Tipsify, Sander et al. 2007)
+void Mesh_OptimizeVertexCache(Mesh* mesh, size_t cache_size = MESH_VERTEX_CACHE_SIZE);
+
+// Renumbers vertices in order of first use, so vertex fetches walk memory forward
+void Mesh_OptimizeVertexFetch(Mesh* mesh);
+
+// Bounds of the vertex positions
+void Mesh_ComputeBounds(const Mesh& mesh, MeshBounds* bounds);
+
+// Quantizes the vertices into the interleaved GPU format
+void Mesh_Pack(const Mesh& mesh, const MeshBounds& bounds, std::vector<PackedVertex>* packed);
+
+// IEEE 754 half precision, rounded to nearest even
+uint16_t Mesh_FloatToHalf(float value);
+
+// Average cache miss ratio (transformed vertices per triangle) of a FIFO cache
+float Mesh_ACMR(const std::vector<uint32_t>& indices, size_t num_vertices, size_t cache_size = MESH_VERTEX_CACHE_SIZE);
+
+#endif // _MESH_H
@@ -0,0 +1,90 @@
+#ifndef _MESHCACHE_H
+#define _MESHCACHE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "mesh.h"
+#include "mappedfile.h"
+
+// Processed mesh, cached next to its OBJ file ("<file>.mesh") and memory mapped as is:
+//
+//   MeshCacheHeader
+//   strings             char[strings_size] (source path, then the part names)
+//   parts               MeshCachePart[num_parts]
+//   vertices            PackedVertex[num_vertices]
+//   indices             uint32[num_indices]
+//
+// Sections start on 64 byte boundaries. A cache belongs to the source path it was built
+// from; it is valid while the source keeps its size and mtime, or, when only the mtime
+// changed, its content hash.
+#define MESH_CACHE_MAGIC 0x434D574D // "MWMC"
+#define MESH_CACHE_VERSION 2
+#define MESH_CACHE_EXTENSION ".mesh"
+
+// Header flags
+#define MESH_CACHE_NORMALS   0x1
+#define MESH_CACHE_TEXCOORDS 0x2
+
+struct MeshCacheHeader
+{
+    uint32_t   magic;
+    uint32_t   version;
+    uint32_t   vertex_size;  // sizeof(PackedVertex)
+    uint32_t   flags;
+    uint64_t   source_size;
+    int64_t    source_mtime;
+    uint64_t   source_hash;
+    MeshBounds bounds;       // Bounds the positions were quantized in
+    uint32_t   num_vertices;
+    uint32_t   num_indices;
+    uint32_t   num_parts;
+    uint32_t   strings_size;
+    uint32_t   source_length; // Source path, at the start of the strings
+    uint32_t   padding;
+};
+
+// Index ranges of a part's levels of detail, named by a span of the strings
+struct MeshCachePart
+{
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t num_lods;
+    MeshLOD  lods[MESH_MAX_LODS];
+};
+
+// Vertex and index streams ready for glBufferData, from a mapped cache or a fresh build
+struct PackedMesh
+{
+    MeshBounds            bounds;
+    bool                  has_normals;
+    bool                  has_texcoords;
+    const PackedVertex*   vertices;
+    size_t                num_vertices;
+    const uint32_t*       indices;
+    size_t                num_indices;
+    std::vector<MeshPart> parts;
+
+    PackedMesh() : has_normals(false), has_texcoords(false), vertices(NULL), num_vertices(0), indices(NULL), num_indices(0) { }
+};
+
+// Read-only view of a mapped cache
+struct MeshCache
+{
+    MappedFile file;
+    PackedMesh mesh; // Streams point into the mapping
+
+    // Maps the cache of a source file, failing if it is missing, outdated or of another version
+    bool Open(const char* filename, const char* source);
+    void Close();
+};
+
+// Cache file of an OBJ file
+std::string MeshCache_Filename(const char* source);
+
+// Writes the cache of a source file (to a temporary file, renamed when complete)
+bool MeshCache_Write(const char* filename, const char* source, const PackedMesh& mesh);
+
+#endif // _MESHCACHE_H
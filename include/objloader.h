@@ -0,0 +1,23 @@
+#ifndef _OBJLOADER_H
+#define _OBJLOADER_H
+
+#include <string>
+#include <vector>
+
+#include <tiny_obj_loader.h>
+
+#include "threadpool.h"
+
+// Lines per parsing task, at least (splits below ~64 KB are not worth dispatching)
+#define OBJ_MIN_CHUNK_SIZE (64 * 1024)
+
+// Loads an OBJ file into the same attrib_t/shape_t/material_t results as tinyobj::LoadObj.
+// The file is memory mapped and split at line boundaries into chunks that are tokenized in
+// parallel on the pool; their vertex and face streams are then merged in file order.
+// Materials are read through tinyobj, and 't' (subdivision tag) lines are ignored.
+// Coordinates follow tinyobj's token rules, so ".5", "-.5", "nan" and "inf" read as 0.
+bool Obj_LoadParallel(const char* filename, tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                      std::vector<tinyobj::material_t>* materials, std::string* err, const char* mtl_basepath = NULL,
+                      bool triangulate = true, ThreadPool& pool = ThreadPool::Global());
+
+#endif // _OBJLOADER_H
@@ -0,0 +1,175 @@
+#ifndef _PARSEUTILS_H
+#define _PARSEUTILS_H
+
+#include <cstddef>
+#include <cstring>
+
+// Text parsing helpers working on [p, end) ranges of memory mapped files.
+// None of them needs a terminating '\0', and all of them stop at end.
+
+// Skips spaces and tabs (not line breaks)
+inline void Parse_SkipSpaces(const char*& p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+}
+
+// Moves p to the first character after the next '\n' (or to end)
+inline void Parse_SkipLine(const char*& p, const char* end)
+{
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+    p = nl ? nl + 1 : end;
+}
+
+// Returns the end of the current line (the '\n' or end), ignoring a trailing '\r'
+inline const char* Parse_LineEnd(const char* p, const char* end)
+{
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+    if (!nl)
+        nl = end;
+    if (nl > p && nl[-1] == '\r')
+        --nl;
+    return nl;
+}
+
+// Checks if [p, end) starts with the given token followed by a separator
+inline bool Parse_IsToken(const char* p, const char* end, const char* token, size_t length)
+{
+    if ((size_t)(end - p) < length || memcmp(p, token, length) != 0)
+        return false;
+    p += length;
+    return p == end || *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n';
+}
+
+// Parses an unsigned decimal integer
+inline bool Parse_Unsigned(const char*& p, const char* end, unsigned long* value)
+{
+    Parse_SkipSpaces(p, end);
+    if (p == end || *p < '0' || *p > '9')
+        return false;
+
+    unsigned long v = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        v = v*10 + (unsigned long)(*p++ - '0');
+
+    *value = v;
+    return true;
+}
+
+// Parses a signed decimal integer
+inline bool Parse_Int(const char*& p, const char* end, long* value)
+{
+    Parse_SkipSpaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    unsigned long v;
+    if (!Parse_Unsigned(p, end, &v))
+        return false;
+
+    *value = negative ? -(long)v : (long)v;
+    return true;
+}
+
+// Parses a floating point number ([+-]digits[.digits][(e|E)[+-]digits], plus "inf"/"nan"
+// as written by iostreams). Accumulates the mantissa as an integer and applies the decimal
+// exponent once, which is exact for the short numbers found in logs and OBJ files.
+inline bool Parse_Float(const char*& p, const char* end, float* value)
+{
+    static const double powers_of_ten[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    Parse_SkipSpaces(p, end);
+    const char* start = p;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    if (end - p >= 3 && (p[0] == 'i' || p[0] == 'n'))
+    {
+        if (memcmp(p, "inf", 3) == 0)
+            *value = negative ? -__builtin_inff() : __builtin_inff();
+        else if (memcmp(p, "nan", 3) == 0)
+            *value = __builtin_nanf("");
+        else
+        {
+            p = start;
+            return false;
+        }
+        p += 3;
+        return true;
+    }
+
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool any_digit = false;
+
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        // Digits past the 19th do not fit the mantissa and only scale it
+        if (digits < 19)
+        {
+            mantissa = mantissa*10 + (unsigned)(*p - '0');
+            digits += (mantissa != 0);
+        }
+        else
+            ++exponent;
+        any_digit = true;
+        ++p;
+    }
+
+    if (p < end && *p == '.')
+    {
+        ++p;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa*10 + (unsigned)(*p - '0');
+                digits += (mantissa != 0);
+                --exponent;
+            }
+            any_digit = true;
+            ++p;
+        }
+    }
+
+    if (!any_digit)
+    {
+        p = start;
+        return false;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* e = p + 1;
+        long exp_value;
+        if (Parse_Int(e, end, &exp_value))
+        {
+            exponent += (int)exp_value;
+            p = e;
+        }
+    }
+
+    double v = (double)mantissa;
+    if (exponent < 0)
+    {
+        while (exponent < -22) { v /= 1e22; exponent += 22; }
+        v /= powers_of_ten[-exponent];
+    }
+    else
+    {
+        while (exponent > 22) { v *= 1e22; exponent -= 22; }
+        v *= powers_of_ten[exponent];
+    }
+
+    *value = (float)(negative ? -v : v);
+    return true;
+}
+
+#endif // _PARSEUTILS_H
@@ -1,6 +1,8 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstddef>
+#include <cstring>
 #include <map>
 #include <stack>
 #include <string>
@@ -11,17 +13,31 @@
 #include <stdexcept>
 #include <algorithm>
 #include <thread>
+#include <sys/time.h>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <glm/mat3x3.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <tiny_obj_loader.h>
 #include "utils.h"
 #include "matrices.h"
 #include "wiicpp.h"
+#include "flightrecorder.h"
+#include "gesturespotter.h"
+#include "buttonevents.h"
+#include "mesh.h"
+#include "meshcache.h"
+#include "objloader.h"
+#include "bvh.h"
+#include "headless.h"
+#include "softraster.h"
+#include "framepacing.h"
 
 // Object data loaded from wavefront model
 struct ObjModel
@@ -35,7 +51,7 @@ struct ObjModel
         printf("Loading Model \"%s\"... ", filename);
 
         std::string err;
-        bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename, basepath, triangulate);
+        bool ret = Obj_LoadParallel(filename, &attrib, &shapes, &materials, &err, basepath, triangulate);
 
         if (!err.empty())
             fprintf(stderr, "\n%s\n", err.c_str());
@@ -48,13 +64,31 @@ struct ObjModel
 };
 
 // ObjModel building and drawing functions
-void BuildTrianglesAndAddToVirtualScene(ObjModel*); // Builds ObjModel as a triangle mesh for rastering
+typedef uint32_t SceneHandle; // Index of an object in g_VirtualScene
+#define INVALID_SCENE_HANDLE ((SceneHandle)-1)
+SceneHandle LoadModelAndAddToVirtualScene(const char* filename); // Loads an OBJ file through its mesh cache, returns the handle of its first shape
+SceneHandle BuildTrianglesAndAddToVirtualScene(ObjModel*, const char* source = NULL); // Builds ObjModel as a triangle mesh for rastering (caching it for source), returns the handle of its first shape
+SceneHandle AddPackedMeshToVirtualScene(const PackedMesh& mesh); // Uploads packed vertex and index streams, returns the handle of its first part
 void ComputeNormals(ObjModel* model); // Computes normals for ObjModel in case they do not exist
-void DrawVirtualObject(const char* object_name); // Draws an object from g_VirtualScene
+SceneHandle FindVirtualObject(const char* object_name); // Resolves an object name to its handle (setup code only)
+typedef uint32_t InstanceHandle; // Index of an instance in g_SceneInstances
+#define INVALID_INSTANCE_HANDLE ((InstanceHandle)-1)
+InstanceHandle AddSceneInstance(SceneHandle object, const glm::mat4& model, int material_id); // Places an instance of an object in the culled scene
+void MoveSceneInstance(InstanceHandle instance, const glm::mat4& model); // Moves a scene instance
+void QueueVisibleSceneInstances(const glm::mat4& view, const glm::mat4& projection, float viewport_height, CullStats* stats); // Queues the scene instances inside the view frustum, each at its level of detail
+void QueueVirtualObject(SceneHandle object, const glm::mat4& model, int material_id, uint32_t lod = 0); // Queues an instance of an object for this frame
+glm::mat4 WiimoteModel(const glm::quat& orientation); // Model matrix of the wiimote at an orientation
+void LatchPoseInstance(struct InstanceData* instance); // Rebuilds the instance following the wiimote from the freshest pose
+void DrawQueuedObjects(); // Draws every queued instance, one instanced draw per object and level of detail
+void DrawQueuedObjectsSoftware(const SoftRasterFrame& frame); // Renders every queued instance on the CPU, then copies the image to the framebuffer
+size_t PushObjectUniforms(SceneHandle object); // Queues the per-object block of a draw, returns its slot
+void UploadObjectUniforms(); // Sends every queued per-object block to the GPU at once
+void DrawVirtualObject(SceneHandle object, uint32_t lod, size_t slot, size_t first_instance, size_t num_instances); // Draws instances of an object from g_VirtualScene
 void PrintObjModelInfo(ObjModel*); // Prints information about an ObjModel (DEBUG)
 
 // Shader functions
 void LoadShadersFromFiles(); // Load vertex and fragment shaders
+void CreateUniformBuffers(); // Creates the per-frame and per-object uniform buffers
 GLuint LoadShader_Vertex(const char* filename);   // Loads a vertex shader
 GLuint LoadShader_Fragment(const char* filename); // Loads a fragment shader
 void LoadShader(const char* filename, GLuint shader_id);
@@ -64,9 +98,14 @@ GLuint CreateGpuProgram(GLuint vertex_shader_id, GLuint fragment_shader_id); //
 void TextRendering_Init();
 float TextRendering_LineHeight(GLFWwindow* window);
 float TextRendering_CharWidth(GLFWwindow* window);
-void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f);
+void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f); // Queues a string, reusing its layout from earlier frames
+void TextRendering_Flush(); // Draws every string printed since the last flush in one call
+void TextRendering_SetViewport(int width, int height); // Sets the framebuffer size text is laid out for
 void TextRendering_ShowFramesPerSecond(GLFWwindow* window);
 
+// Window creation
+GLFWwindow* CreateRenderWindow(int width, int height);
+
 // Callback functions for user and operating system interaction
 void FramebufferSizeCallback(GLFWwindow* window, int width, int height);
 void ErrorCallback(int error, const char* description);
@@ -78,15 +117,69 @@ void CursorPosCallback(GLFWwindow* window, double xpos, double ypos);
 int ConnectWiimotes();
 void ControllerHandlerThread();
 void HandleEvent(CWiimote &wm);
+void HandleReport(uint64_t timestamp, float roll_rate, float pitch_rate, float yaw_rate,
+                  float accel_x, float accel_y, float accel_z, float delta_t); // Rates in deg/s, accelerations in g
 
 // Struct containing data for rendering and object
 struct SceneObject
 {
     std::string  name;        // Object name
-    size_t       first_index; // Index of the first vertex in index[]
-    size_t       num_indices; // Amount of vertex indices in index[]
+    MeshLOD      lods[MESH_MAX_LODS]; // Index ranges in index[], from the full mesh to the coarsest level
+    uint32_t     num_lods;
     GLenum       rendering_mode; // Rastering mode (GL_TRIANGLES, GL_TRIANGLE_STRIP, etc.)
     GLuint       vertex_array_object_id; // Vertex Array Object ID with model attributes
+    glm::vec3    position_offset; // Packed positions are position_offset + position_scale * [0, 1]
+    glm::vec3    position_scale;
+    BVHBounds    bounds;          // Local bounds, for culling
+    uint32_t     soft_mesh;       // Streams in g_SoftRasterMeshes (CPU renderer only)
+};
+
+// Placed instance of an object, kept in the culling hierarchy
+struct SceneInstance
+{
+    SceneHandle object;
+    glm::mat4   model;
+    int         material_id;
+    int32_t     leaf; // Leaf in g_SceneBVH
+    uint32_t    lod;  // Level of detail drawn last, kept within the hysteresis band
+};
+
+// Level of detail selection: the coarsest level whose error stays under LOD_PIXEL_ERROR pixels
+// on screen. A level only changes once its error crosses the threshold by LOD_HYSTERESIS
+// (relative), so objects sitting at a switching distance do not pop every frame.
+#define LOD_PIXEL_ERROR 1.0f
+#define LOD_HYSTERESIS  0.25f
+
+// Uniform block binding points (shared by both shaders)
+#define FRAME_UNIFORMS_BINDING  0
+#define OBJECT_UNIFORMS_BINDING 1
+
+// "FrameUniforms" block (std140), written once per frame
+struct FrameUniforms
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 camera_position; // World coordinates
+    glm::vec4 light_direction; // World coordinates, towards the light
+};
+
+// "ObjectUniforms" block (std140), one per draw. Blocks are laid out g_ObjectUniformStride
+// bytes apart in a single buffer, and each draw binds its own range.
+struct ObjectUniforms
+{
+    glm::vec4 position_offset; // Dequantization of the packed positions (xyz)
+    glm::vec4 position_scale;
+};
+
+// Per-instance vertex attributes (divisor 1), read from g_InstanceBuffer
+#define INSTANCE_MODEL_LOCATION         3 // mat4: locations 3 to 6
+#define INSTANCE_NORMAL_MATRIX_LOCATION 7 // mat3: locations 7 to 9
+#define INSTANCE_MATERIAL_ID_LOCATION   10
+struct InstanceData
+{
+    glm::mat4 model;
+    glm::mat3 normal_matrix; // inverse(transpose(model))
+    int32_t   material_id;
 };
 
 // Struct containing placement information for an instance of an object
@@ -157,8 +250,14 @@ struct WiiData
     #define GYROSCOPE_MOVING_AVERAGE_WINDOW_SIZE 8
     #define ACCELEROMETER_MOVING_AVERAGE_WINDOW_SIZE 8
 
+    // Gyroscope rates at rest (deg/s), removed from every report (measured by lognoise)
+    #define GYROSCOPE_BIAS_ROLL 0.0f
+    #define GYROSCOPE_BIAS_PITCH 0.0f
+    #define GYROSCOPE_BIAS_YAW 0.0f
+
     CWii wii; // Wii instance
     int connectedWiimotes; // Connected wiimote count
+    int trackedWiimote; // ID of the wiimote moving the model (the first connected)
     float gyroReadings[GYROSCOPE_MOVING_AVERAGE_WINDOW_SIZE][3]; // Last gyroscope readings
     int gyroReadingsIndex;
     float accelReadings[ACCELEROMETER_MOVING_AVERAGE_WINDOW_SIZE][3]; // Last accelerometer readings
@@ -179,6 +278,7 @@ struct WiiData
         gyroReadingsIndex  = 0;
         accelReadingsIndex = 0;
         connectedWiimotes  = 0;
+        trackedWiimote     = -1;
     }
 
     // Update gyroscope readings with provided values
@@ -256,12 +356,23 @@ struct WiiData
     }
 };
 
-// Object map (name : SceneObject)
-std::map<std::string, SceneObject> g_VirtualScene;
+// Object table, indexed by the handles given out when objects are built
+std::vector<SceneObject> g_VirtualScene;
+
+// Object name resolver (name : handle), for setup code; draws use handles only
+std::map<std::string, SceneHandle> g_VirtualSceneNames;
+
+// Placed instances, and the bounding volume hierarchy culling them every frame
+std::vector<SceneInstance> g_SceneInstances;
+DynamicBVH g_SceneBVH;
 
 // Screen Ratio (Width / Height)
 float g_ScreenRatio = 1.0f;
 
+// Framebuffer size (window or headless framebuffer)
+int g_FramebufferWidth  = 800;
+int g_FramebufferHeight = 600;
+
 // Mouse buttons status
 bool g_LeftMouseButtonPressed = false;
 bool g_RightMouseButtonPressed = false;
@@ -271,10 +382,34 @@ bool g_MiddleMouseButtonPressed = false;
 GLuint vertex_shader_id;
 GLuint fragment_shader_id;
 GLuint program_id = 0;
-GLint model_uniform;
-GLint view_uniform;
-GLint projection_uniform;
-GLint object_id_uniform;
+
+// Uniform buffers
+GLuint g_FrameUniformBuffer;
+GLuint g_ObjectUniformBuffer;
+size_t g_ObjectUniformStride;           // sizeof(ObjectUniforms) rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+std::vector<char> g_ObjectUniformBlocks; // Per-object blocks queued for this frame
+
+// Instances queued for this frame ((object, level of detail), per-instance data) and their buffer
+std::vector<std::pair<SceneHandle, uint32_t> > g_QueuedObjects;
+std::vector<InstanceData> g_QueuedInstances;
+GLuint g_InstanceBuffer;
+
+// CPU renderer (--renderer cpu): the packed streams of every mesh, and the texture and read
+// framebuffer its images are blitted from
+SoftRasterizer* g_SoftRasterizer = NULL;
+std::vector<SoftRasterMesh> g_SoftRasterMeshes;
+GLuint g_SoftRasterTexture = 0;
+GLuint g_SoftRasterFramebuffer = 0;
+
+// Fused wiimote pose, published for every report and latched right before the draw
+PoseLatch g_PoseLatch;
+
+// Scene instance following the pose, its slot in this frame's queue, and the report time and
+// latch time (usec) of the pose it was last drawn at
+InstanceHandle g_PoseInstance = INVALID_INSTANCE_HANDLE;
+size_t g_QueuedPoseSlot = (size_t)-1;
+uint64_t g_LatchedPoseTimestamp = 0;
+uint64_t g_LatchedPoseTime = 0;
 
 // Time variables
 static float previous_time = glfwGetTime();
@@ -293,6 +428,16 @@ static struct Camera g_Camera = {.cameraTheta = M_PI_2,
 // Wiimote real object instance
 static WiiData g_Wii;
 
+// Button press/release edges, stamped on the controller thread
+static ButtonEventQueue g_ButtonEvents;
+
+// Live gesture spotting (one "<gesture name>.log" dataset per gesture),
+// compiled into an indexed library that is rebuilt whenever a dataset changes
+#define GESTURES_DIRECTORY "../../data/gestures"
+#define GESTURES_LIBRARY "../../data/gestures.lib"
+static GestureLibrary g_GestureLibrary;
+static GestureSpotter g_GestureSpotter;
+
 // Wiimote vritual object instance
 static struct PlacedObject placed_wiimote = {.obj_name = "wiimote",
                             .positionX = 0.0f, .positionY = 0.0f, .positionZ = 0.0f,
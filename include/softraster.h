@@ -0,0 +1,171 @@
+#ifndef _SOFTRASTER_H
+#define _SOFTRASTER_H
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "mesh.h"
+#include "threadpool.h"
+
+// Square screen tiles, each rasterized by one task start to end
+#define SOFTRASTER_TILE_SIZE 64
+
+// Screen positions are snapped to 1/16 pixel. Fixed point coordinates of the largest
+// framebuffer must fit 16 bits, so edge functions stay exact in 32 bit lanes inside a tile.
+#define SOFTRASTER_SUBPIXEL_BITS 4
+#define SOFTRASTER_MAX_SIZE      4096
+
+// Triangles are set up and binned in this many blocks, whatever the thread count. Tiles walk
+// the blocks in order, so every tile sees its triangles in draw order and the image does not
+// depend on the amount of threads or on scheduling.
+#define SOFTRASTER_SETUP_BLOCKS 64
+
+// Mesh streams as uploaded to the GPU, kept on the CPU for the software renderer
+struct SoftRasterMesh
+{
+    std::vector<PackedVertex> vertices;
+    std::vector<uint32_t>     indices;
+    glm::vec3                 position_offset; // Packed positions are position_offset + position_scale * [0, 1]
+    glm::vec3                 position_scale;
+};
+
+// Frame constants, as in the FrameUniforms block of the shaders
+struct SoftRasterFrame
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 camera_position; // World coordinates
+    glm::vec4 light_direction; // World coordinates, towards the light
+};
+
+// Work done by the last frame
+struct SoftRasterStats
+{
+    size_t triangles;   // Submitted
+    size_t culled;      // Back facing, outside the frustum, or covering no pixel center
+    size_t clipped;     // Crossing a frustum plane
+    size_t bin_entries; // (tile, triangle) pairs
+    size_t pixels;      // Written after the depth test
+};
+
+// CPU renderer of the packed meshes with the shading model of shader_fragment.glsl (Phong,
+// per pixel, gamma corrected), for machines without a GPU and as a reference for the GPU
+// path. A frame runs in three parallel passes over the thread pool:
+//
+//   1. vertices of every draw are transformed as in shader_vertex.glsl
+//   2. triangles are clipped, culled (back faces, as glCullFace(GL_BACK)) and snapped to
+//      fixed point, and each one is binned into the tiles its edges cross
+//   3. tiles are rasterized independently, heaviest first: edge functions and the depth test
+//      (GL_LESS) run on 4 pixel spans with SSE2, then the covered pixels are shaded
+//
+// Edge functions are exact integers with a top-left fill rule, so shared edges are drawn
+// once and images are the same on every run.
+class SoftRasterizer
+{
+public:
+    SoftRasterizer(ThreadPool& pool = ThreadPool::Global());
+
+    // Sets the framebuffer size, false when a side is over SOFTRASTER_MAX_SIZE
+    bool Resize(int width, int height);
+
+    // Starts a frame cleared to a color
+    void Begin(const SoftRasterFrame& frame, const glm::vec3& clear_color);
+
+    // Queues a draw of an index range of a mesh. The mesh must stay alive until End().
+    void Draw(const SoftRasterMesh* mesh, uint32_t first_index, uint32_t num_indices,
+              const glm::mat4& model, const glm::mat3& normal_matrix, int material_id);
+
+    // Renders every queued draw
+    void End();
+
+    // RGBA8 pixels, rows from the bottom up (as glReadPixels) and Stride() pixels apart
+    const uint32_t* Pixels() const { return color.data(); }
+    int Width() const  { return width; }
+    int Height() const { return height; }
+    int Stride() const { return tiles_x * SOFTRASTER_TILE_SIZE; }
+
+    const SoftRasterStats& Stats() const { return stats; }
+
+private:
+    // Vertex after the vertex stage
+    struct Vertex
+    {
+        glm::vec4 clip;
+        glm::vec3 world;
+        glm::vec3 normal; // World coordinates, not normalized
+    };
+
+    // Triangle after setup. Edge i faces corner i: a * x + b * y + c over fixed point pixel
+    // centers, positive inside. The 8 attributes (window depth, 1/w, world position/w, normal/w)
+    // are planes over the pixel offsets from (min_x, min_y).
+    struct Triangle
+    {
+        int32_t a[3];
+        int32_t b[3];
+        int64_t c[3];         // Fill rule bias included
+        int32_t min_x, min_y; // Pixels whose centers may be covered
+        int32_t max_x, max_y;
+        float   plane_a[8];   // attribute = plane_a * dx + plane_b * dy + plane_c
+        float   plane_b[8];
+        float   plane_c[8];
+        int32_t material_id;
+    };
+
+    struct DrawCall
+    {
+        const SoftRasterMesh* mesh;
+        uint32_t              first_index;
+        uint32_t              num_indices;
+        uint32_t              min_vertex;   // Vertex range the indices use
+        uint32_t              max_vertex;
+        size_t                first_vertex; // Of the range in vertices[]
+        glm::mat4             model;
+        glm::mat3             normal_matrix;
+        int                   material_id;
+    };
+
+    struct SetupBlock
+    {
+        std::vector<Triangle>               triangles;
+        std::vector<std::vector<uint32_t> > bins; // Triangles crossing each tile
+        SoftRasterStats                     stats;
+    };
+
+    void RunOnPool(size_t count, void (SoftRasterizer::*task)(size_t));
+    void TransformDraw(size_t draw);
+    void SetupBlockTriangles(size_t block);
+    bool SetupTriangle(SetupBlock& block, const Vertex* corners[3], int material_id);
+    void BinTriangle(SetupBlock& block, uint32_t index);
+    void RasterTile(size_t order);
+    size_t RasterTriangle(const Triangle& triangle, int tile_x, int tile_y);
+
+    ThreadPool&                 pool;
+    int                         width;
+    int                         height;
+    int                         tiles_x;
+    int                         tiles_y;
+    std::vector<uint32_t>       color;
+    std::vector<float>          depth;
+    uint32_t                    clear_color;
+    SoftRasterFrame             frame;
+    glm::mat4                   view_projection;
+    std::vector<DrawCall>       draws;
+    std::vector<size_t>         draw_triangles; // Triangles before each draw, then the total
+    std::vector<Vertex>         vertices;
+    std::vector<SetupBlock>     blocks;
+    std::vector<uint32_t>       tile_order;     // Tiles by decreasing amount of triangles
+    std::vector<size_t>         tile_costs;
+    std::vector<size_t>         tile_pixels;
+    SoftRasterStats             stats;
+
+    SoftRasterizer(const SoftRasterizer&);
+    SoftRasterizer& operator=(const SoftRasterizer&);
+};
+
+#endif // _SOFTRASTER_H
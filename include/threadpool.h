@@ -0,0 +1,70 @@
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed size pool of worker threads executing submitted tasks. Every worker owns a task
+// deque: tasks submitted from a worker go to its own deque and are run newest first,
+// idle workers steal the oldest tasks of the others.
+class ThreadPool
+{
+public:
+    // Creates the pool (0 threads = one per hardware core)
+    ThreadPool(unsigned int num_threads = 0);
+    ~ThreadPool();
+
+    // Queues a task for execution on any worker
+    void Submit(const std::function<void()>& task);
+
+    // Runs one queued task on the calling thread, if there is any
+    bool RunPendingTask();
+
+    // Blocks until every submitted task has finished. Must not be called from a pool task.
+    void Wait();
+
+    // Amount of worker threads
+    unsigned int Size() const { return (unsigned int)workers.size(); }
+
+    // Pool shared by the whole application
+    static ThreadPool& Global();
+
+private:
+    // Tasks of one worker: the owner works at the back, thieves take from the front
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()> > tasks;
+    };
+
+    void WorkerLoop(size_t index);
+    bool PopTask(size_t index, std::function<void()>* task);
+    void FinishTask();
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkQueue> > queues;
+    std::atomic<size_t> queuedTasks;  // Tasks waiting in any deque
+    std::atomic<size_t> pendingTasks; // Tasks submitted and not finished
+    std::atomic<size_t> nextQueue;    // Deque for the next submission from outside the pool
+    std::mutex sleepMutex;
+    std::condition_variable tasksAvailable;
+    std::condition_variable tasksDone;
+    bool stopping;
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+};
+
+// Splits [0, count) in contiguous blocks and runs body(begin, end) for each one on the pool.
+// Returns only after all blocks were processed. The calling thread runs queued tasks while
+// it waits, so ParallelFor may be nested inside pool tasks.
+void ParallelFor(ThreadPool& pool, size_t count, const std::function<void(size_t, size_t)>& body, size_t min_block = 1);
+
+#endif // _THREADPOOL_H
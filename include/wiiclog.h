@@ -0,0 +1,65 @@
+#ifndef _WIICLOG_H
+#define _WIICLOG_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "sample.h"
+#include "mappedfile.h"
+
+// Direct access to WiiC log files (the format written by Dataset::save and Logger):
+//
+//   WiiC <version>
+//   <date>
+//   <device address>
+//   START <training timestamp>
+//   ACC <timestamp> <x> <y> <z>
+//   GYRO <timestamp> <roll> <pitch> <yaw>
+//   ...
+//   END
+//
+
+// Version written in the header by WiiC
+#define WIICLOG_VERSION 1
+
+// Log header fields
+struct WiicLogHeader
+{
+    float       version;
+    std::string date;
+    std::string address;     // MAC address of the source device
+    size_t      body_offset; // Offset of the first line after the header
+};
+
+// Byte range of a training block inside a log
+struct WiicLogTraining
+{
+    size_t        begin;        // First byte after the START line
+    size_t        end;          // First byte of the END line
+    size_t        num_samples;  // Sample lines between START and END
+    unsigned long timestamp;    // START timestamp (msec from midnight)
+};
+
+// A single sample line
+struct WiicLogSample
+{
+    int           type;       // WIIC_LOG_ACC or WIIC_LOG_GYRO
+    unsigned long timestamp;  // msec from the gesture start
+    float         values[3];  // x, y, z (ACC) or roll, pitch, yaw (GYRO)
+};
+
+// Parses the header at the start of a log
+bool WiicLog_ParseHeader(const char* data, size_t size, WiicLogHeader* header);
+
+// Finds every START/END block after offset. Returns false on unterminated or nested blocks.
+bool WiicLog_FindTrainings(const char* data, size_t size, size_t offset, std::vector<WiicLogTraining>* trainings);
+
+// Parses the sample line at p and moves p to the next line. Blank lines set type to WIIC_LOG_NONE.
+bool WiicLog_ParseSample(const char*& p, const char* end, WiicLogSample* sample);
+
+// Writes a header identical to the one of Dataset::save()
+void WiicLog_WriteHeader(FILE* out, const char* address);
+
+#endif // _WIICLOG_H
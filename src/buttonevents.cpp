@@ -0,0 +1,59 @@
+#include "buttonevents.h"
+#include "wiic_macros.h"
+
+// Controller thread: btns, btns_held and btns_released of a report of controller
+void ButtonEventQueue::Feed(uint64_t timestamp, int controller, uint16_t buttons, uint16_t held, uint16_t released)
+{
+    buttons &= WIIMOTE_BUTTON_ALL;
+    uint16_t& down = state[controller]; // Allocated once per controller
+
+    // Edges as WiiC reports them, plus any change since the last report seen, so a lost
+    // report never leaves a button stuck. A button found pressed anew while still down
+    // was released in between.
+    uint16_t presses  = buttons & (~held | ~down);
+    uint16_t releases = down & (released | ~buttons | presses);
+
+    // Releases first, they happened before any press of the same report
+    Push(timestamp, controller, releases, false);
+    Push(timestamp, controller, presses, true);
+    down = buttons;
+}
+
+// Queues one edge per set bit
+void ButtonEventQueue::Push(uint64_t timestamp, int controller, uint16_t buttons, bool pressed)
+{
+    for (uint16_t bit = 1; buttons; bit <<= 1)
+    {
+        if (!(buttons & bit))
+            continue;
+        buttons &= ~bit;
+
+        ButtonEvent event;
+        event.timestamp = timestamp;
+        event.controller = controller;
+        event.button = bit;
+        event.pressed = pressed;
+        if (!events.Push(event))
+            dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Short name of a WIIMOTE_BUTTON_* bit
+const char* Button_Name(uint16_t button)
+{
+    switch (button)
+    {
+        case WIIMOTE_BUTTON_TWO:   return "2";
+        case WIIMOTE_BUTTON_ONE:   return "1";
+        case WIIMOTE_BUTTON_B:     return "B";
+        case WIIMOTE_BUTTON_A:     return "A";
+        case WIIMOTE_BUTTON_MINUS: return "-";
+        case WIIMOTE_BUTTON_HOME:  return "HOME";
+        case WIIMOTE_BUTTON_LEFT:  return "LEFT";
+        case WIIMOTE_BUTTON_RIGHT: return "RIGHT";
+        case WIIMOTE_BUTTON_DOWN:  return "DOWN";
+        case WIIMOTE_BUTTON_UP:    return "UP";
+        case WIIMOTE_BUTTON_PLUS:  return "+";
+        default:                     return "?";
+    }
+}
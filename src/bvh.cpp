@@ -0,0 +1,362 @@
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+
+// =========================================================================================
+//                                       BOUNDS
+//==========================================================================================
+
+static BVHBounds Combine(const BVHBounds& a, const BVHBounds& b)
+{
+    BVHBounds c = { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+    return c;
+}
+
+static float SurfaceArea(const BVHBounds& b)
+{
+    glm::vec3 d = b.max - b.min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static bool Contains(const BVHBounds& outer, const BVHBounds& inner)
+{
+    return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::lessThanEqual(inner.max, outer.max));
+}
+
+// World bounds of local bounds placed by a model matrix (Arvo: the extents go through |M|)
+BVHBounds BVH_Transform(const BVHBounds& local, const glm::mat4& model)
+{
+    glm::vec3 center = glm::vec3(model * glm::vec4((local.min + local.max) * 0.5f, 1.0f));
+    glm::vec3 extent = (local.max - local.min) * 0.5f;
+
+    glm::vec3 world_extent(0.0f);
+    for (int column = 0; column < 3; ++column)
+        world_extent += glm::abs(glm::vec3(model[column])) * extent[column];
+
+    BVHBounds world = { center - world_extent, center + world_extent };
+    return world;
+}
+
+// Frustum of a projection * view matrix (Gribb and Hartmann: clip planes are sums of rows)
+void Frustum_FromMatrix(const glm::mat4& clip, Frustum* frustum)
+{
+    glm::vec4 rows[4];
+    for (int row = 0; row < 4; ++row)
+        rows[row] = glm::vec4(clip[0][row], clip[1][row], clip[2][row], clip[3][row]);
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        frustum->planes[2*axis + 0] = rows[3] + rows[axis];
+        frustum->planes[2*axis + 1] = rows[3] - rows[axis];
+    }
+
+    for (int plane = 0; plane < 6; ++plane)
+        frustum->planes[plane] /= glm::length(glm::vec3(frustum->planes[plane]));
+}
+
+// =========================================================================================
+//                                        TREE
+//==========================================================================================
+
+DynamicBVH::DynamicBVH() : root(BVH_NULL_NODE), free_list(BVH_NULL_NODE), num_leaves(0)
+{
+}
+
+int32_t DynamicBVH::AllocateNode()
+{
+    if (free_list == BVH_NULL_NODE)
+    {
+        Node node;
+        node.parent = BVH_NULL_NODE;
+        free_list = (int32_t)nodes.size();
+        nodes.push_back(node);
+    }
+
+    int32_t index = free_list;
+    Node& node = nodes[index];
+    free_list   = node.parent;
+    node.parent = BVH_NULL_NODE;
+    node.left   = BVH_NULL_NODE;
+    node.right  = BVH_NULL_NODE;
+    node.height = 0;
+    node.user_data = 0;
+    return index;
+}
+
+void DynamicBVH::FreeNode(int32_t index)
+{
+    nodes[index].parent = free_list;
+    nodes[index].height = -1;
+    free_list = index;
+}
+
+// Adds a leaf, returning its id
+int32_t DynamicBVH::Insert(const BVHBounds& bounds, uint32_t user_data)
+{
+    int32_t leaf = AllocateNode();
+
+    glm::vec3 margin = (bounds.max - bounds.min) * BVH_FAT_MARGIN;
+    nodes[leaf].bounds.min = bounds.min - margin;
+    nodes[leaf].bounds.max = bounds.max + margin;
+    nodes[leaf].user_data  = user_data;
+
+    InsertLeaf(leaf);
+    ++num_leaves;
+    return leaf;
+}
+
+void DynamicBVH::Remove(int32_t leaf)
+{
+    assert(nodes[leaf].IsLeaf() && nodes[leaf].height == 0);
+    RemoveLeaf(leaf);
+    FreeNode(leaf);
+    --num_leaves;
+}
+
+// Updates the bounds of a leaf, reinserting it only when it left its enlarged bounds
+bool DynamicBVH::Move(int32_t leaf, const BVHBounds& bounds)
+{
+    if (Contains(nodes[leaf].bounds, bounds))
+        return false;
+
+    RemoveLeaf(leaf);
+
+    glm::vec3 margin = (bounds.max - bounds.min) * BVH_FAT_MARGIN;
+    nodes[leaf].bounds.min = bounds.min - margin;
+    nodes[leaf].bounds.max = bounds.max + margin;
+
+    InsertLeaf(leaf);
+    return true;
+}
+
+void DynamicBVH::InsertLeaf(int32_t leaf)
+{
+    if (root == BVH_NULL_NODE)
+    {
+        root = leaf;
+        nodes[leaf].parent = BVH_NULL_NODE;
+        return;
+    }
+
+    // Descend towards the sibling whose pairing costs the least surface area
+    BVHBounds leaf_bounds = nodes[leaf].bounds;
+    int32_t index = root;
+    while (!nodes[index].IsLeaf())
+    {
+        const Node& node = nodes[index];
+        float area = SurfaceArea(node.bounds);
+        float combined_area = SurfaceArea(Combine(node.bounds, leaf_bounds));
+
+        // Cost of a new parent here, and the growth every ancestor below inherits
+        float cost = 2.0f * combined_area;
+        float inheritance_cost = 2.0f * (combined_area - area);
+
+        float child_cost[2];
+        int32_t children[2] = { node.left, node.right };
+        for (int c = 0; c < 2; ++c)
+        {
+            const Node& child = nodes[children[c]];
+            float grown = SurfaceArea(Combine(child.bounds, leaf_bounds));
+            child_cost[c] = (child.IsLeaf() ? grown : grown - SurfaceArea(child.bounds)) + inheritance_cost;
+        }
+
+        if (cost < child_cost[0] && cost < child_cost[1])
+            break;
+        index = child_cost[0] < child_cost[1] ? children[0] : children[1];
+    }
+
+    int32_t sibling = index;
+    int32_t old_parent = nodes[sibling].parent;
+    int32_t new_parent = AllocateNode();
+
+    Node& parent = nodes[new_parent];
+    parent.parent = old_parent;
+    parent.bounds = Combine(leaf_bounds, nodes[sibling].bounds);
+    parent.height = nodes[sibling].height + 1;
+    parent.left   = sibling;
+    parent.right  = leaf;
+
+    if (old_parent != BVH_NULL_NODE)
+    {
+        if (nodes[old_parent].left == sibling)
+            nodes[old_parent].left = new_parent;
+        else
+            nodes[old_parent].right = new_parent;
+    }
+    else
+        root = new_parent;
+
+    nodes[sibling].parent = new_parent;
+    nodes[leaf].parent = new_parent;
+
+    Refit(nodes[leaf].parent);
+}
+
+void DynamicBVH::RemoveLeaf(int32_t leaf)
+{
+    if (leaf == root)
+    {
+        root = BVH_NULL_NODE;
+        return;
+    }
+
+    int32_t parent = nodes[leaf].parent;
+    int32_t grand_parent = nodes[parent].parent;
+    int32_t sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+    // The sibling takes the place of the parent
+    if (grand_parent != BVH_NULL_NODE)
+    {
+        if (nodes[grand_parent].left == parent)
+            nodes[grand_parent].left = sibling;
+        else
+            nodes[grand_parent].right = sibling;
+        nodes[sibling].parent = grand_parent;
+        FreeNode(parent);
+
+        Refit(grand_parent);
+    }
+    else
+    {
+        root = sibling;
+        nodes[sibling].parent = BVH_NULL_NODE;
+        FreeNode(parent);
+    }
+}
+
+// Rebalances and refits a node and its ancestors
+void DynamicBVH::Refit(int32_t index)
+{
+    while (index != BVH_NULL_NODE)
+    {
+        index = Balance(index);
+
+        Node& node = nodes[index];
+        node.height = 1 + std::max(nodes[node.left].height, nodes[node.right].height);
+        node.bounds = Combine(nodes[node.left].bounds, nodes[node.right].bounds);
+
+        index = node.parent;
+    }
+}
+
+// Rotates the taller child of a node up when the heights of its children differ by more
+// than one. Returns the node now at its place.
+int32_t DynamicBVH::Balance(int32_t a)
+{
+    if (nodes[a].IsLeaf() || nodes[a].height < 2)
+        return a;
+
+    int32_t b = nodes[a].left;
+    int32_t c = nodes[a].right;
+    int32_t balance = nodes[c].height - nodes[b].height;
+    if (balance >= -1 && balance <= 1)
+        return a;
+
+    // up: the taller child, rising; other: the child left under a
+    int32_t up    = balance > 1 ? c : b;
+    int32_t other = balance > 1 ? b : c;
+    int32_t f = nodes[up].left;
+    int32_t g = nodes[up].right;
+
+    // a becomes a child of up
+    nodes[up].left   = a;
+    nodes[up].parent = nodes[a].parent;
+    nodes[a].parent  = up;
+
+    if (nodes[up].parent != BVH_NULL_NODE)
+    {
+        if (nodes[nodes[up].parent].left == a)
+            nodes[nodes[up].parent].left = up;
+        else
+            nodes[nodes[up].parent].right = up;
+    }
+    else
+        root = up;
+
+    // The taller grandchild stays under up, the shorter one moves under a
+    int32_t keep = nodes[f].height > nodes[g].height ? f : g;
+    int32_t move = keep == f ? g : f;
+
+    nodes[up].right = keep;
+    if (balance > 1)
+        nodes[a].right = move;
+    else
+        nodes[a].left = move;
+    nodes[move].parent = a;
+
+    nodes[a].bounds  = Combine(nodes[other].bounds, nodes[move].bounds);
+    nodes[a].height  = 1 + std::max(nodes[other].height, nodes[move].height);
+    nodes[up].bounds = Combine(nodes[a].bounds, nodes[keep].bounds);
+    nodes[up].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+    return up;
+}
+
+// =========================================================================================
+//                                       QUERY
+//==========================================================================================
+
+// Appends the user data of every leaf crossing the frustum
+void DynamicBVH::Query(const Frustum& frustum, std::vector<uint32_t>* visible, CullStats* stats) const
+{
+    size_t first = visible->size();
+    size_t tested = 0;
+
+    // Nodes to visit, with the planes they may still cross (planes their parent was fully
+    // inside of need no test below it)
+    std::vector<std::pair<int32_t, uint32_t> > stack;
+    if (root != BVH_NULL_NODE)
+        stack.push_back(std::make_pair(root, 0x3Fu));
+
+    while (!stack.empty())
+    {
+        int32_t index = stack.back().first;
+        uint32_t planes = stack.back().second;
+        stack.pop_back();
+
+        const Node& node = nodes[index];
+        bool outside = false;
+        if (planes)
+        {
+            ++tested;
+            for (int p = 0; p < 6 && !outside; ++p)
+            {
+                if (!(planes & (1u << p)))
+                    continue;
+
+                // Farthest corner along the plane normal, then the nearest one
+                const glm::vec4& plane = frustum.planes[p];
+                glm::vec3 normal(plane);
+                glm::vec3 far_corner  = glm::mix(node.bounds.min, node.bounds.max, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+                glm::vec3 near_corner = glm::mix(node.bounds.max, node.bounds.min, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+
+                if (glm::dot(normal, far_corner) + plane.w < 0.0f)
+                    outside = true;
+                else if (glm::dot(normal, near_corner) + plane.w >= 0.0f)
+                    planes &= ~(1u << p);
+            }
+        }
+
+        if (outside)
+            continue;
+
+        if (node.IsLeaf())
+            visible->push_back(node.user_data);
+        else
+        {
+            stack.push_back(std::make_pair(node.left, planes));
+            stack.push_back(std::make_pair(node.right, planes));
+        }
+    }
+
+    if (stats)
+    {
+        size_t drawn = visible->size() - first;
+        stats->tested += tested;
+        stats->drawn  += drawn;
+        stats->culled += num_leaves - drawn;
+    }
+}
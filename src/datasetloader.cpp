@@ -0,0 +1,112 @@
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "datasetloader.h"
+#include "wiiclog.h"
+
+// Parses the samples of one training block
+static bool LoadTrainingSpan(const char* data, const WiicLogTraining& span, Training* training)
+{
+    const char* p   = data + span.begin;
+    const char* end = data + span.end;
+
+    training->setTimestampFromMidnight(span.timestamp);
+
+    WiicLogSample sample;
+    while (p < end)
+    {
+        if (!WiicLog_ParseSample(p, end, &sample))
+            return false;
+
+        Sample* s;
+        if (sample.type == WIIC_LOG_ACC)
+            s = new AccSample(sample.values[0], sample.values[1], sample.values[2]);
+        else if (sample.type == WIIC_LOG_GYRO)
+            s = new GyroSample(sample.values[0], sample.values[1], sample.values[2]);
+        else
+            continue;
+
+        s->setLogType(sample.type);
+        s->setTimestampFromGestureStart(sample.timestamp);
+        training->addSample(s);
+    }
+
+    return true;
+}
+
+// Loads a WiiC log into dataset, parsing trainings in parallel
+bool Dataset_LoadParallel(Dataset* dataset, const std::string& filename, ThreadPool& pool)
+{
+    printf("Loading Dataset \"%s\"... ", filename.c_str());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    MappedFile file;
+    if (!file.Open(filename.c_str()))
+    {
+        fprintf(stderr, "\n[Error] Unable to open the dataset file\n");
+        return false;
+    }
+
+    // First pass: header and training boundaries
+    WiicLogHeader header;
+    if (!WiicLog_ParseHeader(file.data, file.size, &header))
+    {
+        fprintf(stderr, "\n[Error] Bad log format.\n");
+        return false;
+    }
+
+    // WiiC reads the version as an integer and refuses newer logs
+    if ((int)header.version > WIICLOG_VERSION)
+    {
+        fprintf(stderr, "\n[Error] Unsupported WiiC log version.\n");
+        return false;
+    }
+
+    std::vector<WiicLogTraining> spans;
+    if (!WiicLog_FindTrainings(file.data, file.size, header.body_offset, &spans))
+    {
+        fprintf(stderr, "\n[Error] Unable to load a training in the dataset\n");
+        return false;
+    }
+
+    // Second pass: every training is parsed independently into its preallocated slot
+    std::vector<Training*> trainings(spans.size());
+    for (size_t i = 0; i < spans.size(); ++i)
+        trainings[i] = new Training();
+
+    std::atomic<bool> failed(false);
+    size_t num_samples = 0;
+    for (size_t i = 0; i < spans.size(); ++i)
+        num_samples += spans[i].num_samples;
+
+    // Keep blocks around 16k samples so tiny trainings are not dispatched one by one
+    size_t min_block = spans.empty() ? 1 : 1 + spans.size() * 16384 / (num_samples + 1);
+
+    const char* data = file.data;
+    ParallelFor(pool, spans.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end && !failed.load(std::memory_order_relaxed); ++i)
+            if (!LoadTrainingSpan(data, spans[i], trainings[i]))
+                failed = true;
+    }, min_block);
+
+    if (failed)
+    {
+        for (size_t i = 0; i < trainings.size(); ++i)
+            delete trainings[i];
+        fprintf(stderr, "\n[Error] Bad log type.\n");
+        return false;
+    }
+
+    dataset->clear();
+    for (size_t i = 0; i < trainings.size(); ++i)
+        dataset->addTraining(trainings[i]);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("OK. (%u trainings, %lu samples, %.1f MB/s)\n", (unsigned)trainings.size(), (unsigned long)num_samples,
+           file.size / (1024.0*1024.0) / (seconds > 0.0 ? seconds : 1e-9));
+
+    return true;
+}
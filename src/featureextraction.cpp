@@ -0,0 +1,285 @@
+#include <cmath>
+#include <cstdio>
+#include <chrono>
+#include <complex>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "featureextraction.h"
+
+// =========================================================================================
+//                                 CHANNEL KERNELS
+//==========================================================================================
+
+// Sum of x[0..n)
+static float Kernel_Sum(const float* x, size_t n)
+{
+    size_t i = 0;
+    float sum = 0.0f;
+
+    #ifdef __SSE2__
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_loadu_ps(x + i));
+        acc1 = _mm_add_ps(acc1, _mm_loadu_ps(x + i + 4));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    #endif
+
+    for (; i < n; ++i)
+        sum += x[i];
+    return sum;
+}
+
+// Sum of (x[i] - offset)^2
+static float Kernel_SumSquares(const float* x, size_t n, float offset)
+{
+    size_t i = 0;
+    float sum = 0.0f;
+
+    #ifdef __SSE2__
+    __m128 o    = _mm_set1_ps(offset);
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(x + i), o);
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(x + i + 4), o);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    #endif
+
+    for (; i < n; ++i)
+        sum += (x[i] - offset) * (x[i] - offset);
+    return sum;
+}
+
+// Amount of sign changes of x around level
+static int Kernel_ZeroCrossings(const float* x, size_t n, float level)
+{
+    size_t i = 1;
+    int count = 0;
+
+    #ifdef __SSE2__
+    __m128 l = _mm_set1_ps(level);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 prev = _mm_sub_ps(_mm_loadu_ps(x + i - 1), l);
+        __m128 curr = _mm_sub_ps(_mm_loadu_ps(x + i), l);
+        count += __builtin_popcount(_mm_movemask_ps(_mm_xor_ps(prev, curr)));
+    }
+    #endif
+
+    for (; i < n; ++i)
+        count += ((x[i - 1] - level) < 0.0f) != ((x[i] - level) < 0.0f);
+    return count;
+}
+
+// Amount of local maxima above threshold
+static int Kernel_Peaks(const float* x, size_t n, float threshold)
+{
+    size_t i = 1;
+    int count = 0;
+
+    #ifdef __SSE2__
+    __m128 t = _mm_set1_ps(threshold);
+    for (; i + 5 <= n; i += 4)
+    {
+        __m128 left   = _mm_loadu_ps(x + i - 1);
+        __m128 center = _mm_loadu_ps(x + i);
+        __m128 right  = _mm_loadu_ps(x + i + 1);
+        __m128 peak   = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(center, left), _mm_cmpge_ps(center, right)), _mm_cmpgt_ps(center, t));
+        count += __builtin_popcount(_mm_movemask_ps(peak));
+    }
+    #endif
+
+    for (; i + 1 < n; ++i)
+        count += (x[i] > x[i - 1]) & (x[i] >= x[i + 1]) & (x[i] > threshold);
+    return count;
+}
+
+// Power of FEATURE_FFT_BANDS equal width bands of the spectrum of x (mean removed).
+// The channel is linearly resampled to FEATURE_FFT_SIZE points first, so every
+// training yields comparable bands regardless of its length.
+static void Kernel_BandPowers(const float* x, size_t n, float mean, float* bands)
+{
+    typedef std::complex<float> complexf;
+    static const int LOG2_SIZE = 6;
+    static_assert((1 << LOG2_SIZE) == FEATURE_FFT_SIZE, "FFT size must match LOG2_SIZE");
+
+    // Twiddle factors shared by every call
+    static const std::vector<complexf> twiddles = []
+    {
+        std::vector<complexf> w(FEATURE_FFT_SIZE / 2);
+        for (int k = 0; k < FEATURE_FFT_SIZE / 2; ++k)
+            w[k] = std::polar(1.0f, (float)(-2.0 * M_PI * k / FEATURE_FFT_SIZE));
+        return w;
+    }();
+
+    for (int b = 0; b < FEATURE_FFT_BANDS; ++b)
+        bands[b] = 0.0f;
+    if (n < 2)
+        return;
+
+    // Resample into bit-reversed order
+    complexf buffer[FEATURE_FFT_SIZE];
+    float step = (float)(n - 1) / (FEATURE_FFT_SIZE - 1);
+    for (int i = 0; i < FEATURE_FFT_SIZE; ++i)
+    {
+        float pos  = i * step;
+        size_t i0  = (size_t)pos;
+        size_t i1  = i0 + 1 < n ? i0 + 1 : i0;
+        float frac = pos - i0;
+
+        int reversed = 0;
+        for (int bit = 0; bit < LOG2_SIZE; ++bit)
+            reversed |= ((i >> bit) & 1) << (LOG2_SIZE - 1 - bit);
+
+        buffer[reversed] = complexf(x[i0] + (x[i1] - x[i0]) * frac - mean, 0.0f);
+    }
+
+    // Iterative radix-2 butterflies
+    for (int size = 2; size <= FEATURE_FFT_SIZE; size *= 2)
+    {
+        int half   = size / 2;
+        int stride = FEATURE_FFT_SIZE / size;
+        for (int start = 0; start < FEATURE_FFT_SIZE; start += size)
+        {
+            for (int k = 0; k < half; ++k)
+            {
+                complexf t = twiddles[k * stride] * buffer[start + k + half];
+                buffer[start + k + half] = buffer[start + k] - t;
+                buffer[start + k]       += t;
+            }
+        }
+    }
+
+    // Bins 1..N/2 (DC was removed with the mean)
+    const int bins_per_band = (FEATURE_FFT_SIZE / 2) / FEATURE_FFT_BANDS;
+    for (int k = 1; k <= FEATURE_FFT_SIZE / 2; ++k)
+        bands[(k - 1) / bins_per_band] += std::norm(buffer[k]) / FEATURE_FFT_SIZE;
+}
+
+// =========================================================================================
+//                                FEATURE EXTRACTION
+//==========================================================================================
+
+// Refills the arrays from the samples of a training
+void TrainingChannels::Load(const Training* training)
+{
+    for (int c = 0; c < NUM_FEATURE_CHANNELS; ++c)
+        values[c].clear();
+
+    unsigned int num_samples = training->size();
+    duration = 0;
+    if (num_samples == 0)
+        return;
+
+    for (unsigned int i = 0; i < num_samples; ++i)
+    {
+        const Sample* sample = training->sampleAt(i);
+        if (sample->getLogType() == WIIC_LOG_ACC)
+        {
+            const AccSample* acc = static_cast<const AccSample*>(sample);
+            values[CHANNEL_ACC_X].push_back(acc->x());
+            values[CHANNEL_ACC_Y].push_back(acc->y());
+            values[CHANNEL_ACC_Z].push_back(acc->z());
+        }
+        else if (sample->getLogType() == WIIC_LOG_GYRO)
+        {
+            const GyroSample* gyro = static_cast<const GyroSample*>(sample);
+            values[CHANNEL_GYRO_ROLL].push_back(gyro->roll());
+            values[CHANNEL_GYRO_PITCH].push_back(gyro->pitch());
+            values[CHANNEL_GYRO_YAW].push_back(gyro->yaw());
+        }
+    }
+
+    duration = training->sampleAt(num_samples - 1)->getTimestampFromGestureStart()
+             - training->sampleAt(0)->getTimestampFromGestureStart();
+}
+
+// Computes the feature row of a single training
+void Features_Compute(const TrainingChannels& channels, float* row)
+{
+    for (int c = 0; c < NUM_FEATURE_CHANNELS; ++c)
+    {
+        const float* x = channels.values[c].data();
+        size_t n = channels.values[c].size();
+        float* f = row + c * FEATURES_PER_CHANNEL;
+
+        if (n == 0)
+        {
+            for (int i = 0; i < FEATURES_PER_CHANNEL; ++i)
+                f[i] = 0.0f;
+            continue;
+        }
+
+        float mean     = Kernel_Sum(x, n) / n;
+        float variance = Kernel_SumSquares(x, n, mean) / n;
+
+        f[0] = mean;
+        f[1] = variance;
+        f[2] = Kernel_SumSquares(x, n, 0.0f) / n;
+        f[3] = (float)Kernel_ZeroCrossings(x, n, mean);
+        f[4] = (float)Kernel_Peaks(x, n, mean + std::sqrt(variance));
+        Kernel_BandPowers(x, n, mean, f + 5);
+    }
+
+    row[NUM_FEATURE_CHANNELS * FEATURES_PER_CHANNEL] = channels.duration / 1000.0f;
+}
+
+// Appends one row per training of the dataset, computing rows in parallel
+void Features_AppendDataset(const Dataset& dataset, int label, FeatureMatrix* features, ThreadPool& pool)
+{
+    printf("Extracting features of %u trainings... ", dataset.size());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    size_t first_row = features->rows;
+    features->rows += dataset.size();
+    features->data.resize(features->rows * features->cols);
+    features->labels.resize(features->rows, label);
+
+    ParallelFor(pool, dataset.size(), [&](size_t begin, size_t end)
+    {
+        // Scratch arrays reused by every training of the block
+        TrainingChannels channels;
+        for (size_t i = begin; i < end; ++i)
+        {
+            channels.Load(dataset.trainingAt(i));
+            Features_Compute(channels, features->Row(first_row + i));
+        }
+    }, 64);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("OK. (%.1f ms)\n", seconds * 1000.0);
+}
+
+// Name of a feature column
+const char* Features_ColumnName(size_t column, char* buffer, size_t buffer_size)
+{
+    static const char* channel_names[NUM_FEATURE_CHANNELS] = {
+        "acc_x", "acc_y", "acc_z", "gyro_roll", "gyro_pitch", "gyro_yaw"
+    };
+    static const char* feature_names[5] = {
+        "mean", "variance", "energy", "zero_crossings", "peaks"
+    };
+
+    if (column >= FEATURES_PER_TRAINING - 1)
+        snprintf(buffer, buffer_size, "duration");
+    else if (column % FEATURES_PER_CHANNEL < 5)
+        snprintf(buffer, buffer_size, "%s.%s", channel_names[column / FEATURES_PER_CHANNEL], feature_names[column % FEATURES_PER_CHANNEL]);
+    else
+        snprintf(buffer, buffer_size, "%s.band%d", channel_names[column / FEATURES_PER_CHANNEL], (int)(column % FEATURES_PER_CHANNEL - 5));
+
+    return buffer;
+}
@@ -0,0 +1,252 @@
+#include <cmath>
+#include <ctime>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <sys/time.h>
+
+#include "flightrecorder.h"
+#include "wiiclog.h"
+
+// Smallest power of two holding FLIGHT_RECORDER_SECONDS at FLIGHT_RECORDER_MAX_RATE
+static constexpr size_t RingCapacity(size_t n, size_t c = 1) { return c >= n ? c : RingCapacity(n, c * 2); }
+static const size_t RING_CAPACITY = RingCapacity(FLIGHT_RECORDER_SECONDS * FLIGHT_RECORDER_MAX_RATE);
+
+// Single producer ring overwriting its oldest entries. The producer never waits: the
+// reader copies the slots and then drops the ones the producer reused meanwhile.
+template <typename T>
+struct RecorderRing
+{
+    T entries[RING_CAPACITY];
+    std::atomic<uint64_t> head; // Total amount of entries ever pushed
+
+    RecorderRing() : head(0) { }
+
+    void Push(const T& entry)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        entries[h & (RING_CAPACITY - 1)] = entry;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    void Snapshot(std::vector<T>* out) const
+    {
+        uint64_t end   = head.load(std::memory_order_acquire);
+        uint64_t begin = end > RING_CAPACITY ? end - RING_CAPACITY : 0;
+
+        out->resize(end - begin);
+        for (uint64_t i = begin; i < end; ++i)
+            (*out)[i - begin] = entries[i & (RING_CAPACITY - 1)];
+
+        // Entries up to (head - capacity) may have been overwritten during the copy
+        uint64_t after = head.load(std::memory_order_acquire);
+        if (after >= RING_CAPACITY && after - RING_CAPACITY + 1 > begin)
+        {
+            uint64_t dropped = after - RING_CAPACITY + 1 - begin;
+            out->erase(out->begin(), out->begin() + (dropped < out->size() ? dropped : out->size()));
+        }
+    }
+};
+
+struct RecordedReport
+{
+    uint64_t timestamp;
+    float    gyro[3];  // roll, pitch, yaw rates (deg/s)
+    float    accel[3]; // gravity vector
+};
+
+struct RecordedPose
+{
+    uint64_t timestamp;
+    float    w, x, y, z;
+};
+
+// Recorder state
+static RecorderRing<RecordedReport> g_RecordedReports;
+static RecorderRing<RecordedPose>   g_RecordedPoses;
+static RecorderRing<uint64_t>       g_RecordedFrames;
+
+static std::string                  g_RecorderDeviceAddress;
+static std::thread                  g_RecorderThread;
+static std::mutex                   g_RecorderMutex;
+static std::condition_variable      g_RecorderWakeUp;
+static std::atomic<const char*>     g_RecorderDumpReason(NULL);
+static std::atomic<bool>            g_RecorderStopping(false);
+
+// Microseconds on the clock used by WiiC report timestamps
+uint64_t FlightRecorder_Now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Recording (sensor thread)
+void FlightRecorder_RecordReport(uint64_t timestamp, float roll_rate, float pitch_rate, float yaw_rate, float accel_x, float accel_y, float accel_z)
+{
+    RecordedReport report = { timestamp, { roll_rate, pitch_rate, yaw_rate }, { accel_x, accel_y, accel_z } };
+    g_RecordedReports.Push(report);
+
+    // Anomaly detection, at most one dump per recorded window
+    static uint64_t previous_timestamp = 0;
+    static uint64_t last_anomaly = 0;
+
+    // Timestamps going backwards (clock steps) are not gaps
+    bool gap = previous_timestamp != 0 && timestamp > previous_timestamp && timestamp - previous_timestamp > FLIGHT_RECORDER_GAP_THRESHOLD;
+    bool saturated = std::fabs(roll_rate) > FLIGHT_RECORDER_RATE_THRESHOLD
+                  || std::fabs(pitch_rate) > FLIGHT_RECORDER_RATE_THRESHOLD
+                  || std::fabs(yaw_rate) > FLIGHT_RECORDER_RATE_THRESHOLD;
+    previous_timestamp = timestamp;
+
+    if ((gap || saturated) && timestamp > last_anomaly + FLIGHT_RECORDER_SECONDS * 1000000ull)
+    {
+        last_anomaly = timestamp;
+        FlightRecorder_TriggerDump(gap ? "report gap" : "gyro saturation");
+    }
+}
+
+void FlightRecorder_RecordPose(uint64_t timestamp, float w, float x, float y, float z)
+{
+    RecordedPose pose = { timestamp, w, x, y, z };
+    g_RecordedPoses.Push(pose);
+}
+
+// Recording (render thread)
+void FlightRecorder_RecordFrame(uint64_t timestamp)
+{
+    g_RecordedFrames.Push(timestamp);
+}
+
+// Asks the dump thread to write the rings to disk
+void FlightRecorder_TriggerDump(const char* reason)
+{
+    g_RecorderDumpReason.store(reason);
+    g_RecorderWakeUp.notify_one();
+}
+
+// SIGUSR1 handler (only async-signal-safe work: an atomic store)
+static void FlightRecorder_SignalHandler(int)
+{
+    g_RecorderDumpReason.store("SIGUSR1");
+}
+
+// Milliseconds since local midnight, as used by WiiC training timestamps
+static unsigned long MillisecondsFromMidnight(uint64_t timestamp)
+{
+    time_t seconds = (time_t)(timestamp / 1000000);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    return (local.tm_hour*3600 + local.tm_min*60 + local.tm_sec) * 1000ul + (unsigned long)(timestamp / 1000 % 1000);
+}
+
+// Writes a snapshot of the rings as a single training
+static void FlightRecorder_Dump(const char* reason)
+{
+    std::vector<RecordedReport> reports;
+    std::vector<RecordedPose>   poses;
+    std::vector<uint64_t>       frames;
+    g_RecordedReports.Snapshot(&reports);
+    g_RecordedPoses.Snapshot(&poses);
+    g_RecordedFrames.Snapshot(&frames);
+
+    if (reports.empty() && poses.empty() && frames.empty())
+        return;
+
+    // Common time origin for every stream: the earliest entry of any of them, not the first,
+    // since the wall clock may have stepped back within the rings
+    uint64_t origin = UINT64_MAX;
+    for (size_t i = 0; i < reports.size(); ++i)
+        origin = std::min(origin, reports[i].timestamp);
+    for (size_t i = 0; i < poses.size(); ++i)
+        origin = std::min(origin, poses[i].timestamp);
+    for (size_t i = 0; i < frames.size(); ++i)
+        origin = std::min(origin, frames[i]);
+
+    char filename[64];
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(filename, sizeof(filename), "flightrecorder-%Y%m%d-%H%M%S.log", &local);
+
+    FILE* out = fopen(filename, "w");
+    if (!out)
+    {
+        fprintf(stderr, "ERROR: Cannot open file \"%s\".\n", filename);
+        return;
+    }
+
+    WiicLog_WriteHeader(out, g_RecorderDeviceAddress.c_str());
+    fprintf(out, "START %lu\n", MillisecondsFromMidnight(origin));
+    for (size_t i = 0; i < reports.size(); ++i)
+    {
+        const RecordedReport& r = reports[i];
+        unsigned long ms = (unsigned long)((r.timestamp - origin) / 1000);
+        fprintf(out, "ACC %lu %g %g %g\n", ms, r.accel[0], r.accel[1], r.accel[2]);
+        fprintf(out, "GYRO %lu %g %g %g\n", ms, r.gyro[0], r.gyro[1], r.gyro[2]);
+    }
+    fprintf(out, "END\n");
+    fclose(out);
+
+    std::string poses_filename = std::string(filename) + ".poses";
+    out = fopen(poses_filename.c_str(), "w");
+    if (out)
+    {
+        for (size_t i = 0; i < poses.size(); ++i)
+            fprintf(out, "POSE %lu %g %g %g %g\n", (unsigned long)((poses[i].timestamp - origin) / 1000),
+                    poses[i].w, poses[i].x, poses[i].y, poses[i].z);
+        for (size_t i = 0; i < frames.size(); ++i)
+            fprintf(out, "FRAME %lu\n", (unsigned long)((frames[i] - origin) / 1000));
+        fclose(out);
+    }
+
+    printf("Flight recorder dump (%s): \"%s\" (%u reports, %u poses, %u frames)\n", reason, filename,
+           (unsigned)reports.size(), (unsigned)poses.size(), (unsigned)frames.size());
+    fflush(stdout);
+}
+
+// Dump thread: waits for requests (signals are only noticed by the periodic wake up)
+static void FlightRecorder_Thread()
+{
+    while (!g_RecorderStopping)
+    {
+        {
+            std::unique_lock<std::mutex> lock(g_RecorderMutex);
+            g_RecorderWakeUp.wait_for(lock, std::chrono::milliseconds(100));
+        }
+
+        const char* reason = g_RecorderDumpReason.exchange(NULL);
+        if (reason)
+            FlightRecorder_Dump(reason);
+    }
+}
+
+// Starts the dump thread and installs the SIGUSR1 handler
+void FlightRecorder_Start(const char* device_address)
+{
+    if (g_RecorderThread.joinable())
+        return;
+
+    g_RecorderDeviceAddress = device_address ? device_address : "";
+    g_RecorderStopping = false;
+    g_RecorderThread = std::thread(FlightRecorder_Thread);
+
+    signal(SIGUSR1, FlightRecorder_SignalHandler);
+}
+
+void FlightRecorder_Stop()
+{
+    if (!g_RecorderThread.joinable())
+        return;
+
+    signal(SIGUSR1, SIG_DFL);
+    g_RecorderStopping = true;
+    g_RecorderWakeUp.notify_one();
+    g_RecorderThread.join();
+}
@@ -0,0 +1,75 @@
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include "framepacing.h"
+#include "flightrecorder.h"
+
+// Single writer: the orientation quaternion of the report at timestamp (usec)
+void PoseLatch::Publish(uint64_t time, float w, float x, float y, float z)
+{
+    uint32_t start = sequence.load(std::memory_order_relaxed);
+    sequence.store(start + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    timestamp.store(time, std::memory_order_relaxed);
+    orientation[0].store(w, std::memory_order_relaxed);
+    orientation[1].store(x, std::memory_order_relaxed);
+    orientation[2].store(y, std::memory_order_relaxed);
+    orientation[3].store(z, std::memory_order_relaxed);
+
+    sequence.store(start + 2, std::memory_order_release);
+}
+
+// Any thread: the last published orientation (w, x, y, z), returns its report timestamp
+uint64_t PoseLatch::Read(float pose[4]) const
+{
+    for (;;)
+    {
+        uint32_t start = sequence.load(std::memory_order_acquire);
+        uint64_t time = timestamp.load(std::memory_order_relaxed);
+        for (int i = 0; i < 4; ++i)
+            pose[i] = orientation[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (!(start & 1) && sequence.load(std::memory_order_relaxed) == start)
+            return time;
+    }
+}
+
+// Sleeps until the latest start that still makes the refresh after the last present
+uint64_t FramePacer::WaitForDeadline()
+{
+    if (!interval || !last_present)
+        return 0;
+
+    // The refresh after the last present, minus the work and margin of the next frame
+    uint64_t budget = PredictedWork() + FRAME_PACING_MARGIN;
+    if (budget >= interval)
+        return 0;
+    uint64_t deadline = last_present + interval - budget;
+
+    uint64_t now = FlightRecorder_Now();
+    if (now >= deadline)
+        return 0;
+    std::this_thread::sleep_for(std::chrono::microseconds(deadline - now));
+    return FlightRecorder_Now() - now;
+}
+
+// Frame start, the time its commands were submitted, and the time its swap returned
+void FramePacer::FramePresented(uint64_t frame_start, uint64_t submitted, uint64_t presented)
+{
+    work[next] = submitted > frame_start ? submitted - frame_start : 0;
+    next = (next + 1) % FRAME_PACING_HISTORY;
+    count = std::min(count + 1, (size_t)FRAME_PACING_HISTORY);
+    last_present = presented;
+}
+
+// Predicted CPU work of the next frame: the slowest of the last frames
+uint64_t FramePacer::PredictedWork() const
+{
+    uint64_t slowest = 0;
+    for (size_t i = 0; i < count; ++i)
+        slowest = std::max(slowest, work[i]);
+    return slowest;
+}
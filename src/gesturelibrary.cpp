@@ -0,0 +1,450 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "gesturelibrary.h"
+#include "datasetloader.h"
+
+// =========================================================================================
+//                                      LAYOUT
+//==========================================================================================
+
+static size_t AlignSection(size_t offset)
+{
+    return (offset + 63) & ~(size_t)63;
+}
+
+// Section offsets of a library with the given header
+struct LibraryLayout
+{
+    size_t names, labels, embeddings, nodes, sequences, upper, lower, size;
+
+    LibraryLayout(const GestureLibraryHeader& header)
+    {
+        size_t sequences_size = (size_t)header.num_templates * GESTURE_SEQUENCE_SIZE * sizeof(float);
+        names      = AlignSection(sizeof(GestureLibraryHeader));
+        labels     = AlignSection(names + (size_t)header.num_classes * GESTURE_NAME_SIZE);
+        embeddings = AlignSection(labels + (size_t)header.num_templates * sizeof(int32_t));
+        nodes      = AlignSection(embeddings + (size_t)header.num_templates * GESTURE_EMBEDDING_SIZE * sizeof(float));
+        sequences  = AlignSection(nodes + (size_t)header.num_nodes * sizeof(GestureLibraryNode));
+        upper      = AlignSection(sequences + sequences_size);
+        lower      = AlignSection(upper + sequences_size);
+        size       = lower + sequences_size;
+    }
+};
+
+// Embedding of a resampled gesture
+void GestureLibrary_Embed(const float* sequence, float* embedding)
+{
+    const int span = GESTURE_LENGTH / GESTURE_EMBEDDING_SEGMENTS;
+
+    // Scaled by sqrt(span), so embedding distances approximate sequence distances
+    float scale = 1.0f / std::sqrt((float)span);
+    for (int s = 0; s < GESTURE_EMBEDDING_SEGMENTS; ++s)
+    {
+        for (int c = 0; c < NUM_FEATURE_CHANNELS; ++c)
+        {
+            float sum = 0.0f;
+            for (int i = s * span; i < (s + 1) * span; ++i)
+                sum += sequence[i * GESTURE_FRAME_STRIDE + c];
+            embedding[s * NUM_FEATURE_CHANNELS + c] = sum * scale;
+        }
+    }
+}
+
+// FNV-1a over the class names, each with its terminator
+static uint32_t HashNames(const std::vector<std::string>& names)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t n = 0; n < names.size(); ++n)
+        for (size_t i = 0; i <= names[n].size(); ++i)
+            hash = (hash ^ (uint8_t)names[n].c_str()[i]) * 16777619u;
+    return hash;
+}
+
+static float EmbeddingDistance(const float* a, const float* b)
+{
+    float sum = 0.0f;
+    for (int d = 0; d < GESTURE_EMBEDDING_SIZE; ++d)
+        sum += (a[d] - b[d]) * (a[d] - b[d]);
+    return sum;
+}
+
+// =========================================================================================
+//                                     BUILDING
+//==========================================================================================
+
+// Splits order[begin, end) on the dimension of largest spread, around its median
+static int32_t BuildNode(const std::vector<float>& embeddings, std::vector<int>& order, int begin, int end, std::vector<GestureLibraryNode>* nodes)
+{
+    int32_t index = (int32_t)nodes->size();
+    GestureLibraryNode node = { -1, 0.0f, -1, -1, begin, end };
+    nodes->push_back(node);
+
+    if (end - begin <= GESTURE_LIBRARY_LEAF_SIZE)
+        return index;
+
+    int dimension = 0;
+    float widest = -1.0f;
+    for (int d = 0; d < GESTURE_EMBEDDING_SIZE; ++d)
+    {
+        float low = INFINITY, high = -INFINITY;
+        for (int i = begin; i < end; ++i)
+        {
+            low  = std::min(low,  embeddings[order[i] * GESTURE_EMBEDDING_SIZE + d]);
+            high = std::max(high, embeddings[order[i] * GESTURE_EMBEDDING_SIZE + d]);
+        }
+        if (high - low > widest)
+        {
+            widest = high - low;
+            dimension = d;
+        }
+    }
+
+    int middle = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](int a, int b)
+    {
+        return embeddings[a * GESTURE_EMBEDDING_SIZE + dimension] < embeddings[b * GESTURE_EMBEDDING_SIZE + dimension];
+    });
+
+    (*nodes)[index].dimension = dimension;
+    (*nodes)[index].split = embeddings[order[middle] * GESTURE_EMBEDDING_SIZE + dimension];
+    int32_t left  = BuildNode(embeddings, order, begin, middle, nodes);
+    int32_t right = BuildNode(embeddings, order, middle, end, nodes);
+    (*nodes)[index].left  = left;
+    (*nodes)[index].right = right;
+    return index;
+}
+
+static void WriteSection(FILE* out, size_t offset, const void* data, size_t size)
+{
+    fseek(out, (long)offset, SEEK_SET);
+    if (size > 0)
+        fwrite(data, 1, size, out);
+}
+
+// Builds the index and writes a library file
+bool GestureLibrary_Write(const char* filename, const std::vector<GestureSequence>& sequences,
+                          const std::vector<int>& labels, const std::vector<std::string>& names, size_t band)
+{
+    size_t count = sequences.size();
+
+    std::vector<float> embeddings(count * GESTURE_EMBEDDING_SIZE);
+    for (size_t i = 0; i < count; ++i)
+        GestureLibrary_Embed(sequences[i].Data(), &embeddings[i * GESTURE_EMBEDDING_SIZE]);
+
+    std::vector<int> order(count);
+    for (size_t i = 0; i < count; ++i)
+        order[i] = (int)i;
+
+    std::vector<GestureLibraryNode> nodes;
+    if (count > 0)
+        BuildNode(embeddings, order, 0, (int)count, &nodes);
+
+    // Sections in tree order
+    std::vector<char>    name_table(names.size() * GESTURE_NAME_SIZE, '\0');
+    std::vector<int32_t> sorted_labels(count);
+    std::vector<float>   sorted_embeddings(count * GESTURE_EMBEDDING_SIZE);
+    std::vector<float>   sorted_sequences(count * GESTURE_SEQUENCE_SIZE);
+    std::vector<float>   upper(count * GESTURE_SEQUENCE_SIZE), lower(count * GESTURE_SEQUENCE_SIZE);
+
+    for (size_t c = 0; c < names.size(); ++c)
+        strncpy(&name_table[c * GESTURE_NAME_SIZE], names[c].c_str(), GESTURE_NAME_SIZE - 1);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        int source = order[i];
+        sorted_labels[i] = labels[source];
+        std::copy(&embeddings[source * GESTURE_EMBEDDING_SIZE], &embeddings[(source + 1) * GESTURE_EMBEDDING_SIZE],
+                  &sorted_embeddings[i * GESTURE_EMBEDDING_SIZE]);
+        std::copy(sequences[source].frames.begin(), sequences[source].frames.end(), &sorted_sequences[i * GESTURE_SEQUENCE_SIZE]);
+        Gesture_Envelope(sequences[source].Data(), band, &upper[i * GESTURE_SEQUENCE_SIZE], &lower[i * GESTURE_SEQUENCE_SIZE]);
+    }
+
+    GestureLibraryHeader header;
+    header.magic          = GESTURE_LIBRARY_MAGIC;
+    header.version        = GESTURE_LIBRARY_VERSION;
+    header.sequence_size  = GESTURE_SEQUENCE_SIZE;
+    header.embedding_size = GESTURE_EMBEDDING_SIZE;
+    header.num_classes    = (uint32_t)names.size();
+    header.num_templates  = (uint32_t)count;
+    header.num_nodes      = (uint32_t)nodes.size();
+    header.band           = (uint32_t)band;
+    header.classes_hash   = HashNames(names);
+    LibraryLayout layout(header);
+
+    // Written beside the target and renamed, so a mapped library is never modified
+    std::string temporary = std::string(filename) + ".tmp";
+    FILE* out = fopen(temporary.c_str(), "wb");
+    if (!out)
+    {
+        fprintf(stderr, "ERROR: Cannot open file \"%s\".\n", temporary.c_str());
+        return false;
+    }
+
+    size_t sequences_size = count * GESTURE_SEQUENCE_SIZE * sizeof(float);
+    WriteSection(out, 0, &header, sizeof(header));
+    WriteSection(out, layout.names, name_table.data(), name_table.size());
+    WriteSection(out, layout.labels, sorted_labels.data(), count * sizeof(int32_t));
+    WriteSection(out, layout.embeddings, sorted_embeddings.data(), sorted_embeddings.size() * sizeof(float));
+    WriteSection(out, layout.nodes, nodes.data(), nodes.size() * sizeof(GestureLibraryNode));
+    WriteSection(out, layout.sequences, sorted_sequences.data(), sequences_size);
+    WriteSection(out, layout.upper, upper.data(), sequences_size);
+    WriteSection(out, layout.lower, lower.data(), sequences_size);
+
+    bool ok = !ferror(out);
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), filename) != 0)
+    {
+        fprintf(stderr, "ERROR: Cannot write file \"%s\".\n", filename);
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Lists the "*.log" files of a directory, sorted
+static bool ListDatasets(const char* directory, std::vector<std::string>* datasets)
+{
+    DIR* dir = opendir(directory);
+    if (!dir)
+        return false;
+
+    while (struct dirent* entry = readdir(dir))
+    {
+        size_t length = strlen(entry->d_name);
+        if (length > 4 && strcmp(entry->d_name + length - 4, ".log") == 0)
+            datasets->push_back(entry->d_name);
+    }
+    closedir(dir);
+    std::sort(datasets->begin(), datasets->end());
+    return true;
+}
+
+// Loads a directory of "<class name>.log" datasets, one class per file
+bool GestureLibrary_LoadDirectory(const char* directory, std::vector<GestureSequence>* sequences, std::vector<int>* labels,
+                                  std::vector<std::string>* names, ThreadPool& pool)
+{
+    std::vector<std::string> datasets;
+    if (!ListDatasets(directory, &datasets))
+        return false;
+
+    for (size_t f = 0; f < datasets.size(); ++f)
+    {
+        Dataset dataset;
+        if (!Dataset_LoadParallel(&dataset, std::string(directory) + "/" + datasets[f], pool))
+            continue;
+
+        std::vector<GestureSequence> loaded;
+        Gesture_LoadDataset(dataset, &loaded, pool);
+
+        int label = (int)names->size();
+        names->push_back(datasets[f].substr(0, datasets[f].size() - 4));
+        sequences->insert(sequences->end(), loaded.begin(), loaded.end());
+        labels->insert(labels->end(), loaded.size(), label);
+    }
+    return !names->empty();
+}
+
+// Rebuilds the library when it is missing, outdated, older than any dataset of the directory,
+// or when its classes are not those datasets (one was added or removed)
+bool GestureLibrary_Update(const char* directory, const char* filename, ThreadPool& pool)
+{
+    std::vector<std::string> datasets;
+    if (!ListDatasets(directory, &datasets))
+        return false;
+
+    // Libraries of another version are rebuilt; current ones keep their band (it may come from gesturetrain)
+    GestureLibraryHeader header;
+    FILE* in = fopen(filename, "rb");
+    bool valid = in && fread(&header, sizeof(header), 1, in) == 1
+              && header.magic == GESTURE_LIBRARY_MAGIC && header.version == GESTURE_LIBRARY_VERSION;
+    if (in)
+        fclose(in);
+    size_t band = valid ? header.band : GESTURE_BAND;
+
+    std::vector<std::string> classes;
+    for (size_t f = 0; f < datasets.size(); ++f)
+        classes.push_back(datasets[f].substr(0, datasets[f].size() - 4));
+
+    struct stat library_stat;
+    bool stale = !valid || header.num_classes != classes.size() || header.classes_hash != HashNames(classes)
+              || stat(filename, &library_stat) != 0;
+    for (size_t f = 0; f < datasets.size() && !stale; ++f)
+    {
+        struct stat dataset_stat;
+        std::string path = std::string(directory) + "/" + datasets[f];
+        stale = stat(path.c_str(), &dataset_stat) == 0 && dataset_stat.st_mtime >= library_stat.st_mtime;
+    }
+    if (!stale)
+        return true;
+
+    std::vector<GestureSequence> sequences;
+    std::vector<int> labels;
+    std::vector<std::string> names;
+    GestureLibrary_LoadDirectory(directory, &sequences, &labels, &names, pool);
+
+    printf("Writing Gesture Library \"%s\"... ", filename);
+    fflush(stdout);
+    if (!GestureLibrary_Write(filename, sequences, labels, names, band))
+        return false;
+    printf("OK. (%u classes, %u templates)\n", (unsigned)names.size(), (unsigned)sequences.size());
+    return true;
+}
+
+// =========================================================================================
+//                                      LOOKUP
+//==========================================================================================
+
+// Tree nodes from the file are used as indices: children must come after their parent (so
+// every descent ends) and leaves must cover templates of the library
+static bool ValidNodes(const GestureLibraryNode* nodes, const GestureLibraryHeader& header)
+{
+    if (header.num_templates > 0 && header.num_nodes == 0)
+        return false;
+
+    for (int32_t n = 0; n < (int32_t)header.num_nodes; ++n)
+    {
+        const GestureLibraryNode& node = nodes[n];
+        if (node.dimension == -1)
+        {
+            if (node.begin < 0 || node.begin > node.end || node.end > (int32_t)header.num_templates)
+                return false;
+        }
+        else if (node.dimension < 0 || node.dimension >= GESTURE_EMBEDDING_SIZE
+                 || node.left <= n || node.left >= (int32_t)header.num_nodes
+                 || node.right <= n || node.right >= (int32_t)header.num_nodes)
+            return false;
+    }
+    return true;
+}
+
+// Labels must name a class, and class names must be terminated
+static bool ValidLabels(const int32_t* labels, const char* names, const GestureLibraryHeader& header)
+{
+    for (uint32_t i = 0; i < header.num_templates; ++i)
+        if (labels[i] < 0 || labels[i] >= (int32_t)header.num_classes)
+            return false;
+    for (uint32_t c = 0; c < header.num_classes; ++c)
+        if (names[(c + 1) * GESTURE_NAME_SIZE - 1] != '\0')
+            return false;
+    return true;
+}
+
+// Maps a library file, checking its header, size, tree and labels
+bool GestureLibrary::Open(const char* filename)
+{
+    Close();
+    if (!file.Open(filename))
+        return false;
+
+    printf("Loading Gesture Library \"%s\"... ", filename);
+
+    const GestureLibraryHeader* h = (const GestureLibraryHeader*)file.data;
+    bool valid = file.size >= sizeof(GestureLibraryHeader) && h->magic == GESTURE_LIBRARY_MAGIC && h->version == GESTURE_LIBRARY_VERSION
+              && h->sequence_size == GESTURE_SEQUENCE_SIZE && h->embedding_size == GESTURE_EMBEDDING_SIZE && h->band < GESTURE_LENGTH
+              && h->num_classes <= INT32_MAX && h->num_templates <= INT32_MAX && h->num_nodes <= INT32_MAX;
+
+    LibraryLayout layout = valid ? LibraryLayout(*h) : LibraryLayout(GestureLibraryHeader());
+    valid = valid && file.size >= layout.size
+         && ValidNodes((const GestureLibraryNode*)(file.data + layout.nodes), *h)
+         && ValidLabels((const int32_t*)(file.data + layout.labels), file.data + layout.names, *h);
+    if (!valid)
+    {
+        fprintf(stderr, "\nERROR: Bad gesture library \"%s\".\n", filename);
+        file.Close();
+        return false;
+    }
+
+    header     = h;
+    names      = file.data + layout.names;
+    labels     = (const int32_t*)(file.data + layout.labels);
+    embeddings = (const float*)(file.data + layout.embeddings);
+    nodes      = (const GestureLibraryNode*)(file.data + layout.nodes);
+    sequences  = (const float*)(file.data + layout.sequences);
+    upper      = (const float*)(file.data + layout.upper);
+    lower      = (const float*)(file.data + layout.lower);
+
+    printf("OK. (%u classes, %u templates)\n", h->num_classes, h->num_templates);
+    return true;
+}
+
+void GestureLibrary::Close()
+{
+    file.Close();
+    header = NULL;
+}
+
+GestureTemplates GestureLibrary::Templates() const
+{
+    GestureTemplates templates = { sequences, upper, lower, labels, Size(), header ? header->band : GESTURE_BAND };
+    return templates;
+}
+
+// Best bin first: nodes are visited by increasing distance bound to their cell, keeping
+// the closest templates, until max_leaves leaves were scanned or no cell can improve them
+void GestureLibrary::Candidates(const float* embedding, size_t count, size_t max_leaves, std::vector<std::pair<float, int> >* candidates) const
+{
+    candidates->clear();
+    if (Size() == 0 || count == 0)
+        return;
+
+    typedef std::pair<float, int32_t> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > cells;
+    std::priority_queue<Entry> nearest; // Max heap of the best templates so far
+
+    cells.push(Entry(0.0f, 0));
+    size_t leaves = 0;
+    while (!cells.empty() && leaves < max_leaves)
+    {
+        Entry cell = cells.top();
+        cells.pop();
+        if (nearest.size() == count && cell.first >= nearest.top().first)
+            break;
+
+        // Descend to the nearest leaf, queueing the far sides
+        const GestureLibraryNode* node = &nodes[cell.second];
+        while (node->dimension >= 0)
+        {
+            float difference = embedding[node->dimension] - node->split;
+            int32_t near = difference < 0.0f ? node->left : node->right;
+            int32_t far  = difference < 0.0f ? node->right : node->left;
+            cells.push(Entry(std::max(cell.first, difference * difference), far));
+            node = &nodes[near];
+        }
+
+        for (int32_t i = node->begin; i < node->end; ++i)
+        {
+            float distance = EmbeddingDistance(embedding, embeddings + (size_t)i * GESTURE_EMBEDDING_SIZE);
+            if (nearest.size() < count)
+                nearest.push(Entry(distance, i));
+            else if (distance < nearest.top().first)
+            {
+                nearest.pop();
+                nearest.push(Entry(distance, i));
+            }
+        }
+        ++leaves;
+    }
+
+    candidates->resize(nearest.size());
+    for (size_t k = nearest.size(); k-- > 0; nearest.pop())
+        (*candidates)[k] = nearest.top();
+}
+
+// Classifies a gesture: k-d tree candidates, then exact DTW over them
+bool GestureLibrary::Classify(const GestureSequence& sequence, GestureMatch* match) const
+{
+    float embedding[GESTURE_EMBEDDING_SIZE];
+    GestureLibrary_Embed(sequence.Data(), embedding);
+
+    std::vector<std::pair<float, int> > candidates;
+    Candidates(embedding, GESTURE_LIBRARY_CANDIDATES, GESTURE_LIBRARY_MAX_LEAVES, &candidates);
+
+    Gesture_MatchCandidates(Templates(), sequence.Data(), candidates, false, match);
+    return match->label >= 0;
+}
@@ -0,0 +1,410 @@
+#include <cmath>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "gesturerecognizer.h"
+
+// =========================================================================================
+//                                  FRAME KERNELS
+//==========================================================================================
+
+// Squared distance between two frames
+static inline float Kernel_FrameDistance(const float* a, const float* b)
+{
+    #ifdef __SSE2__
+    __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a), _mm_loadu_ps(b));
+    __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + 4), _mm_loadu_ps(b + 4));
+    __m128 s  = _mm_add_ps(_mm_mul_ps(d0, d0), _mm_mul_ps(d1, d1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+    #else
+    float sum = 0.0f;
+    for (int c = 0; c < GESTURE_FRAME_STRIDE; ++c)
+        sum += (a[c] - b[c]) * (a[c] - b[c]);
+    return sum;
+    #endif
+}
+
+// Squared distances between x and the four frames starting at b
+static inline void Kernel_FrameDistances4(const float* x, const float* b, float* out)
+{
+    #ifdef __SSE2__
+    __m128 x0 = _mm_loadu_ps(x), x1 = _mm_loadu_ps(x + 4);
+    __m128 s[4];
+    for (int k = 0; k < 4; ++k)
+    {
+        const float* y = b + k * GESTURE_FRAME_STRIDE;
+        __m128 d0 = _mm_sub_ps(x0, _mm_loadu_ps(y));
+        __m128 d1 = _mm_sub_ps(x1, _mm_loadu_ps(y + 4));
+        s[k] = _mm_add_ps(_mm_mul_ps(d0, d0), _mm_mul_ps(d1, d1));
+    }
+    _MM_TRANSPOSE4_PS(s[0], s[1], s[2], s[3]);
+    _mm_storeu_ps(out, _mm_add_ps(_mm_add_ps(s[0], s[1]), _mm_add_ps(s[2], s[3])));
+    #else
+    for (int k = 0; k < 4; ++k)
+        out[k] = Kernel_FrameDistance(x, b + k * GESTURE_FRAME_STRIDE);
+    #endif
+}
+
+// Squared distance of a frame outside [lower, upper]
+static inline float Kernel_EnvelopeDistance(const float* x, const float* upper, const float* lower)
+{
+    #ifdef __SSE2__
+    __m128 zero = _mm_setzero_ps();
+    __m128 x0 = _mm_loadu_ps(x), x1 = _mm_loadu_ps(x + 4);
+    __m128 d0 = _mm_add_ps(_mm_max_ps(_mm_sub_ps(x0, _mm_loadu_ps(upper)), zero),
+                           _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(lower), x0), zero));
+    __m128 d1 = _mm_add_ps(_mm_max_ps(_mm_sub_ps(x1, _mm_loadu_ps(upper + 4)), zero),
+                           _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(lower + 4), x1), zero));
+    __m128 s  = _mm_add_ps(_mm_mul_ps(d0, d0), _mm_mul_ps(d1, d1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+    #else
+    float sum = 0.0f;
+    for (int c = 0; c < GESTURE_FRAME_STRIDE; ++c)
+    {
+        float d = x[c] > upper[c] ? x[c] - upper[c] : (x[c] < lower[c] ? lower[c] - x[c] : 0.0f);
+        sum += d*d;
+    }
+    return sum;
+    #endif
+}
+
+// out = min(max(x, lower), upper)
+static inline void Kernel_Clamp(const float* x, const float* upper, const float* lower, float* out)
+{
+    for (int c = 0; c < GESTURE_FRAME_STRIDE; ++c)
+        out[c] = std::min(std::max(x[c], lower[c]), upper[c]);
+}
+
+// =========================================================================================
+//                                     SEQUENCES
+//==========================================================================================
+
+// Resamples the channels of a training
+void GestureSequence::Load(const TrainingChannels& channels)
+{
+    std::fill(frames.begin(), frames.end(), 0.0f);
+
+    for (int c = 0; c < NUM_FEATURE_CHANNELS; ++c)
+    {
+        const std::vector<float>& x = channels.values[c];
+        size_t n = x.size();
+        if (n == 0)
+            continue;
+
+        float scale = c < CHANNEL_GYRO_ROLL ? GESTURE_ACC_SCALE : GESTURE_GYRO_SCALE;
+        float step  = (float)(n - 1) / (GESTURE_LENGTH - 1);
+        for (int i = 0; i < GESTURE_LENGTH; ++i)
+        {
+            float pos  = i * step;
+            size_t i0  = std::min((size_t)pos, n - 1);
+            size_t i1  = i0 + 1 < n ? i0 + 1 : i0;
+            float frac = pos - i0;
+            Frame(i)[c] = (x[i0] + (x[i1] - x[i0]) * frac) * scale;
+        }
+    }
+}
+
+// Resamples every training of a dataset in parallel
+void Gesture_LoadDataset(const Dataset& dataset, std::vector<GestureSequence>* sequences, ThreadPool& pool)
+{
+    sequences->resize(dataset.size());
+    ParallelFor(pool, sequences->size(), [&](size_t begin, size_t end)
+    {
+        TrainingChannels channels;
+        for (size_t i = begin; i < end; ++i)
+        {
+            channels.Load(dataset.trainingAt(i));
+            (*sequences)[i].Load(channels);
+        }
+    });
+}
+
+// Upper and lower envelopes of a sequence over a window of band frames on each side
+void Gesture_Envelope(const float* sequence, size_t band, float* upper, float* lower)
+{
+    for (size_t i = 0; i < GESTURE_LENGTH; ++i)
+    {
+        size_t first = i > band ? i - band : 0;
+        size_t last  = std::min(i + band, (size_t)GESTURE_LENGTH - 1);
+
+        float* u = upper + i * GESTURE_FRAME_STRIDE;
+        float* l = lower + i * GESTURE_FRAME_STRIDE;
+        const float* x = sequence + first * GESTURE_FRAME_STRIDE;
+
+        #ifdef __SSE2__
+        __m128 u0 = _mm_loadu_ps(x), u1 = _mm_loadu_ps(x + 4);
+        __m128 l0 = u0, l1 = u1;
+        for (size_t j = first + 1; j <= last; ++j)
+        {
+            x += GESTURE_FRAME_STRIDE;
+            __m128 x0 = _mm_loadu_ps(x), x1 = _mm_loadu_ps(x + 4);
+            u0 = _mm_max_ps(u0, x0); u1 = _mm_max_ps(u1, x1);
+            l0 = _mm_min_ps(l0, x0); l1 = _mm_min_ps(l1, x1);
+        }
+        _mm_storeu_ps(u, u0); _mm_storeu_ps(u + 4, u1);
+        _mm_storeu_ps(l, l0); _mm_storeu_ps(l + 4, l1);
+        #else
+        std::copy(x, x + GESTURE_FRAME_STRIDE, u);
+        std::copy(x, x + GESTURE_FRAME_STRIDE, l);
+        for (size_t j = first + 1; j <= last; ++j)
+        {
+            x += GESTURE_FRAME_STRIDE;
+            for (int c = 0; c < GESTURE_FRAME_STRIDE; ++c)
+            {
+                u[c] = std::max(u[c], x[c]);
+                l[c] = std::min(l[c], x[c]);
+            }
+        }
+        #endif
+    }
+}
+
+// =========================================================================================
+//                                    DISTANCES
+//==========================================================================================
+
+// Squared distance of x outside the envelope, abandoning once it exceeds limit
+float Gesture_LowerBoundKeogh(const float* x, const float* upper, const float* lower, float limit)
+{
+    float sum = 0.0f;
+
+    // Eight frames between checks of the limit
+    for (size_t i = 0; i < GESTURE_SEQUENCE_SIZE; i += 8 * GESTURE_FRAME_STRIDE)
+    {
+        #ifdef __SSE2__
+        __m128 zero = _mm_setzero_ps();
+        __m128 acc  = _mm_setzero_ps();
+        for (size_t k = i; k < i + 8 * GESTURE_FRAME_STRIDE; k += 4)
+        {
+            __m128 v = _mm_loadu_ps(x + k);
+            __m128 d = _mm_add_ps(_mm_max_ps(_mm_sub_ps(v, _mm_loadu_ps(upper + k)), zero),
+                                  _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(lower + k), v), zero));
+            acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, acc);
+        sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        #else
+        for (size_t k = i; k < i + 8 * GESTURE_FRAME_STRIDE; k += GESTURE_FRAME_STRIDE)
+            sum += Kernel_EnvelopeDistance(x + k, upper + k, lower + k);
+        #endif
+
+        if (sum > limit)
+            break;
+    }
+    return sum;
+}
+
+// LB_Improved (Lemire): LB_Keogh of the query, plus LB_Keogh of the template against the
+// envelope of the query projected onto the template envelope
+static float LowerBoundImproved(const float* query, float keogh, const float* candidate,
+                                const float* upper, const float* lower, size_t band, float limit)
+{
+    float projection[GESTURE_SEQUENCE_SIZE];
+    float projection_upper[GESTURE_SEQUENCE_SIZE];
+    float projection_lower[GESTURE_SEQUENCE_SIZE];
+    for (size_t k = 0; k < GESTURE_SEQUENCE_SIZE; k += GESTURE_FRAME_STRIDE)
+        Kernel_Clamp(query + k, upper + k, lower + k, projection + k);
+
+    Gesture_Envelope(projection, band, projection_upper, projection_lower);
+    return keogh + Gesture_LowerBoundKeogh(candidate, projection_upper, projection_lower, limit - keogh);
+}
+
+// DTW distance inside a Sakoe-Chiba band. Abandoned once the cheapest path through a
+// row, plus the lower bound of the rows left (tail_bound[i + 1], optional), exceeds limit.
+float Gesture_DTW(const float* a, const float* b, size_t band, float limit, const float* tail_bound)
+{
+    // Rows of the cost matrix, shifted by one so column -1 is the border
+    float rows[2][GESTURE_LENGTH + 1];
+    float costs[GESTURE_LENGTH];
+    float* previous = rows[0];
+    float* current  = rows[1];
+
+    std::fill(previous, previous + GESTURE_LENGTH + 1, INFINITY);
+    previous[0] = 0.0f;
+
+    for (size_t i = 0; i < GESTURE_LENGTH; ++i)
+    {
+        size_t first = i > band ? i - band : 0;
+        size_t last  = std::min(i + band, (size_t)GESTURE_LENGTH - 1);
+
+        // Frame distances first (independent, SIMD), then the dependent recurrence
+        const float* x = a + i * GESTURE_FRAME_STRIDE;
+        size_t j = first;
+        for (; j + 4 <= last + 1; j += 4)
+            Kernel_FrameDistances4(x, b + j * GESTURE_FRAME_STRIDE, costs + j);
+        for (; j <= last; ++j)
+            costs[j] = Kernel_FrameDistance(x, b + j * GESTURE_FRAME_STRIDE);
+
+        std::fill(current, current + GESTURE_LENGTH + 1, INFINITY);
+        float row_min = INFINITY;
+        for (size_t j = first; j <= last; ++j)
+        {
+            float best = std::min(std::min(previous[j + 1], previous[j]), current[j]);
+            current[j + 1] = best + costs[j];
+            row_min = std::min(row_min, current[j + 1]);
+        }
+
+        float remaining = tail_bound && i + 1 < GESTURE_LENGTH ? tail_bound[i + 1] : 0.0f;
+        if (row_min + remaining > limit)
+            return row_min + remaining;
+        std::swap(previous, current);
+    }
+
+    return previous[GESTURE_LENGTH];
+}
+
+// Nearest neighbour among the candidates. Every pruned candidate leaves a lower bound of
+// its distance, so the distance to the nearest other class, and with it the confidence,
+// is bounded without computing any extra DTW.
+void Gesture_MatchCandidates(const GestureTemplates& templates, const float* query,
+                             const std::vector<std::pair<float, int> >& candidates, bool keys_are_bounds, GestureMatch* match)
+{
+    match->label = -1;
+    match->index = -1;
+    match->distance = INFINITY;
+    match->confidence = 0.0f;
+    match->candidates = candidates.size();
+    match->pruned_keogh = 0;
+    match->pruned_improved = 0;
+    match->computed = 0;
+
+    // Distance (or lower bound) of every visited candidate, to bound the nearest other class
+    std::vector<float> bounds(candidates.size(), INFINITY);
+    float tail_bound[GESTURE_LENGTH + 1];
+
+    float best = INFINITY;
+    size_t k = 0;
+    for (; k < candidates.size(); ++k)
+    {
+        int i = candidates[k].second;
+        const float* upper = templates.Upper(i);
+        const float* lower = templates.Lower(i);
+
+        float keogh = keys_are_bounds ? candidates[k].first : Gesture_LowerBoundKeogh(query, upper, lower, best);
+        if (keogh >= best)
+        {
+            // Sorted bounds: no later candidate can beat the nearest one
+            if (keys_are_bounds)
+                break;
+            bounds[k] = keogh;
+            ++match->pruned_keogh;
+            continue;
+        }
+
+        float improved = LowerBoundImproved(query, keogh, templates.Sequence(i), upper, lower, templates.band, best);
+        if (improved >= best)
+        {
+            bounds[k] = improved;
+            ++match->pruned_improved;
+            continue;
+        }
+
+        // Remaining LB_Keogh of each row, for early abandoning
+        tail_bound[GESTURE_LENGTH] = 0.0f;
+        for (size_t row = GESTURE_LENGTH; row-- > 0; )
+        {
+            size_t offset = row * GESTURE_FRAME_STRIDE;
+            tail_bound[row] = tail_bound[row + 1] + Kernel_EnvelopeDistance(query + offset, upper + offset, lower + offset);
+        }
+
+        ++match->computed;
+        bounds[k] = Gesture_DTW(query, templates.Sequence(i), templates.band, best, tail_bound);
+        if (bounds[k] < best)
+        {
+            best = bounds[k];
+            match->label = templates.labels[i];
+            match->index = i;
+        }
+    }
+    match->pruned_keogh += candidates.size() - k;
+
+    float other = k < candidates.size() ? candidates[k].first : INFINITY;
+    for (size_t j = 0; j < k; ++j)
+        if (templates.labels[candidates[j].second] != match->label)
+            other = std::min(other, bounds[j]);
+
+    match->distance = best;
+    if (match->label >= 0)
+        match->confidence = std::isinf(other) ? 1.0f : (other > 0.0f ? std::max(0.0f, 1.0f - best / other) : 0.0f);
+}
+
+// =========================================================================================
+//                                    RECOGNIZER
+//==========================================================================================
+
+// Adds a template of class label
+void GestureRecognizer::AddTemplate(const GestureSequence& sequence, int label)
+{
+    size_t offset = sequences.size();
+    sequences.insert(sequences.end(), sequence.frames.begin(), sequence.frames.end());
+    upper.resize(offset + GESTURE_SEQUENCE_SIZE);
+    lower.resize(offset + GESTURE_SEQUENCE_SIZE);
+    Gesture_Envelope(sequence.Data(), band, &upper[offset], &lower[offset]);
+    labels.push_back(label);
+}
+
+void GestureRecognizer::AddTraining(const Training* training, int label)
+{
+    TrainingChannels channels;
+    channels.Load(training);
+
+    GestureSequence sequence;
+    sequence.Load(channels);
+    AddTemplate(sequence, label);
+}
+
+// Adds every training of the dataset, resampling them in parallel
+void GestureRecognizer::AddDataset(const Dataset& dataset, int label, ThreadPool& pool)
+{
+    std::vector<GestureSequence> sequences;
+    Gesture_LoadDataset(dataset, &sequences, pool);
+
+    for (size_t i = 0; i < sequences.size(); ++i)
+        AddTemplate(sequences[i], label);
+}
+
+void GestureRecognizer::Clear()
+{
+    sequences.clear();
+    upper.clear();
+    lower.clear();
+    labels.clear();
+}
+
+GestureTemplates GestureRecognizer::Templates() const
+{
+    GestureTemplates templates = { sequences.data(), upper.data(), lower.data(), labels.data(), labels.size(), band };
+    return templates;
+}
+
+// Classifies a gesture against the templates, visiting them by increasing LB_Keogh
+bool GestureRecognizer::Classify(const GestureSequence& sequence, GestureMatch* match) const
+{
+    GestureTemplates templates = Templates();
+
+    std::vector<std::pair<float, int> > order(templates.count);
+    for (size_t i = 0; i < templates.count; ++i)
+        order[i] = std::make_pair(Gesture_LowerBoundKeogh(sequence.Data(), templates.Upper(i), templates.Lower(i), INFINITY), (int)i);
+    std::sort(order.begin(), order.end());
+
+    Gesture_MatchCandidates(templates, sequence.Data(), order, true, match);
+    return match->label >= 0;
+}
+
+bool GestureRecognizer::Classify(const Training* training, GestureMatch* match) const
+{
+    TrainingChannels channels;
+    channels.Load(training);
+
+    GestureSequence sequence;
+    sequence.Load(channels);
+    return Classify(sequence, match);
+}
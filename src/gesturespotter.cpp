@@ -0,0 +1,314 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "gesturespotter.h"
+
+// =========================================================================================
+//                                    TEMPLATES
+//==========================================================================================
+
+// Adds a template of class label, always matched
+void GestureSpotter::AddTemplate(const GestureSequence& sequence, int label)
+{
+    Append(sequence.Data(), label);
+    blocks.back().active_until = INT32_MAX;
+}
+
+// Packs a template into the last block, matched only once shortlisted
+void GestureSpotter::Append(const float* sequence, int label)
+{
+    int lane = count % 4;
+    if (lane == 0)
+    {
+        blocks.push_back(Block());
+        Block& block = blocks.back();
+        memset(block.values, 0, sizeof(block.values));
+        for (int i = 0; i <= GESTURE_LENGTH; ++i)
+            for (int l = 0; l < 4; ++l)
+            {
+                block.distance[i][l] = INFINITY;
+                block.start[i][l] = 0;
+            }
+        for (int l = 0; l < 4; ++l)
+        {
+            block.best_distance[l] = INFINITY;
+            block.best_start[l] = 0;
+            block.best_end[l] = 0;
+            block.label[l] = -1;
+            block.index[l] = -1;
+        }
+        block.active_until = 0;
+    }
+
+    Block& block = blocks.back();
+    for (int i = 0; i < GESTURE_LENGTH; ++i)
+        for (int c = 0; c < NUM_FEATURE_CHANNELS; ++c)
+            block.values[i][c][lane] = sequence[i * GESTURE_FRAME_STRIDE + c];
+    block.label[lane] = label;
+    block.index[lane] = (int)count;
+
+    if ((size_t)label >= last_end.size())
+        last_end.resize(label + 1, -1);
+    ++count;
+}
+
+// Adds every template of a gesture library, the first one added is indexed
+void GestureSpotter::AddLibrary(const GestureLibrary& added)
+{
+    int first = (int)names.size();
+    for (size_t c = 0; c < added.NumClasses(); ++c)
+        names.push_back(added.Name((int)c));
+
+    bool indexed = !library;
+    if (indexed)
+        library = &added;
+    for (size_t i = 0; i < added.Size(); ++i)
+    {
+        Append(added.sequences + i * GESTURE_SEQUENCE_SIZE, first + added.labels[i]);
+        if (indexed)
+            library_blocks.push_back((int32_t)blocks.size() - 1);
+        else
+            blocks.back().active_until = INT32_MAX;
+    }
+
+    printf("Gesture spotting: %u classes, %u templates (%u shortlisted by the index)\n",
+           (unsigned)names.size(), (unsigned)count, (unsigned)library_blocks.size());
+}
+
+// =========================================================================================
+//                                     SPOTTING
+//==========================================================================================
+
+// Sensor thread: consumes one report
+void GestureSpotter::Feed(uint64_t timestamp, float accel_x, float accel_y, float accel_z, float roll_rate, float pitch_rate, float yaw_rate)
+{
+    int32_t t = (int32_t)++samples;
+    timestamps[t % GESTURE_SPOTTING_HISTORY] = timestamp;
+
+    float* x = features[t % GESTURE_SPOTTING_HISTORY];
+    x[0] = accel_x * GESTURE_ACC_SCALE;
+    x[1] = accel_y * GESTURE_ACC_SCALE;
+    x[2] = accel_z * GESTURE_ACC_SCALE;
+    x[3] = roll_rate * GESTURE_GYRO_SCALE;
+    x[4] = pitch_rate * GESTURE_GYRO_SCALE;
+    x[5] = yaw_rate * GESTURE_GYRO_SCALE;
+
+    if (library && t % GESTURE_SPOTTING_INTERVAL == 0)
+        Shortlist(t);
+
+    // Shortlisted blocks, and those still holding a match to report
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        Block& block = blocks[b];
+        bool pending = block.best_distance[0] < INFINITY || block.best_distance[1] < INFINITY
+                    || block.best_distance[2] < INFINITY || block.best_distance[3] < INFINITY;
+        if (block.active_until >= t || pending)
+            Update(block, x, t);
+    }
+}
+
+// Queries the index with the embedding of each recent window, and keeps the blocks of the
+// proposed templates matched
+void GestureSpotter::Shortlist(int32_t t)
+{
+    std::vector<std::pair<float, int> > candidates;
+    float scale = std::sqrt((float)(GESTURE_LENGTH / GESTURE_EMBEDDING_SEGMENTS));
+
+    for (int32_t window = GESTURE_SPOTTING_MIN_WINDOW; window <= GESTURE_SPOTTING_MAX_WINDOW; window *= 2)
+    {
+        if (t - window + 1 < stream_start)
+            break;
+
+        // Segment means scaled as GestureLibrary_Embed does over the resampled frames
+        float embedding[GESTURE_EMBEDDING_SIZE];
+        int32_t span = window / GESTURE_EMBEDDING_SEGMENTS;
+        for (int s = 0; s < GESTURE_EMBEDDING_SEGMENTS; ++s)
+        {
+            float sum[NUM_FEATURE_CHANNELS] = { 0.0f };
+            for (int32_t u = t - window + 1 + s * span; u <= t - window + (s + 1) * span; ++u)
+                for (int c = 0; c < NUM_FEATURE_CHANNELS; ++c)
+                    sum[c] += features[u % GESTURE_SPOTTING_HISTORY][c];
+            for (int c = 0; c < NUM_FEATURE_CHANNELS; ++c)
+                embedding[s * NUM_FEATURE_CHANNELS + c] = sum[c] / span * scale;
+        }
+
+        library->Candidates(embedding, GESTURE_SPOTTING_CANDIDATES, GESTURE_LIBRARY_MAX_LEAVES, &candidates);
+        for (size_t k = 0; k < candidates.size(); ++k)
+        {
+            Block& block = blocks[library_blocks[candidates[k].second]];
+            if (block.active_until < t)
+                Activate(block, t);
+            block.active_until = std::max(block.active_until, t + GESTURE_SPOTTING_LINGER);
+        }
+    }
+}
+
+// Restarts the columns of a block that was not matched, replaying the samples before t
+void GestureSpotter::Activate(Block& block, int32_t t)
+{
+    for (int i = 0; i <= GESTURE_LENGTH; ++i)
+        for (int l = 0; l < 4; ++l)
+            block.distance[i][l] = INFINITY;
+    for (int l = 0; l < 4; ++l)
+        block.best_distance[l] = INFINITY;
+
+    for (int32_t u = std::max(stream_start, t - GESTURE_SPOTTING_MAX_WINDOW); u < t; ++u)
+        Update(block, features[u % GESTURE_SPOTTING_HISTORY], u);
+}
+
+// Updates the DTW columns of a block with sample t, reporting the matches it settles
+void GestureSpotter::Update(Block& block, const float* x, int32_t t)
+{
+    float epsilon = threshold * GESTURE_LENGTH;
+    int ok[4];
+
+    #ifdef __SSE2__
+    __m128 xc[NUM_FEATURE_CHANNELS];
+    for (int c = 0; c < NUM_FEATURE_CHANNELS; ++c)
+        xc[c] = _mm_set1_ps(x[c]);
+
+    // Row 0 is free to start a match at this sample
+    __m128  left_distance = _mm_setzero_ps(), diagonal_distance = _mm_setzero_ps();
+    __m128i left_start = _mm_set1_epi32(t),   diagonal_start = _mm_set1_epi32(t);
+
+    // SPRING report condition: every cell is worse than, or started after, the pending match
+    __m128  pending_distance = _mm_loadu_ps(block.best_distance);
+    __m128i pending_end = _mm_loadu_si128((const __m128i*)block.best_end);
+    __m128  settled = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+    for (int i = 1; i <= GESTURE_LENGTH; ++i)
+    {
+        __m128 cost = _mm_setzero_ps();
+        for (int c = 0; c < NUM_FEATURE_CHANNELS; ++c)
+        {
+            __m128 d = _mm_sub_ps(xc[c], _mm_loadu_ps(block.values[i - 1][c]));
+            cost = _mm_add_ps(cost, _mm_mul_ps(d, d));
+        }
+
+        __m128  up_distance = _mm_loadu_ps(block.distance[i]);
+        __m128i up_start = _mm_loadu_si128((const __m128i*)block.start[i]);
+
+        // min(left, up, diagonal), carrying the start of the chosen path
+        __m128  best = left_distance;
+        __m128i best_start = left_start;
+        __m128i mask = _mm_castps_si128(_mm_cmplt_ps(up_distance, best));
+        best = _mm_min_ps(best, up_distance);
+        best_start = _mm_or_si128(_mm_and_si128(mask, up_start), _mm_andnot_si128(mask, best_start));
+        mask = _mm_castps_si128(_mm_cmplt_ps(diagonal_distance, best));
+        best = _mm_min_ps(best, diagonal_distance);
+        best_start = _mm_or_si128(_mm_and_si128(mask, diagonal_start), _mm_andnot_si128(mask, best_start));
+
+        __m128 distance = _mm_add_ps(best, cost);
+        _mm_storeu_ps(block.distance[i], distance);
+        _mm_storeu_si128((__m128i*)block.start[i], best_start);
+
+        settled = _mm_and_ps(settled, _mm_or_ps(_mm_cmpge_ps(distance, pending_distance),
+                                                _mm_castsi128_ps(_mm_cmpgt_epi32(best_start, pending_end))));
+
+        diagonal_distance = up_distance;
+        diagonal_start = up_start;
+        left_distance = distance;
+        left_start = best_start;
+    }
+
+    _mm_storeu_si128((__m128i*)ok, _mm_castps_si128(settled));
+    #else
+    for (int l = 0; l < 4; ++l)
+    {
+        float left_distance = 0.0f, diagonal_distance = 0.0f;
+        int32_t left_start = t, diagonal_start = t;
+        ok[l] = 1;
+
+        for (int i = 1; i <= GESTURE_LENGTH; ++i)
+        {
+            float cost = 0.0f;
+            for (int c = 0; c < NUM_FEATURE_CHANNELS; ++c)
+                cost += (x[c] - block.values[i - 1][c][l]) * (x[c] - block.values[i - 1][c][l]);
+
+            float up_distance = block.distance[i][l];
+            int32_t up_start = block.start[i][l];
+
+            float best = left_distance;
+            int32_t best_start = left_start;
+            if (up_distance < best)       { best = up_distance;       best_start = up_start; }
+            if (diagonal_distance < best) { best = diagonal_distance; best_start = diagonal_start; }
+
+            block.distance[i][l] = best + cost;
+            block.start[i][l] = best_start;
+            ok[l] &= block.distance[i][l] >= block.best_distance[l] || best_start > block.best_end[l];
+
+            diagonal_distance = up_distance;
+            diagonal_start = up_start;
+            left_distance = best + cost;
+            left_start = best_start;
+        }
+    }
+    #endif
+
+    for (int l = 0; l < 4; ++l)
+    {
+        if (block.label[l] < 0)
+            continue;
+
+        // Report the pending match once nothing can improve it, then drop the paths overlapping it
+        if (block.best_distance[l] <= epsilon && ok[l])
+        {
+            Report(block, l);
+            for (int i = 1; i <= GESTURE_LENGTH; ++i)
+                if (block.start[i][l] <= block.best_end[l])
+                    block.distance[i][l] = INFINITY;
+            block.best_distance[l] = INFINITY;
+        }
+
+        float distance = block.distance[GESTURE_LENGTH][l];
+        if (distance <= epsilon && distance < block.best_distance[l])
+        {
+            block.best_distance[l] = distance;
+            block.best_start[l] = block.start[GESTURE_LENGTH][l];
+            block.best_end[l] = t;
+        }
+    }
+}
+
+// Sensor thread: the stream switches to another controller, partial matches are dropped
+void GestureSpotter::Restart()
+{
+    for (size_t b = 0; b < blocks.size(); ++b)
+        for (int l = 0; l < 4; ++l)
+        {
+            for (int i = 0; i <= GESTURE_LENGTH; ++i)
+                blocks[b].distance[i][l] = INFINITY;
+            blocks[b].best_distance[l] = INFINITY;
+        }
+    stream_start = (int32_t)samples + 1;
+}
+
+// Queues a match, once per class for overlapping matches of several templates
+void GestureSpotter::Report(Block& block, int lane)
+{
+    int label = block.label[lane];
+    int32_t start = block.best_start[lane];
+    int32_t end = block.best_end[lane];
+    if (start <= last_end[label])
+        return;
+    last_end[label] = end;
+
+    // Oldest kept timestamp for starts beyond the history
+    int32_t oldest = (int32_t)samples - GESTURE_SPOTTING_HISTORY + 1;
+    start = std::max(start, oldest);
+
+    GestureEvent event;
+    event.label = label;
+    event.index = block.index[lane];
+    event.start = timestamps[start % GESTURE_SPOTTING_HISTORY];
+    event.end = timestamps[end % GESTURE_SPOTTING_HISTORY];
+    event.distance = block.best_distance[lane];
+    event.confidence = 1.0f - block.best_distance[lane] / (threshold * GESTURE_LENGTH);
+    events.Push(event);
+}
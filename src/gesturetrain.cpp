@@ -0,0 +1,168 @@
+// Gesture recognizer training and cross-validation.
+//
+// Loads a directory of "<gesture name>.log" datasets (one gesture class per file, as used
+// for live spotting), cross-validates the DTW recognizer over every combination of the
+// swept parameters, prints the results of each set, the confusion matrix and per class
+// latency of the best one, and optionally writes a gesture library trained with it.
+//
+//   gesturetrain [--folds K] [--bands B,B,...] [--templates N,N,...] [--library FILE] [--threads N] directory
+//
+// Templates per class 0 keeps every recorded sample. All folds of all parameter sets run at
+// once on the work stealing pool; each one builds its recognizer and tests its queries with
+// nested parallel loops, so cores stay busy however uneven the sets are.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "gesturetraining.h"
+#include "gesturelibrary.h"
+
+// Comma separated list of unsigned values
+static bool ParseList(const char* text, std::vector<size_t>* values)
+{
+    values->clear();
+    while (*text)
+    {
+        char* end;
+        unsigned long value = strtoul(text, &end, 10);
+        if (end == text || (*end != ',' && *end != '\0'))
+            return false;
+        values->push_back(value);
+        text = *end ? end + 1 : end;
+    }
+    return !values->empty();
+}
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: gesturetrain [--folds K] [--bands B,B,...] [--templates N,N,...] [--library FILE] [--threads N] directory\n");
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int num_threads = 0;
+    size_t folds = 5;
+    std::vector<size_t> bands, templates;
+    const char* library_filename = NULL;
+    const char* directory = NULL;
+
+    size_t default_bands[] = { 2, 4, GESTURE_BAND, 10 };
+    size_t default_templates[] = { 8, 32, 0 };
+    bands.assign(default_bands, default_bands + sizeof(default_bands) / sizeof(default_bands[0]));
+    templates.assign(default_templates, default_templates + sizeof(default_templates) / sizeof(default_templates[0]));
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--folds" && has_value)
+            folds = std::max(2ul, strtoul(argv[++i], NULL, 10));
+        else if (arg == "--bands" && has_value)
+        {
+            if (!ParseList(argv[++i], &bands))
+                return PrintUsage(), EXIT_FAILURE;
+        }
+        else if (arg == "--templates" && has_value)
+        {
+            if (!ParseList(argv[++i], &templates))
+                return PrintUsage(), EXIT_FAILURE;
+        }
+        else if (arg == "--library" && has_value)
+            library_filename = argv[++i];
+        else if (arg == "--threads" && has_value)
+            num_threads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (arg.compare(0, 2, "--") == 0 || directory)
+            return PrintUsage(), EXIT_FAILURE;
+        else
+            directory = argv[i];
+    }
+
+    if (!directory)
+        return PrintUsage(), EXIT_FAILURE;
+
+    for (size_t b = 0; b < bands.size(); ++b)
+        if (bands[b] >= GESTURE_LENGTH)
+            return fprintf(stderr, "ERROR: Bands must be below %d frames.\n", GESTURE_LENGTH), EXIT_FAILURE;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ThreadPool pool(num_threads);
+
+    std::vector<GestureSequence> sequences;
+    std::vector<int> labels;
+    std::vector<std::string> names;
+    if (!GestureLibrary_LoadDirectory(directory, &sequences, &labels, &names, pool))
+        return fprintf(stderr, "ERROR: No gesture datasets in \"%s\".\n", directory), EXIT_FAILURE;
+
+    double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<GestureTrainingParameters> parameters;
+    for (size_t b = 0; b < bands.size(); ++b)
+        for (size_t t = 0; t < templates.size(); ++t)
+        {
+            GestureTrainingParameters set = { bands[b], templates[t] };
+            parameters.push_back(set);
+        }
+
+    std::vector<GestureEvaluation> evaluations;
+    size_t best = GestureTraining_CrossValidate(sequences, labels, names.size(), parameters, folds, &evaluations, pool);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Report
+    printf("gestures: \"%s\", %u classes, %u samples, %u folds\n", directory, (unsigned)names.size(), (unsigned)sequences.size(), (unsigned)folds);
+    printf("\n");
+
+    printf("%5s %10s %10s %10s %12s\n", "band", "per class", "templates", "accuracy", "latency ms");
+    for (size_t s = 0; s < evaluations.size(); ++s)
+    {
+        const GestureEvaluation& evaluation = evaluations[s];
+        char per_class[16];
+        if (evaluation.parameters.templates_per_class)
+            snprintf(per_class, sizeof(per_class), "%u", (unsigned)evaluation.parameters.templates_per_class);
+        else
+            snprintf(per_class, sizeof(per_class), "all");
+
+        printf("%5u %10s %10u %9.2f%% %12.3f%s\n", (unsigned)evaluation.parameters.band, per_class, (unsigned)evaluation.templates,
+               evaluation.Accuracy() * 100.0f, evaluation.MeanLatency(), s == best ? "  <-" : "");
+    }
+    printf("\n");
+
+    const GestureEvaluation& chosen = evaluations[best];
+    chosen.Print(names);
+    printf("\n");
+
+    printf("// Recommended recognizer constants (%s)\n", directory);
+    printf("#define GESTURE_BAND %u\n", (unsigned)chosen.parameters.band);
+    printf("\n");
+
+    if (library_filename)
+    {
+        std::vector<size_t> members(sequences.size());
+        for (size_t i = 0; i < members.size(); ++i)
+            members[i] = i;
+
+        std::vector<size_t> selected;
+        GestureTraining_Select(sequences, labels, members, chosen.parameters, &selected, pool);
+
+        std::vector<GestureSequence> kept(selected.size());
+        std::vector<int> kept_labels(selected.size());
+        for (size_t j = 0; j < selected.size(); ++j)
+        {
+            kept[j] = sequences[selected[j]];
+            kept_labels[j] = labels[selected[j]];
+        }
+
+        if (!GestureLibrary_Write(library_filename, kept, kept_labels, names, chosen.parameters.band))
+            return EXIT_FAILURE;
+        printf("wrote \"%s\" (%u templates, band %u)\n", library_filename, (unsigned)kept.size(), (unsigned)chosen.parameters.band);
+    }
+
+    printf("trained %u parameter sets x %u folds in %.3f s (load %.3f s, %u threads)\n", (unsigned)parameters.size(), (unsigned)folds,
+           seconds, load_seconds, pool.Size());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,254 @@
+#include <cmath>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include "gesturetraining.h"
+
+// Fixed, so folds (and results) are the same from one run to the next
+#define FOLD_SEED 1
+
+// =========================================================================================
+//                                     TRAINING
+//==========================================================================================
+
+// Farthest point traversal over the members of one class
+static void SelectClass(const std::vector<GestureSequence>& sequences, const std::vector<size_t>& members,
+                        const GestureTrainingParameters& parameters, std::vector<size_t>* kept)
+{
+    size_t count = parameters.templates_per_class;
+    if (count == 0 || members.size() <= count)
+    {
+        *kept = members;
+        return;
+    }
+
+    // Start from the member nearest to the class mean
+    std::vector<float> mean(GESTURE_SEQUENCE_SIZE, 0.0f);
+    for (size_t j = 0; j < members.size(); ++j)
+        for (size_t k = 0; k < GESTURE_SEQUENCE_SIZE; ++k)
+            mean[k] += sequences[members[j]].frames[k] / members.size();
+
+    size_t next = 0;
+    float nearest = INFINITY;
+    for (size_t j = 0; j < members.size(); ++j)
+    {
+        float sum = 0.0f;
+        for (size_t k = 0; k < GESTURE_SEQUENCE_SIZE; ++k)
+            sum += (sequences[members[j]].frames[k] - mean[k]) * (sequences[members[j]].frames[k] - mean[k]);
+        if (sum < nearest)
+        {
+            nearest = sum;
+            next = j;
+        }
+    }
+
+    // Then keep adding the member farthest from every kept template
+    std::vector<float> distance(members.size(), INFINITY);
+    kept->clear();
+    while (kept->size() < count)
+    {
+        kept->push_back(members[next]);
+        distance[next] = 0.0f;
+
+        const float* added = sequences[members[next]].Data();
+        float farthest = 0.0f;
+        for (size_t j = 0; j < members.size(); ++j)
+        {
+            if (distance[j] == 0.0f)
+                continue;
+
+            // Abandoned DTWs return a bound above the limit, which leaves the minimum unchanged
+            distance[j] = std::min(distance[j], Gesture_DTW(sequences[members[j]].Data(), added, parameters.band, distance[j]));
+            if (distance[j] > farthest)
+            {
+                farthest = distance[j];
+                next = j;
+            }
+        }
+        if (farthest == 0.0f)
+            break;
+    }
+}
+
+// Templates kept for the parameters, classes reduced in parallel
+void GestureTraining_Select(const std::vector<GestureSequence>& sequences, const std::vector<int>& labels, const std::vector<size_t>& members,
+                            const GestureTrainingParameters& parameters, std::vector<size_t>* selected, ThreadPool& pool)
+{
+    std::vector<std::vector<size_t> > classes;
+    for (size_t j = 0; j < members.size(); ++j)
+    {
+        size_t label = (size_t)labels[members[j]];
+        if (label >= classes.size())
+            classes.resize(label + 1);
+        classes[label].push_back(members[j]);
+    }
+
+    std::vector<std::vector<size_t> > kept(classes.size());
+    ParallelFor(pool, classes.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t c = begin; c < end; ++c)
+            SelectClass(sequences, classes[c], parameters, &kept[c]);
+    });
+
+    selected->clear();
+    for (size_t c = 0; c < kept.size(); ++c)
+        selected->insert(selected->end(), kept[c].begin(), kept[c].end());
+}
+
+// Builds a recognizer from the selected templates of the given members
+void GestureTraining_Build(const std::vector<GestureSequence>& sequences, const std::vector<int>& labels, const std::vector<size_t>& members,
+                           const GestureTrainingParameters& parameters, GestureRecognizer* recognizer, ThreadPool& pool)
+{
+    std::vector<size_t> selected;
+    GestureTraining_Select(sequences, labels, members, parameters, &selected, pool);
+
+    recognizer->Clear();
+    recognizer->band = parameters.band;
+    for (size_t j = 0; j < selected.size(); ++j)
+        recognizer->AddTemplate(sequences[selected[j]], labels[selected[j]]);
+}
+
+// =========================================================================================
+//                                    EVALUATION
+//==========================================================================================
+
+size_t GestureEvaluation::Correct() const
+{
+    size_t correct = 0;
+    for (size_t c = 0; c < classes; ++c)
+        correct += confusion[c * classes + c];
+    return correct;
+}
+
+double GestureEvaluation::MeanLatency() const
+{
+    double sum = 0.0;
+    for (size_t c = 0; c < classes; ++c)
+        sum += latency[c];
+    return queries ? sum / queries : 0.0;
+}
+
+// Prints the confusion matrix and the per class accuracy and latency
+void GestureEvaluation::Print(const std::vector<std::string>& names) const
+{
+    printf("%-20s", "actual \\ predicted");
+    for (size_t p = 0; p < classes; ++p)
+        printf(" %5u", (unsigned)p);
+    printf("  accuracy   latency ms (mean/max)\n");
+
+    for (size_t a = 0; a < classes; ++a)
+    {
+        size_t total = 0;
+        for (size_t p = 0; p < classes; ++p)
+            total += confusion[a * classes + p];
+        total += unclassified[a];
+
+        printf("%2u %-17.17s", (unsigned)a, a < names.size() ? names[a].c_str() : "");
+        for (size_t p = 0; p < classes; ++p)
+            printf(" %5u", (unsigned)confusion[a * classes + p]);
+        printf("  %7.1f%%  %8.3f %8.3f\n", total ? 100.0 * confusion[a * classes + a] / total : 0.0,
+               total ? latency[a] / total : 0.0, worst[a]);
+    }
+}
+
+// Stratified k-fold cross-validation of every parameter set
+size_t GestureTraining_CrossValidate(const std::vector<GestureSequence>& sequences, const std::vector<int>& labels, size_t classes,
+                                     const std::vector<GestureTrainingParameters>& parameters, size_t folds,
+                                     std::vector<GestureEvaluation>* evaluations, ThreadPool& pool)
+{
+    folds = std::max(folds, (size_t)2);
+
+    // Members of every class are dealt to the folds in a shuffled order
+    std::vector<size_t> order(sequences.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::mt19937 random(FOLD_SEED);
+    std::shuffle(order.begin(), order.end(), random);
+
+    std::vector<size_t> fold_of(sequences.size());
+    std::vector<size_t> dealt(classes, 0);
+    for (size_t j = 0; j < order.size(); ++j)
+        fold_of[order[j]] = dealt[labels[order[j]]]++ % folds;
+
+    // One task per parameter set and fold; each one builds in parallel and tests in parallel
+    struct FoldResult
+    {
+        std::vector<size_t> test;
+        std::vector<int>    predicted;
+        std::vector<double> latency;
+        size_t              templates;
+    };
+    std::vector<FoldResult> results(parameters.size() * folds);
+
+    ParallelFor(pool, results.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t t = begin; t < end; ++t)
+        {
+            const GestureTrainingParameters& set = parameters[t / folds];
+            FoldResult& result = results[t];
+
+            std::vector<size_t> train;
+            for (size_t i = 0; i < sequences.size(); ++i)
+                (fold_of[i] == t % folds ? result.test : train).push_back(i);
+
+            GestureRecognizer recognizer;
+            GestureTraining_Build(sequences, labels, train, set, &recognizer, pool);
+            result.templates = recognizer.Size();
+
+            result.predicted.resize(result.test.size());
+            result.latency.resize(result.test.size());
+            ParallelFor(pool, result.test.size(), [&](size_t first, size_t last)
+            {
+                GestureMatch match;
+                for (size_t q = first; q < last; ++q)
+                {
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    recognizer.Classify(sequences[result.test[q]], &match);
+                    result.latency[q] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                    result.predicted[q] = match.label;
+                }
+            });
+        }
+    });
+
+    // Merge the folds of every set
+    evaluations->assign(parameters.size(), GestureEvaluation());
+    size_t best = 0;
+    for (size_t s = 0; s < parameters.size(); ++s)
+    {
+        GestureEvaluation& evaluation = (*evaluations)[s];
+        evaluation.parameters = parameters[s];
+        evaluation.classes = classes;
+        evaluation.confusion.assign(classes * classes, 0);
+        evaluation.unclassified.assign(classes, 0);
+        evaluation.latency.assign(classes, 0.0);
+        evaluation.worst.assign(classes, 0.0);
+        evaluation.queries = 0;
+        evaluation.templates = 0;
+
+        for (size_t f = 0; f < folds; ++f)
+        {
+            const FoldResult& result = results[s * folds + f];
+            for (size_t q = 0; q < result.test.size(); ++q)
+            {
+                int actual = labels[result.test[q]];
+                if (result.predicted[q] >= 0)
+                    ++evaluation.confusion[actual * classes + result.predicted[q]];
+                else
+                    ++evaluation.unclassified[actual];
+                evaluation.latency[actual] += result.latency[q];
+                evaluation.worst[actual] = std::max(evaluation.worst[actual], result.latency[q]);
+            }
+            evaluation.queries += result.test.size();
+            evaluation.templates += result.templates;
+        }
+        evaluation.templates /= folds;
+
+        const GestureEvaluation& leader = (*evaluations)[best];
+        if (evaluation.Correct() > leader.Correct() || (evaluation.Correct() == leader.Correct() && evaluation.MeanLatency() < leader.MeanLatency()))
+            best = s;
+    }
+    return best;
+}
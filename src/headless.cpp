@@ -0,0 +1,318 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <glad/glad.h>
+
+#include "headless.h"
+#include "wiiclog.h"
+#include "mappedfile.h"
+
+// =========================================================================================
+//                                      CONTEXT
+//==========================================================================================
+
+static EGLDisplay g_HeadlessDisplay = EGL_NO_DISPLAY;
+static EGLContext g_HeadlessContext = EGL_NO_CONTEXT;
+static EGLSurface g_HeadlessSurface = EGL_NO_SURFACE;
+static GLuint     g_HeadlessFramebuffer = 0;
+static GLuint     g_HeadlessRenderbuffers[2] = { 0, 0 }; // Color, depth
+
+// Whether a space separated extension list names an extension
+static bool HasExtension(const char* extensions, const char* name)
+{
+    size_t length = strlen(name);
+    for (const char* p = extensions; p && (p = strstr(p, name)) != NULL; p += length)
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+            return true;
+    return false;
+}
+
+// Surfaceless platform display, if the EGL library has one
+static EGLDisplay SurfacelessDisplay()
+{
+    if (!HasExtension(eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS), "EGL_MESA_platform_surfaceless"))
+        return EGL_NO_DISPLAY;
+
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    return get_platform_display ? get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL) : EGL_NO_DISPLAY;
+}
+
+bool Headless_Init(int width, int height, bool software)
+{
+    // Read by Mesa when it loads its driver
+    if (software)
+        setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+
+    EGLint major, minor;
+    g_HeadlessDisplay = SurfacelessDisplay();
+    if (g_HeadlessDisplay == EGL_NO_DISPLAY || !eglInitialize(g_HeadlessDisplay, &major, &minor))
+    {
+        g_HeadlessDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (g_HeadlessDisplay == EGL_NO_DISPLAY || !eglInitialize(g_HeadlessDisplay, &major, &minor))
+        {
+            fprintf(stderr, "ERROR: eglInitialize() failed.\n");
+            return false;
+        }
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        fprintf(stderr, "ERROR: EGL %d.%d has no desktop OpenGL.\n", major, minor);
+        Headless_Shutdown();
+        return false;
+    }
+
+    // Frames go to the framebuffer object, so any config will do when no surface is needed
+    bool surfaceless = HasExtension(eglQueryString(g_HeadlessDisplay, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+    const EGLint config_attributes[] = {
+        EGL_SURFACE_TYPE,    surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(g_HeadlessDisplay, config_attributes, &config, 1, &num_configs) || num_configs == 0)
+    {
+        fprintf(stderr, "ERROR: eglChooseConfig() found no OpenGL config.\n");
+        Headless_Shutdown();
+        return false;
+    }
+
+    // OpenGL 3.3 core, as the windowed renderer
+    const EGLint context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    g_HeadlessContext = eglCreateContext(g_HeadlessDisplay, config, EGL_NO_CONTEXT, context_attributes);
+    if (g_HeadlessContext == EGL_NO_CONTEXT)
+    {
+        fprintf(stderr, "ERROR: eglCreateContext() failed (0x%x).\n", eglGetError());
+        Headless_Shutdown();
+        return false;
+    }
+
+    if (!surfaceless)
+    {
+        const EGLint pbuffer_attributes[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+        g_HeadlessSurface = eglCreatePbufferSurface(g_HeadlessDisplay, config, pbuffer_attributes);
+    }
+    if (!eglMakeCurrent(g_HeadlessDisplay, g_HeadlessSurface, g_HeadlessSurface, g_HeadlessContext))
+    {
+        fprintf(stderr, "ERROR: eglMakeCurrent() failed (0x%x).\n", eglGetError());
+        Headless_Shutdown();
+        return false;
+    }
+
+    gladLoadGLLoader((GLADloadproc)eglGetProcAddress);
+
+    // Color and depth attachments of the frame size, bound for the whole run
+    glGenFramebuffers(1, &g_HeadlessFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_HeadlessFramebuffer);
+    glGenRenderbuffers(2, g_HeadlessRenderbuffers);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, g_HeadlessRenderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, g_HeadlessRenderbuffers[0]);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, g_HeadlessRenderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, g_HeadlessRenderbuffers[1]);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "ERROR: Headless framebuffer incomplete.\n");
+        Headless_Shutdown();
+        return false;
+    }
+
+    printf("Headless: EGL %d.%d, %s, %dx%d framebuffer\n", major, minor,
+           g_HeadlessSurface == EGL_NO_SURFACE ? "surfaceless" : "pbuffer", width, height);
+    return true;
+}
+
+void Headless_Shutdown()
+{
+    if (g_HeadlessFramebuffer)
+    {
+        glDeleteFramebuffers(1, &g_HeadlessFramebuffer);
+        glDeleteRenderbuffers(2, g_HeadlessRenderbuffers);
+        g_HeadlessFramebuffer = 0;
+    }
+
+    if (g_HeadlessDisplay == EGL_NO_DISPLAY)
+        return;
+
+    eglMakeCurrent(g_HeadlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (g_HeadlessSurface != EGL_NO_SURFACE)
+        eglDestroySurface(g_HeadlessDisplay, g_HeadlessSurface);
+    if (g_HeadlessContext != EGL_NO_CONTEXT)
+        eglDestroyContext(g_HeadlessDisplay, g_HeadlessContext);
+    eglTerminate(g_HeadlessDisplay);
+
+    g_HeadlessSurface = EGL_NO_SURFACE;
+    g_HeadlessContext = EGL_NO_CONTEXT;
+    g_HeadlessDisplay = EGL_NO_DISPLAY;
+}
+
+// =========================================================================================
+//                                       INPUT
+//==========================================================================================
+
+// Opens the input: "synthetic", or a WiiC log read whole into reports
+bool HeadlessInput::Open(const char* source)
+{
+    synthetic = strcmp(source, "synthetic") == 0;
+    reports.clear();
+    cursor = 0;
+    offset = 0;
+    next_time = 0;
+    if (synthetic)
+        return true;
+
+    MappedFile file;
+    WiicLogHeader header;
+    std::vector<WiicLogTraining> trainings;
+    if (!file.Open(source) || !WiicLog_ParseHeader(file.data, file.size, &header)
+        || !WiicLog_FindTrainings(file.data, file.size, header.body_offset, &trainings))
+    {
+        fprintf(stderr, "ERROR: Cannot read WiiC log \"%s\".\n", source);
+        return false;
+    }
+
+    // Trainings are placed at their START times (msec from midnight), after the previous one
+    HeadlessReport report;
+    memset(&report, 0, sizeof(report));
+    report.accel_z = 1.0f;
+    uint64_t end = 0;
+    for (size_t t = 0; t < trainings.size(); ++t)
+    {
+        uint64_t start = (uint64_t)(trainings[t].timestamp - trainings[0].timestamp) * 1000;
+        start = std::max(start, end);
+
+        const char* p = file.data + trainings[t].begin;
+        WiicLogSample sample;
+        while (p < file.data + trainings[t].end)
+        {
+            if (!WiicLog_ParseSample(p, file.data + trainings[t].end, &sample))
+            {
+                fprintf(stderr, "ERROR: Bad sample in WiiC log \"%s\".\n", source);
+                return false;
+            }
+
+            report.timestamp = std::max(end, start + (uint64_t)sample.timestamp * 1000);
+            if (sample.type == WIIC_LOG_ACC)
+            {
+                report.accel_x = sample.values[0];
+                report.accel_y = sample.values[1];
+                report.accel_z = sample.values[2];
+            }
+            else if (sample.type == WIIC_LOG_GYRO)
+            {
+                report.roll_rate  = sample.values[0];
+                report.pitch_rate = sample.values[1];
+                report.yaw_rate   = sample.values[2];
+                reports.push_back(report);
+                end = report.timestamp;
+            }
+        }
+    }
+
+    if (reports.empty())
+    {
+        fprintf(stderr, "ERROR: WiiC log \"%s\" has no gyroscope samples.\n", source);
+        return false;
+    }
+    duration = end + HEADLESS_REPORT_INTERVAL;
+
+    printf("Headless: replaying %u reports (%.1f s) from \"%s\"\n", (unsigned)reports.size(), duration / 1e6, source);
+    return true;
+}
+
+// Takes the next report due by a time
+bool HeadlessInput::Next(uint64_t until, HeadlessReport* report)
+{
+    if (synthetic)
+    {
+        if (next_time > until)
+            return false;
+
+        // Incommensurate sines on every axis, so the pose never repeats exactly
+        double t = next_time / 1e6;
+        report->timestamp  = next_time;
+        report->roll_rate  = (float)(90.0 * sin(2.0 * M_PI * 0.50 * t));
+        report->pitch_rate = (float)(60.0 * sin(2.0 * M_PI * 0.31 * t + 1.0));
+        report->yaw_rate   = (float)(45.0 * sin(2.0 * M_PI * 0.17 * t + 2.0));
+        report->accel_x    = (float)(0.2 * sin(2.0 * M_PI * 0.23 * t));
+        report->accel_y    = (float)(0.2 * cos(2.0 * M_PI * 0.19 * t));
+        report->accel_z    = 1.0f;
+        next_time += HEADLESS_REPORT_INTERVAL;
+        return true;
+    }
+
+    if (reports.empty() || reports[cursor].timestamp + offset > until)
+        return false;
+
+    *report = reports[cursor];
+    report->timestamp += offset;
+    if (++cursor == reports.size())
+    {
+        cursor = 0;
+        offset += duration;
+    }
+    return true;
+}
+
+// =========================================================================================
+//                                      TIMINGS
+//==========================================================================================
+
+// Writes frame timings as CSV and prints their summary
+bool Headless_WriteTimings(const char* filename, const std::vector<HeadlessFrame>& frames)
+{
+    FILE* out = fopen(filename, "w");
+    if (!out)
+    {
+        fprintf(stderr, "ERROR: Cannot write frame timings \"%s\".\n", filename);
+        return false;
+    }
+
+    fprintf(out, "frame,cpu_ms,frame_ms\n");
+    for (size_t i = 0; i < frames.size(); ++i)
+        fprintf(out, "%u,%.3f,%.3f\n", (unsigned)i, frames[i].cpu_ms, frames[i].frame_ms);
+    bool ok = !ferror(out);
+    ok = fclose(out) == 0 && ok;
+    if (!ok)
+    {
+        fprintf(stderr, "ERROR: Cannot write frame timings \"%s\".\n", filename);
+        return false;
+    }
+
+    if (frames.empty())
+        return true;
+
+    std::vector<double> sorted(frames.size());
+    double cpu_sum = 0.0, frame_sum = 0.0;
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        sorted[i]  = frames[i].frame_ms;
+        cpu_sum   += frames[i].cpu_ms;
+        frame_sum += frames[i].frame_ms;
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    double mean = frame_sum / frames.size();
+    printf("Headless: %u frames, %.2f ms mean (%.1f fps), %.2f ms median, %.2f ms p99, %.2f ms max, %.2f ms CPU mean\n",
+           (unsigned)frames.size(), mean, mean > 0.0 ? 1000.0 / mean : 0.0, sorted[sorted.size() / 2],
+           sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)], sorted.back(), cpu_sum / frames.size());
+    printf("Headless: frame timings written to \"%s\"\n", filename);
+    return true;
+}
@@ -0,0 +1,376 @@
+// Noise characterization of static WiiC sensor logs (Allan variance).
+//
+// Computes overlapping Allan deviation curves for the three gyroscope and the three
+// accelerometer channels of a log recorded with the controller at rest, derives angle
+// random walk, bias instability and accelerometer noise density from them and prints
+// recommended constants for the fusion stage in render.h.
+//
+//   lognoise [--points-per-decade K] [--csv FILE] [--threads N] log
+//
+// Samples of every training are concatenated in file order. Cluster sizes are spaced
+// logarithmically, so the whole curve costs O(n log n): one O(n) pass over the integrated
+// signal per cluster size, spread across the thread pool.
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "wiiclog.h"
+#include "threadpool.h"
+
+#define NUM_CHANNELS 6
+
+// Gyroscope channels are in deg/s, accelerometer channels in g
+static const char* g_ChannelNames[NUM_CHANNELS] = {
+    "acc.x", "acc.y", "acc.z", "gyro.roll", "gyro.pitch", "gyro.yaw"
+};
+
+// Bias instability is read at the flat bottom of the curve, sigma = sqrt(2 ln 2 / pi) * B
+#define BIAS_INSTABILITY_FACTOR 0.664f
+
+// Clusters needed (n / m) for a point to count in the white noise estimate
+#define WHITE_NOISE_MIN_CLUSTERS 1000
+
+// Largest lag a moving average window may add to the fusion stage (seconds)
+#define MAX_SMOOTHING_LAG 0.04
+
+// =========================================================================================
+//                                  ALLAN VARIANCE
+//==========================================================================================
+
+// Sum over k < count of (s[k+2m] - 2 s[k+m] + s[k])^2
+static double Kernel_SecondDifferenceEnergy(const double* s, size_t m, size_t count)
+{
+    size_t k = 0;
+    double sum = 0.0;
+
+    #ifdef __SSE2__
+    __m128d two  = _mm_set1_pd(2.0);
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    for (; k + 4 <= count; k += 4)
+    {
+        __m128d d0 = _mm_add_pd(_mm_sub_pd(_mm_loadu_pd(s + k + 2*m), _mm_mul_pd(two, _mm_loadu_pd(s + k + m))), _mm_loadu_pd(s + k));
+        __m128d d1 = _mm_add_pd(_mm_sub_pd(_mm_loadu_pd(s + k + 2*m + 2), _mm_mul_pd(two, _mm_loadu_pd(s + k + m + 2))), _mm_loadu_pd(s + k + 2));
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    sum = lanes[0] + lanes[1];
+    #endif
+
+    for (; k < count; ++k)
+    {
+        double d = s[k + 2*m] - 2.0*s[k + m] + s[k];
+        sum += d*d;
+    }
+    return sum;
+}
+
+// Logarithmically spaced cluster sizes, keeping at least 9 independent clusters
+static std::vector<size_t> ClusterSizes(size_t n, unsigned int points_per_decade)
+{
+    std::vector<size_t> sizes;
+    for (unsigned int j = 0; ; ++j)
+    {
+        size_t m = (size_t)std::lround(std::pow(10.0, (double)j / points_per_decade));
+        if (m * 9 > n)
+            break;
+        if (sizes.empty() || m != sizes.back())
+            sizes.push_back(m);
+    }
+    return sizes;
+}
+
+// Overlapping Allan deviation of y at the given cluster sizes. Returns the mean of y.
+static double AllanDeviation(const std::vector<float>& y, const std::vector<size_t>& sizes, std::vector<double>* deviation, ThreadPool& pool)
+{
+    size_t n = y.size();
+
+    double mean = 0.0;
+    for (size_t i = 0; i < n; ++i)
+        mean += y[i];
+    mean /= n;
+
+    // Integrated signal (mean removed to keep the sums small)
+    std::vector<double> s(n + 1);
+    s[0] = 0.0;
+    for (size_t i = 0; i < n; ++i)
+        s[i + 1] = s[i] + (y[i] - mean);
+
+    deviation->resize(sizes.size());
+    ParallelFor(pool, sizes.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t j = begin; j < end; ++j)
+        {
+            size_t m = sizes[j];
+            size_t count = n + 1 - 2*m;
+            double energy = Kernel_SecondDifferenceEnergy(&s[0], m, count);
+            (*deviation)[j] = std::sqrt(energy / (2.0 * (double)m * m * count));
+        }
+    });
+
+    return mean;
+}
+
+// Noise parameters read from one Allan deviation curve
+struct NoiseParameters
+{
+    double mean;
+    double white;            // White noise coefficient (N): units * sqrt(s)
+    double bias_instability; // Flicker floor (B): units
+    double min_tau;          // Cluster time at the bottom of the curve (s)
+};
+
+static NoiseParameters ReadCurve(double mean, size_t n, const std::vector<size_t>& sizes, const std::vector<double>& tau, const std::vector<double>& deviation)
+{
+    NoiseParameters parameters;
+    parameters.mean = mean;
+    parameters.bias_instability = INFINITY;
+    parameters.min_tau = tau.empty() ? 0.0 : tau[0];
+
+    // White noise: sigma * sqrt(tau) along the -1/2 slope, where clusters are many enough
+    // for a couple of percent of uncertainty (median, so outliers of other terms drop out)
+    std::vector<double> white;
+    for (size_t j = 0; j + 1 < tau.size() && sizes[j] * WHITE_NOISE_MIN_CLUSTERS <= n; ++j)
+    {
+        double slope = std::log(deviation[j + 1] / deviation[j]) / std::log(tau[j + 1] / tau[j]);
+        if (slope > -0.75 && slope < -0.25)
+            white.push_back(deviation[j] * std::sqrt(tau[j]));
+    }
+    if (!white.empty())
+    {
+        std::nth_element(white.begin(), white.begin() + white.size() / 2, white.end());
+        parameters.white = white[white.size() / 2];
+    }
+    else
+        parameters.white = tau.empty() ? 0.0 : deviation[0] * std::sqrt(tau[0]);
+
+    // Bias instability: bottom of the curve
+    for (size_t j = 0; j < tau.size(); ++j)
+    {
+        if (deviation[j] / BIAS_INSTABILITY_FACTOR < parameters.bias_instability)
+        {
+            parameters.bias_instability = deviation[j] / BIAS_INSTABILITY_FACTOR;
+            parameters.min_tau = tau[j];
+        }
+    }
+    return parameters;
+}
+
+// Cluster time where the integrated gyro error (N_g sqrt(t) + B_g t) meets the
+// accelerometer tilt noise (N_a / sqrt(t)), both in radians
+static double CrossoverTime(double gyro_white, double gyro_bias, double accel_white, double tau0)
+{
+    double low = tau0, high = 1e4;
+    for (int i = 0; i < 100; ++i)
+    {
+        double t = std::sqrt(low * high);
+        double gyro_error = gyro_white * std::sqrt(t) + gyro_bias * t;
+        double tilt_error = accel_white / std::sqrt(t);
+        if (gyro_error < tilt_error)
+            low = t;
+        else
+            high = t;
+    }
+    return std::sqrt(low * high);
+}
+
+// =========================================================================================
+//                                       MAIN
+//==========================================================================================
+
+// Samples of one training, per channel
+struct TrainingSamples
+{
+    std::vector<float> values[NUM_CHANNELS];
+    unsigned long      first[2], last[2]; // msec from the training start, per sample type
+};
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: lognoise [--points-per-decade K] [--csv FILE] [--threads N] log\n");
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int num_threads = 0;
+    unsigned int points_per_decade = 10;
+    const char* csv_filename = NULL;
+    const char* filename = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--points-per-decade" && has_value)
+            points_per_decade = std::max(1ul, strtoul(argv[++i], NULL, 10));
+        else if (arg == "--csv" && has_value)
+            csv_filename = argv[++i];
+        else if (arg == "--threads" && has_value)
+            num_threads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (arg.compare(0, 2, "--") == 0 || filename)
+            return PrintUsage(), EXIT_FAILURE;
+        else
+            filename = argv[i];
+    }
+
+    if (!filename)
+        return PrintUsage(), EXIT_FAILURE;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ThreadPool pool(num_threads);
+
+    MappedFile file;
+    WiicLogHeader header;
+    std::vector<WiicLogTraining> trainings;
+    if (!file.Open(filename))
+        return fprintf(stderr, "ERROR: Cannot open file \"%s\".\n", filename), EXIT_FAILURE;
+    if (!WiicLog_ParseHeader(file.data, file.size, &header) || !WiicLog_FindTrainings(file.data, file.size, header.body_offset, &trainings))
+        return fprintf(stderr, "ERROR: Bad log file \"%s\".\n", filename), EXIT_FAILURE;
+
+    // Parse the trainings in parallel
+    std::vector<TrainingSamples> parsed(trainings.size());
+    ParallelFor(pool, trainings.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t t = begin; t < end; ++t)
+        {
+            const char* p    = file.data + trainings[t].begin;
+            const char* stop = file.data + trainings[t].end;
+            TrainingSamples& samples = parsed[t];
+            for (int c = 0; c < NUM_CHANNELS; ++c)
+                samples.values[c].reserve(trainings[t].num_samples / 2 + 1);
+
+            WiicLogSample sample;
+            while (p < stop)
+            {
+                if (!WiicLog_ParseSample(p, stop, &sample) || (sample.type != WIIC_LOG_ACC && sample.type != WIIC_LOG_GYRO))
+                    continue;
+
+                int type = sample.type == WIIC_LOG_ACC ? 0 : 1;
+                if (samples.values[type * 3].empty())
+                    samples.first[type] = sample.timestamp;
+                samples.last[type] = sample.timestamp;
+                for (int i = 0; i < 3; ++i)
+                    samples.values[type * 3 + i].push_back(sample.values[i]);
+            }
+        }
+    });
+
+    // Concatenate, and take the sampling period from the time covered by each training
+    std::vector<float> channels[NUM_CHANNELS];
+    double span[2] = { 0.0, 0.0 };
+    size_t intervals[2] = { 0, 0 }, samples[2] = { 0, 0 };
+    for (size_t t = 0; t < parsed.size(); ++t)
+    {
+        for (int type = 0; type < 2; ++type)
+        {
+            size_t count = parsed[t].values[type * 3].size();
+            samples[type] += count;
+            if (count > 1)
+            {
+                span[type] += (parsed[t].last[type] - parsed[t].first[type]) / 1000.0;
+                intervals[type] += count - 1;
+            }
+        }
+        for (int c = 0; c < NUM_CHANNELS; ++c)
+        {
+            channels[c].insert(channels[c].end(), parsed[t].values[c].begin(), parsed[t].values[c].end());
+            std::vector<float>().swap(parsed[t].values[c]);
+        }
+    }
+
+    if (intervals[0] == 0 || intervals[1] == 0 || span[0] <= 0.0 || span[1] <= 0.0)
+        return fprintf(stderr, "ERROR: \"%s\" needs both ACC and GYRO samples.\n", filename), EXIT_FAILURE;
+
+    double tau0[2] = { span[0] / intervals[0], span[1] / intervals[1] };
+    double parse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Allan deviation curves, one channel at a time to bound the memory of the integrated signal
+    std::vector<double> tau[NUM_CHANNELS], deviation[NUM_CHANNELS];
+    NoiseParameters parameters[NUM_CHANNELS];
+    for (int c = 0; c < NUM_CHANNELS; ++c)
+    {
+        int type = c / 3;
+        std::vector<size_t> sizes = ClusterSizes(channels[c].size(), points_per_decade);
+        double mean = AllanDeviation(channels[c], sizes, &deviation[c], pool);
+
+        tau[c].resize(sizes.size());
+        for (size_t j = 0; j < sizes.size(); ++j)
+            tau[c][j] = sizes[j] * tau0[type];
+
+        parameters[c] = ReadCurve(mean, channels[c].size(), sizes, tau[c], deviation[c]);
+        std::vector<float>().swap(channels[c]);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Report
+    printf("log: \"%s\" (%s), %u trainings\n", filename, header.address.c_str(), (unsigned)trainings.size());
+    printf("ACC  %lu samples at %.2f Hz (%.1f h)\n", (unsigned long)samples[0], 1.0 / tau0[0], span[0] / 3600.0);
+    printf("GYRO %lu samples at %.2f Hz (%.1f h)\n", (unsigned long)samples[1], 1.0 / tau0[1], span[1] / 3600.0);
+    printf("\n");
+
+    printf("%-11s %12s %16s %18s %12s\n", "channel", "mean", "white noise", "bias instability", "at tau (s)");
+    for (int c = 0; c < 3; ++c)
+        printf("%-11s %10.5f g %9.1f ug/rtHz %15.1f ug %12.2f\n", g_ChannelNames[c], parameters[c].mean,
+               parameters[c].white * 1e6, parameters[c].bias_instability * 1e6, parameters[c].min_tau);
+    for (int c = 3; c < NUM_CHANNELS; ++c)
+        printf("%-11s %8.4f d/s %11.4f d/rth %14.3f d/h %12.2f\n", g_ChannelNames[c], parameters[c].mean,
+               parameters[c].white * 60.0, parameters[c].bias_instability * 3600.0, parameters[c].min_tau);
+    printf("\n");
+
+    if (csv_filename)
+    {
+        FILE* csv = fopen(csv_filename, "w");
+        if (!csv)
+            return fprintf(stderr, "ERROR: Cannot open file \"%s\".\n", csv_filename), EXIT_FAILURE;
+
+        fprintf(csv, "channel,tau,deviation\n");
+        for (int c = 0; c < NUM_CHANNELS; ++c)
+            for (size_t j = 0; j < tau[c].size(); ++j)
+                fprintf(csv, "%s,%g,%g\n", g_ChannelNames[c], tau[c][j], deviation[c][j]);
+        fclose(csv);
+    }
+
+    // Recommended fusion constants. The moving averages stop helping where the Allan
+    // deviation bottoms out, and are capped so they add at most MAX_SMOOTHING_LAG of lag.
+    double gyro_min_tau = std::min(std::min(parameters[3].min_tau, parameters[4].min_tau), parameters[5].min_tau);
+    double accel_min_tau = std::min(std::min(parameters[0].min_tau, parameters[1].min_tau), parameters[2].min_tau);
+    long gyro_window  = std::max(1l, std::min(std::lround(gyro_min_tau / tau0[1]),  (long)(2.0 * MAX_SMOOTHING_LAG / tau0[1])));
+    long accel_window = std::max(1l, std::min(std::lround(accel_min_tau / tau0[0]), (long)(2.0 * MAX_SMOOTHING_LAG / tau0[0])));
+
+    // Complementary filter: trust the gyroscope up to where its drift exceeds the tilt noise
+    double gyro_white = 0.0, gyro_bias = 0.0, accel_white = 0.0;
+    for (int i = 0; i < 3; ++i)
+    {
+        gyro_white  += parameters[3 + i].white * M_PI / 180.0 / 3.0;
+        gyro_bias   += parameters[3 + i].bias_instability * M_PI / 180.0 / 3.0;
+        accel_white += parameters[i].white / 3.0;
+    }
+    double crossover = CrossoverTime(gyro_white, gyro_bias, accel_white, tau0[1]);
+    printf("gyro/accel crossover: %.4f s (complementary filter alpha %.6f at %.2f Hz)\n\n", crossover,
+           crossover / (crossover + tau0[1]), 1.0 / tau0[1]);
+
+    // Only the constants HandleReport() reads
+    printf("// Recommended fusion constants (%s)\n", filename);
+    printf("#define GYROSCOPE_MOVING_AVERAGE_WINDOW_SIZE %ld\n", gyro_window);
+    printf("#define ACCELEROMETER_MOVING_AVERAGE_WINDOW_SIZE %ld\n", accel_window);
+    printf("#define GYROSCOPE_BIAS_ROLL %.5ff\n", parameters[3].mean);
+    printf("#define GYROSCOPE_BIAS_PITCH %.5ff\n", parameters[4].mean);
+    printf("#define GYROSCOPE_BIAS_YAW %.5ff\n", parameters[5].mean);
+    printf("\n");
+
+    printf("analyzed %.1f MB in %.3f s (parse %.3f s, %u threads)\n", file.size / (1024.0*1024.0), seconds, parse_seconds, pool.Size());
+    return EXIT_SUCCESS;
+}
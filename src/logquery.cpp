@@ -0,0 +1,464 @@
+// Command line query tool for WiiC sensor logs.
+//
+// Scans one or many logs in parallel (memory mapped) and prints per channel aggregates
+// of the samples matching the filters, without loading anything through Dataset.
+//
+//   logquery [--addr MAC] [--from TIME] [--to TIME] [--where PREDICATE]... [--gap MSEC]
+//            [--threads N] log...
+//
+// TIME is the time of day of a sample (training START + sample offset), as HH:MM[:SS[.mmm]]
+// or as milliseconds since midnight. PREDICATE is <channel><op><value>, with channel one of
+// acc.x acc.y acc.z gyro.roll gyro.pitch gyro.yaw and op one of < <= > >= = !=. Predicates
+// on accelerometer channels filter ACC samples, predicates on gyroscope channels GYRO ones.
+// Rates and gaps count every sample in the time window, whatever the predicates. Logs that
+// cannot be read and malformed sample lines are reported, and the exit status is then 1.
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <algorithm>
+#include <stdint.h>
+#include <strings.h>
+
+#include "wiiclog.h"
+#include "threadpool.h"
+#include "parseutils.h"
+
+#define NUM_CHANNELS 6
+#define HISTOGRAM_BUCKETS 65536
+
+static const char* g_ChannelNames[NUM_CHANNELS] = {
+    "acc.x", "acc.y", "acc.z", "gyro.roll", "gyro.pitch", "gyro.yaw"
+};
+
+// =========================================================================================
+//                                     FILTERS
+//==========================================================================================
+
+struct Predicate
+{
+    int   channel;
+    char  op[3];
+    float value;
+
+    bool Test(float x) const
+    {
+        switch (op[0])
+        {
+            case '<': return op[1] == '=' ? x <= value : x < value;
+            case '>': return op[1] == '=' ? x >= value : x > value;
+            case '=': return x == value;
+            default:  return x != value;
+        }
+    }
+};
+
+struct Query
+{
+    std::string            address;
+    unsigned long          from;
+    unsigned long          to;
+    std::vector<Predicate> predicates;
+    unsigned long          gap; // msec
+};
+
+// Parses HH:MM[:SS[.mmm]] or plain milliseconds since midnight
+static bool ParseTimeOfDay(const char* text, unsigned long* ms)
+{
+    const char* p   = text;
+    const char* end = text + strlen(text);
+
+    unsigned long hours, minutes = 0;
+    float seconds = 0.0f;
+    if (!Parse_Unsigned(p, end, &hours))
+        return false;
+    if (p == end)
+        return *ms = hours, true;
+
+    if (*p++ != ':' || !Parse_Unsigned(p, end, &minutes))
+        return false;
+    if (p < end && (*p++ != ':' || !Parse_Float(p, end, &seconds)))
+        return false;
+
+    *ms = (hours*3600 + minutes*60) * 1000 + (unsigned long)std::lround(seconds * 1000.0f);
+    return p == end;
+}
+
+// Parses <channel><op><value>
+static bool ParsePredicate(const char* text, Predicate* predicate)
+{
+    for (int c = 0; c < NUM_CHANNELS; ++c)
+    {
+        size_t length = strlen(g_ChannelNames[c]);
+        if (strncmp(text, g_ChannelNames[c], length) != 0)
+            continue;
+
+        const char* p = text + length;
+        size_t op_length = strspn(p, "<>=!");
+        if (op_length < 1 || op_length > 2)
+            return false;
+
+        predicate->channel = c;
+        memcpy(predicate->op, p, op_length);
+        predicate->op[op_length] = '\0';
+        if (strcmp(predicate->op, "!") == 0 || (op_length == 2 && predicate->op[1] != '='))
+            return false;
+
+        p += op_length;
+        const char* end = p + strlen(p);
+        return Parse_Float(p, end, &predicate->value) && p == end;
+    }
+    return false;
+}
+
+// =========================================================================================
+//                                   AGGREGATION
+//==========================================================================================
+
+// Order preserving mapping of a float to an unsigned key
+static inline uint32_t FloatKey(float x)
+{
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+static inline float KeyFloat(uint32_t key)
+{
+    uint32_t u = (key & 0x80000000u) ? (key & 0x7FFFFFFFu) : ~key;
+    float x;
+    memcpy(&x, &u, sizeof(x));
+    return x;
+}
+
+// Aggregates of the matching samples. Percentiles come from a histogram over the top
+// 16 bits of the float keys (sign, exponent and 7 mantissa bits), so accumulators can
+// be merged in O(1) memory with a relative error below 0.4%.
+struct Aggregate
+{
+    uint64_t              count[NUM_CHANNELS];
+    float                 min[NUM_CHANNELS];
+    float                 max[NUM_CHANNELS];
+    double                sum[NUM_CHANNELS];
+    std::vector<uint32_t> histogram[NUM_CHANNELS];
+
+    // Per sample type (0 = ACC, 1 = GYRO): matching samples, then the rate and gaps of every
+    // sample in the time window
+    uint64_t              samples[2];
+    uint64_t              intervals[2];
+    double                span[2];     // seconds between the first and last sample of each training
+    uint64_t              gaps[2];
+    unsigned long         max_gap[2];  // msec
+
+    uint64_t              trainings;
+    uint64_t              bad_lines;   // Sample lines that failed to parse
+
+    Aggregate()
+    {
+        for (int c = 0; c < NUM_CHANNELS; ++c)
+        {
+            count[c] = 0;
+            min[c] = INFINITY;
+            max[c] = -INFINITY;
+            sum[c] = 0.0;
+            histogram[c].assign(HISTOGRAM_BUCKETS, 0);
+        }
+        for (int t = 0; t < 2; ++t)
+        {
+            samples[t] = 0;
+            intervals[t] = 0;
+            span[t] = 0.0;
+            gaps[t] = 0;
+            max_gap[t] = 0;
+        }
+        trainings = 0;
+        bad_lines = 0;
+    }
+
+    void Add(int channel, float x)
+    {
+        ++count[channel];
+        min[channel] = std::min(min[channel], x);
+        max[channel] = std::max(max[channel], x);
+        sum[channel] += x;
+        ++histogram[channel][FloatKey(x) >> 16];
+    }
+
+    void Merge(const Aggregate& other)
+    {
+        for (int c = 0; c < NUM_CHANNELS; ++c)
+        {
+            count[c] += other.count[c];
+            min[c] = std::min(min[c], other.min[c]);
+            max[c] = std::max(max[c], other.max[c]);
+            sum[c] += other.sum[c];
+            for (size_t b = 0; b < HISTOGRAM_BUCKETS; ++b)
+                histogram[c][b] += other.histogram[c][b];
+        }
+        for (int t = 0; t < 2; ++t)
+        {
+            samples[t] += other.samples[t];
+            intervals[t] += other.intervals[t];
+            span[t] += other.span[t];
+            gaps[t] += other.gaps[t];
+            max_gap[t] = std::max(max_gap[t], other.max_gap[t]);
+        }
+        trainings += other.trainings;
+        bad_lines += other.bad_lines;
+    }
+
+    float Percentile(int channel, double p) const
+    {
+        if (count[channel] == 0)
+            return NAN;
+
+        uint64_t rank = (uint64_t)std::ceil(p * count[channel]);
+        if (rank == 0)
+            rank = 1;
+
+        uint64_t seen = 0;
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; ++b)
+        {
+            seen += histogram[channel][b];
+            if (seen >= rank)
+            {
+                // Bucket midpoint, clamped to the exact extremes
+                float x = KeyFloat((uint32_t)(b << 16) | 0x8000u);
+                return std::min(std::max(x, min[channel]), max[channel]);
+            }
+        }
+        return max[channel];
+    }
+};
+
+// A log and its trainings
+struct LogFile
+{
+    const char*                  filename;
+    MappedFile                   file;
+    WiicLogHeader                header;
+    std::vector<WiicLogTraining> trainings;
+    const char*                  error;   // Why the log could not be read, NULL if it was
+    bool                         matched; // Read, and from the queried address
+};
+
+// Scans one training into the aggregate
+static void ScanTraining(const LogFile& log, const WiicLogTraining& training, const Query& query, Aggregate* aggregate)
+{
+    const char* p   = log.file.data + training.begin;
+    const char* end = log.file.data + training.end;
+
+    unsigned long first[2] = { 0, 0 }, last[2] = { 0, 0 };
+    uint64_t      seen[2]  = { 0, 0 }; // In the time window
+    uint64_t      matched[2] = { 0, 0 };
+
+    WiicLogSample sample;
+    while (p < end)
+    {
+        if (!WiicLog_ParseSample(p, end, &sample))
+        {
+            ++aggregate->bad_lines;
+            continue;
+        }
+        if (sample.type != WIIC_LOG_ACC && sample.type != WIIC_LOG_GYRO)
+            continue;
+
+        unsigned long time_of_day = training.timestamp + sample.timestamp;
+        if (time_of_day < query.from || time_of_day > query.to)
+            continue;
+
+        int type = sample.type == WIIC_LOG_ACC ? 0 : 1;
+        int first_channel = type * 3;
+
+        // Rate and gaps over every sample of each type in the window, whatever the predicates
+        if (seen[type]++ == 0)
+            first[type] = sample.timestamp;
+        else if (sample.timestamp > last[type] && sample.timestamp - last[type] > query.gap)
+        {
+            ++aggregate->gaps[type];
+            aggregate->max_gap[type] = std::max(aggregate->max_gap[type], sample.timestamp - last[type]);
+        }
+        last[type] = sample.timestamp;
+
+        bool match = true;
+        for (size_t i = 0; i < query.predicates.size() && match; ++i)
+        {
+            const Predicate& predicate = query.predicates[i];
+            if (predicate.channel / 3 == type)
+                match = predicate.Test(sample.values[predicate.channel - first_channel]);
+        }
+        if (!match)
+            continue;
+
+        ++matched[type];
+        for (int i = 0; i < 3; ++i)
+            aggregate->Add(first_channel + i, sample.values[i]);
+    }
+
+    for (int t = 0; t < 2; ++t)
+    {
+        aggregate->samples[t] += matched[t];
+        if (seen[t] > 1 && last[t] > first[t])
+        {
+            aggregate->intervals[t] += seen[t] - 1;
+            aggregate->span[t] += (last[t] - first[t]) / 1000.0;
+        }
+    }
+    ++aggregate->trainings;
+}
+
+// =========================================================================================
+//                                       MAIN
+//==========================================================================================
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: logquery [--addr MAC] [--from TIME] [--to TIME] [--where PREDICATE]... [--gap MSEC] [--threads N] log...\n");
+}
+
+int main(int argc, char* argv[])
+{
+    Query query;
+    query.from = 0;
+    query.to   = (unsigned long)-1;
+    query.gap  = 50;
+    unsigned int num_threads = 0;
+    std::vector<const char*> filenames;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--addr" && has_value)
+            query.address = argv[++i];
+        else if (arg == "--from" && has_value)
+        {
+            if (!ParseTimeOfDay(argv[++i], &query.from))
+                return fprintf(stderr, "ERROR: Bad time \"%s\".\n", argv[i]), EXIT_FAILURE;
+        }
+        else if (arg == "--to" && has_value)
+        {
+            if (!ParseTimeOfDay(argv[++i], &query.to))
+                return fprintf(stderr, "ERROR: Bad time \"%s\".\n", argv[i]), EXIT_FAILURE;
+        }
+        else if (arg == "--where" && has_value)
+        {
+            Predicate predicate;
+            if (!ParsePredicate(argv[++i], &predicate))
+                return fprintf(stderr, "ERROR: Bad predicate \"%s\".\n", argv[i]), EXIT_FAILURE;
+            query.predicates.push_back(predicate);
+        }
+        else if (arg == "--gap" && has_value)
+            query.gap = strtoul(argv[++i], NULL, 10);
+        else if (arg == "--threads" && has_value)
+            num_threads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (arg.compare(0, 2, "--") == 0)
+            return PrintUsage(), EXIT_FAILURE;
+        else
+            filenames.push_back(argv[i]);
+    }
+
+    if (filenames.empty())
+        return PrintUsage(), EXIT_FAILURE;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ThreadPool pool(num_threads);
+
+    // Map the logs, check headers and find trainings (one log per task)
+    std::vector<LogFile> logs(filenames.size());
+    ParallelFor(pool, logs.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            LogFile& log = logs[i];
+            log.filename = filenames[i];
+            log.error = NULL;
+            log.matched = false;
+
+            if (!log.file.Open(log.filename))
+                log.error = "cannot open file";
+            else if (!WiicLog_ParseHeader(log.file.data, log.file.size, &log.header))
+                log.error = "bad header";
+            else if (!query.address.empty() && strcasecmp(log.header.address.c_str(), query.address.c_str()) != 0)
+                continue;
+            else if (!WiicLog_FindTrainings(log.file.data, log.file.size, log.header.body_offset, &log.trainings))
+                log.error = "bad training blocks";
+            else
+                log.matched = true;
+        }
+    });
+
+    // Unreadable logs are errors, not logs of another address
+    size_t failed_logs = 0;
+    for (size_t i = 0; i < logs.size(); ++i)
+        if (logs[i].error)
+        {
+            fprintf(stderr, "ERROR: Cannot read log \"%s\" (%s).\n", logs[i].filename, logs[i].error);
+            ++failed_logs;
+        }
+
+    // Flatten the trainings of every matching log, then scan them in parallel
+    std::vector<std::pair<const LogFile*, const WiicLogTraining*> > work;
+    size_t matched_logs = 0;
+    uint64_t scanned_bytes = 0;
+    for (size_t i = 0; i < logs.size(); ++i)
+    {
+        if (!logs[i].matched)
+            continue;
+        ++matched_logs;
+        scanned_bytes += logs[i].file.size;
+        for (size_t t = 0; t < logs[i].trainings.size(); ++t)
+            work.push_back(std::make_pair(&logs[i], &logs[i].trainings[t]));
+    }
+
+    Aggregate total;
+    std::mutex total_mutex;
+    ParallelFor(pool, work.size(), [&](size_t begin, size_t end)
+    {
+        Aggregate local;
+        for (size_t i = begin; i < end; ++i)
+            ScanTraining(*work[i].first, *work[i].second, query, &local);
+
+        std::lock_guard<std::mutex> lock(total_mutex);
+        total.Merge(local);
+    }, 256);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Report
+    printf("logs: %u (%u matched), trainings: %lu, samples: ACC %lu, GYRO %lu\n",
+           (unsigned)logs.size(), (unsigned)matched_logs, (unsigned long)total.trainings,
+           (unsigned long)total.samples[0], (unsigned long)total.samples[1]);
+
+    printf("%-11s %12s %12s %12s %12s %12s %12s %12s\n", "channel", "count", "min", "max", "mean", "p50", "p95", "p99");
+    for (int c = 0; c < NUM_CHANNELS; ++c)
+    {
+        if (total.count[c] == 0)
+            continue;
+        printf("%-11s %12lu %12.4f %12.4f %12.4f %12.4f %12.4f %12.4f\n", g_ChannelNames[c], (unsigned long)total.count[c],
+               total.min[c], total.max[c], total.sum[c] / total.count[c],
+               total.Percentile(c, 0.50), total.Percentile(c, 0.95), total.Percentile(c, 0.99));
+    }
+
+    const char* type_names[2] = { "ACC", "GYRO" };
+    for (int t = 0; t < 2; ++t)
+    {
+        if (total.samples[t] == 0)
+            continue;
+        printf("%-4s rate: %.2f Hz, gaps > %lu ms: %lu (max %lu ms)\n", type_names[t],
+               total.span[t] > 0.0 ? total.intervals[t] / total.span[t] : 0.0,
+               query.gap, (unsigned long)total.gaps[t], total.max_gap[t]);
+    }
+
+    printf("scanned %.1f MB in %.3f s (%.1f MB/s, %u threads)\n", scanned_bytes / (1024.0*1024.0), seconds,
+           scanned_bytes / (1024.0*1024.0) / (seconds > 0.0 ? seconds : 1e-9), pool.Size());
+
+    if (total.bad_lines > 0)
+        fprintf(stderr, "ERROR: %lu malformed sample lines.\n", (unsigned long)total.bad_lines);
+    return failed_logs == 0 && total.bad_lines == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
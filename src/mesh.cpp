@@ -0,0 +1,696 @@
+#include <cmath>
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <unordered_set>
+
+#include "mesh.h"
+
+// =========================================================================================
+//                                      WELDING
+//==========================================================================================
+
+static uint32_t HashWords(const void* data, size_t count)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t word;
+        memcpy(&word, (const char*)data + 4*i, sizeof(word));
+        hash ^= word;
+        hash *= 16777619u;
+        hash ^= hash >> 15;
+    }
+    return hash;
+}
+
+static uint32_t HashVertex(const MeshVertex& vertex)
+{
+    return HashWords(&vertex, sizeof(MeshVertex) / 4);
+}
+
+// Builds an indexed mesh from triangulated OBJ shapes, welding identical vertices
+void Mesh_Build(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, Mesh* mesh)
+{
+    size_t num_corners = 0;
+    for (size_t shape = 0; shape < shapes.size(); ++shape)
+        num_corners += shapes[shape].mesh.indices.size();
+
+    mesh->vertices.clear();
+    mesh->indices.clear();
+    mesh->parts.clear();
+    mesh->indices.reserve(num_corners);
+    mesh->has_normals = false;
+    mesh->has_texcoords = false;
+
+    // Open addressing table of vertex indices, at most half full
+    size_t capacity = 1;
+    while (capacity < num_corners * 2)
+        capacity <<= 1;
+    std::vector<uint32_t> table(capacity, UINT32_MAX);
+
+    for (size_t shape = 0; shape < shapes.size(); ++shape)
+    {
+        const tinyobj::mesh_t& source = shapes[shape].mesh;
+
+        MeshPart part;
+        part.name = shapes[shape].name;
+        part.num_lods = 1;
+        memset(part.lods, 0, sizeof(part.lods));
+        part.lods[0].first_index = (uint32_t)mesh->indices.size();
+        part.lods[0].error = 0.0f;
+
+        for (size_t triangle = 0; triangle < source.num_face_vertices.size(); ++triangle)
+        {
+            assert(source.num_face_vertices[triangle] == 3);
+
+            for (size_t corner = 3*triangle; corner < 3*triangle + 3; ++corner)
+            {
+                tinyobj::index_t idx = source.indices[corner];
+
+                // Unused attributes are zero, and adding 0.0f turns -0.0f into 0.0f so equal
+                // values always have equal bits
+                MeshVertex vertex;
+                memset(&vertex, 0, sizeof(vertex));
+                for (int i = 0; i < 3; ++i)
+                    vertex.position[i] = attrib.vertices[3*idx.vertex_index + i] + 0.0f;
+                if (idx.normal_index != -1)
+                {
+                    for (int i = 0; i < 3; ++i)
+                        vertex.normal[i] = attrib.normals[3*idx.normal_index + i] + 0.0f;
+                    mesh->has_normals = true;
+                }
+                if (idx.texcoord_index != -1)
+                {
+                    for (int i = 0; i < 2; ++i)
+                        vertex.texcoord[i] = attrib.texcoords[2*idx.texcoord_index + i] + 0.0f;
+                    mesh->has_texcoords = true;
+                }
+
+                size_t slot = HashVertex(vertex) & (capacity - 1);
+                while (table[slot] != UINT32_MAX && memcmp(&mesh->vertices[table[slot]], &vertex, sizeof(vertex)) != 0)
+                    slot = (slot + 1) & (capacity - 1);
+
+                if (table[slot] == UINT32_MAX)
+                {
+                    table[slot] = (uint32_t)mesh->vertices.size();
+                    mesh->vertices.push_back(vertex);
+                }
+                mesh->indices.push_back(table[slot]);
+            }
+        }
+
+        part.lods[0].num_indices = (uint32_t)mesh->indices.size() - part.lods[0].first_index;
+        mesh->parts.push_back(part);
+    }
+}
+
+// =========================================================================================
+//                                   SIMPLIFICATION
+//==========================================================================================
+
+// Weighted sum of squared distances to a set of planes p = (a, b, c, d), kept as the upper
+// half of the symmetric matrix sum(w * p p^T) (Garland and Heckbert 1997)
+struct Quadric
+{
+    double a00, a01, a02, a03;
+    double a11, a12, a13;
+    double a22, a23;
+    double a33;
+    double weight;
+};
+
+static void Quadric_AddPlane(Quadric* q, const double p[4], double w)
+{
+    q->a00 += w * p[0] * p[0]; q->a01 += w * p[0] * p[1]; q->a02 += w * p[0] * p[2]; q->a03 += w * p[0] * p[3];
+    q->a11 += w * p[1] * p[1]; q->a12 += w * p[1] * p[2]; q->a13 += w * p[1] * p[3];
+    q->a22 += w * p[2] * p[2]; q->a23 += w * p[2] * p[3];
+    q->a33 += w * p[3] * p[3];
+    q->weight += w;
+}
+
+static void Quadric_Add(Quadric* q, const Quadric& r)
+{
+    q->a00 += r.a00; q->a01 += r.a01; q->a02 += r.a02; q->a03 += r.a03;
+    q->a11 += r.a11; q->a12 += r.a12; q->a13 += r.a13;
+    q->a22 += r.a22; q->a23 += r.a23;
+    q->a33 += r.a33;
+    q->weight += r.weight;
+}
+
+// Mean squared distance of a point to the planes of a quadric
+static double Quadric_Error(const Quadric& q, const float* point)
+{
+    double x = point[0], y = point[1], z = point[2];
+    double error = q.a00 * x * x + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a03 * x)
+                 + q.a11 * y * y + 2.0 * (q.a12 * y * z + q.a13 * y)
+                 + q.a22 * z * z + 2.0 * q.a23 * z
+                 + q.a33;
+    return q.weight > 0.0 ? std::max(0.0, error) / q.weight : 0.0;
+}
+
+// Unnormalized triangle normal (twice the area long)
+static void TriangleNormal(const float* a, const float* b, const float* c, double normal[3])
+{
+    double u[3], v[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        u[i] = (double)b[i] - a[i];
+        v[i] = (double)c[i] - a[i];
+    }
+    normal[0] = u[1] * v[2] - u[2] * v[1];
+    normal[1] = u[2] * v[0] - u[0] * v[2];
+    normal[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+// Whether moving corner a of a triangle to a new position turns its normal by more than
+// ~75 degrees (or leaves it without area)
+static bool TurnsOver(const float* a, const float* b, const float* c, const float* moved)
+{
+    double before[3], after[3];
+    TriangleNormal(a, b, c, before);
+    TriangleNormal(moved, b, c, after);
+
+    double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+    double length_before = std::sqrt(before[0] * before[0] + before[1] * before[1] + before[2] * before[2]);
+    double length_after  = std::sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+    return length_before > 0.0 && dot <= 0.25 * length_before * length_after;
+}
+
+// Per mesh state shared by the simplification of every part and level
+struct SimplifyContext
+{
+    const Mesh*           mesh;
+    std::vector<uint32_t> position;       // First vertex with the same position, for every vertex
+    std::vector<uint32_t> local_vertex;   // Scratch numberings of a range (UINT32_MAX outside of it)
+    std::vector<uint32_t> local_position;
+};
+
+// Edge collapse from a vertex onto a neighbour
+struct Collapse
+{
+    uint32_t from;
+    uint32_t to;
+    double   cost;
+
+    bool operator<(const Collapse& other) const { return cost < other.cost; }
+};
+
+// Collapses edges of a triangle list until it has at most target_count indices or no edge
+// can go. Vertices only ever collapse onto other existing vertices, so the result indexes the
+// same vertex buffer. Returns the largest distance introduced, in model units.
+static float Simplify(SimplifyContext* context, std::vector<uint32_t>* indices, size_t target_count)
+{
+    const std::vector<MeshVertex>& mesh_vertices = context->mesh->vertices;
+
+    // Local numbering of the vertices in the range, and of their positions
+    std::vector<uint32_t> global;   // Mesh vertex of every local vertex
+    std::vector<uint32_t> position; // Local position of every local vertex
+    std::vector<uint32_t> triangles(indices->size());
+    size_t num_positions = 0;
+    for (size_t i = 0; i < indices->size(); ++i)
+    {
+        uint32_t v = (*indices)[i];
+        if (context->local_vertex[v] == UINT32_MAX)
+        {
+            uint32_t p = context->position[v];
+            if (context->local_position[p] == UINT32_MAX)
+                context->local_position[p] = (uint32_t)num_positions++;
+            context->local_vertex[v] = (uint32_t)global.size();
+            global.push_back(v);
+            position.push_back(context->local_position[p]);
+        }
+        triangles[i] = context->local_vertex[v];
+    }
+    for (size_t v = 0; v < global.size(); ++v)
+    {
+        context->local_vertex[global[v]] = UINT32_MAX;
+        context->local_position[context->position[global[v]]] = UINT32_MAX;
+    }
+
+    size_t num_vertices = global.size();
+    std::vector<const float*> coords(num_vertices);
+    for (size_t v = 0; v < num_vertices; ++v)
+        coords[v] = mesh_vertices[global[v]].position;
+
+    // Seams (positions split into several vertices) stay in place
+    std::vector<uint32_t> wedges(num_positions, 0);
+    for (size_t v = 0; v < num_vertices; ++v)
+        ++wedges[position[v]];
+    std::vector<char> locked(num_positions, 0);
+    for (size_t p = 0; p < num_positions; ++p)
+        locked[p] = wedges[p] > 1;
+
+    // So do borders: edges between positions with no twin running the other way
+    std::unordered_set<uint64_t> edges;
+    edges.reserve(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i)
+        edges.insert((uint64_t)position[triangles[i]] << 32 | position[triangles[i - i % 3 + (i + 1) % 3]]);
+    for (size_t i = 0; i < triangles.size(); ++i)
+    {
+        uint64_t a = position[triangles[i]], b = position[triangles[i - i % 3 + (i + 1) % 3]];
+        if (edges.find(b << 32 | a) == edges.end())
+            locked[a] = locked[b] = 1;
+    }
+
+    // Planes of the triangles around every position, weighted by area
+    std::vector<Quadric> quadrics(num_positions);
+    for (size_t i = 0; i < triangles.size(); i += 3)
+    {
+        double normal[4];
+        TriangleNormal(coords[triangles[i]], coords[triangles[i + 1]], coords[triangles[i + 2]], normal);
+        double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length == 0.0)
+            continue;
+
+        const float* a = coords[triangles[i]];
+        for (int k = 0; k < 3; ++k)
+            normal[k] /= length;
+        normal[3] = -(normal[0] * a[0] + normal[1] * a[1] + normal[2] * a[2]);
+
+        for (int k = 0; k < 3; ++k)
+            Quadric_AddPlane(&quadrics[position[triangles[i + k]]], normal, 0.5 * length);
+    }
+
+    std::vector<uint32_t> collapse(num_vertices);
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> adjacency(triangles.size());
+    std::vector<Collapse> candidates;
+    std::vector<char>     touched(num_positions);
+    double worst = 0.0;
+
+    while (triangles.size() > target_count)
+    {
+        // Triangles around every vertex
+        offsets.assign(num_vertices + 1, 0);
+        for (size_t i = 0; i < triangles.size(); ++i)
+            ++offsets[triangles[i] + 1];
+        for (size_t v = 0; v < num_vertices; ++v)
+            offsets[v + 1] += offsets[v];
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangles.size(); ++i)
+            adjacency[fill[triangles[i]]++] = (uint32_t)(i / 3);
+
+        // Every edge leaving an unlocked position, costed at the position it lands on
+        candidates.clear();
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            uint32_t from = triangles[i], to = triangles[i - i % 3 + (i + 1) % 3];
+            for (int direction = 0; direction < 2; ++direction, std::swap(from, to))
+            {
+                if (locked[position[from]] || position[from] == position[to])
+                    continue;
+                Quadric merged = quadrics[position[from]];
+                Quadric_Add(&merged, quadrics[position[to]]);
+                Collapse candidate = { from, to, Quadric_Error(merged, coords[to]) };
+                candidates.push_back(candidate);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        // Cheapest collapses first. Each one locks the triangles around it for the rest of the
+        // pass, so the collapses of a pass never see each other's changes.
+        for (size_t v = 0; v < num_vertices; ++v)
+            collapse[v] = (uint32_t)v;
+        std::fill(touched.begin(), touched.end(), 0);
+
+        size_t goal = (triangles.size() - target_count) / 6 + 1; // A collapse removes about two triangles
+        size_t collapsed = 0;
+        for (size_t c = 0; c < candidates.size() && collapsed < goal; ++c)
+        {
+            uint32_t from = candidates[c].from, to = candidates[c].to;
+            if (touched[position[from]] || touched[position[to]])
+                continue;
+
+            // Triangles across the edge vanish; the others must keep facing the same way
+            bool flips = false;
+            for (uint32_t a = offsets[from]; a < offsets[from + 1] && !flips; ++a)
+            {
+                const uint32_t* t = &triangles[3 * adjacency[a]];
+                if (position[t[0]] == position[to] || position[t[1]] == position[to] || position[t[2]] == position[to])
+                    continue;
+                int k = t[0] == from ? 0 : t[1] == from ? 1 : 2;
+                flips = TurnsOver(coords[t[k]], coords[t[(k + 1) % 3]], coords[t[(k + 2) % 3]], coords[to]);
+            }
+            if (flips)
+                continue;
+
+            collapse[from] = to;
+            Quadric_Add(&quadrics[position[to]], quadrics[position[from]]);
+            worst = std::max(worst, candidates[c].cost);
+            for (uint32_t a = offsets[from]; a < offsets[from + 1]; ++a)
+                for (int k = 0; k < 3; ++k)
+                    touched[position[triangles[3 * adjacency[a] + k]]] = 1;
+            ++collapsed;
+        }
+        if (collapsed == 0)
+            break;
+
+        // Apply the pass, dropping the triangles left without area
+        size_t count = 0;
+        for (size_t i = 0; i < triangles.size(); i += 3)
+        {
+            uint32_t a = collapse[triangles[i]], b = collapse[triangles[i + 1]], c = collapse[triangles[i + 2]];
+            if (position[a] == position[b] || position[b] == position[c] || position[c] == position[a])
+                continue;
+            triangles[count++] = a;
+            triangles[count++] = b;
+            triangles[count++] = c;
+        }
+        triangles.resize(count);
+    }
+
+    indices->resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i)
+        (*indices)[i] = global[triangles[i]];
+    return (float)std::sqrt(worst);
+}
+
+// Appends coarser levels of every part
+void Mesh_BuildLODs(Mesh* mesh, size_t max_lods)
+{
+    max_lods = std::min(max_lods, (size_t)MESH_MAX_LODS);
+    size_t num_vertices = mesh->vertices.size();
+
+    SimplifyContext context;
+    context.mesh = mesh;
+    context.position.resize(num_vertices);
+    context.local_vertex.assign(num_vertices, UINT32_MAX);
+    context.local_position.assign(num_vertices, UINT32_MAX);
+
+    // Vertices sharing a position, through an open addressing table as in the welding
+    size_t capacity = 1;
+    while (capacity < num_vertices * 2)
+        capacity <<= 1;
+    std::vector<uint32_t> table(capacity, UINT32_MAX);
+    for (size_t v = 0; v < num_vertices; ++v)
+    {
+        const float* position = mesh->vertices[v].position;
+        size_t slot = HashWords(position, 3) & (capacity - 1);
+        while (table[slot] != UINT32_MAX && memcmp(mesh->vertices[table[slot]].position, position, 3 * sizeof(float)) != 0)
+            slot = (slot + 1) & (capacity - 1);
+        if (table[slot] == UINT32_MAX)
+            table[slot] = (uint32_t)v;
+        context.position[v] = table[slot];
+    }
+
+    std::vector<uint32_t> indices;
+    for (size_t p = 0; p < mesh->parts.size(); ++p)
+    {
+        MeshPart& part = mesh->parts[p];
+        if (part.lods[0].num_indices == 0)
+            continue;
+        indices.assign(mesh->indices.begin() + part.lods[0].first_index,
+                       mesh->indices.begin() + part.lods[0].first_index + part.lods[0].num_indices);
+
+        // Errors are kept relative to the radius of the part bounds
+        float low[3] = { INFINITY, INFINITY, INFINITY }, high[3] = { -INFINITY, -INFINITY, -INFINITY };
+        for (size_t i = 0; i < indices.size(); ++i)
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                low[axis]  = std::min(low[axis], mesh->vertices[indices[i]].position[axis]);
+                high[axis] = std::max(high[axis], mesh->vertices[indices[i]].position[axis]);
+            }
+        float radius = 0.5f * std::sqrt((high[0] - low[0]) * (high[0] - low[0]) + (high[1] - low[1]) * (high[1] - low[1])
+                                      + (high[2] - low[2]) * (high[2] - low[2]));
+
+        // Every level starts from the previous one, so the errors add up
+        float error = 0.0f;
+        for (size_t lod = 1; lod < max_lods; ++lod)
+        {
+            size_t previous = indices.size();
+            error += Simplify(&context, &indices, (part.lods[0].num_indices / 3 >> lod) * 3);
+            if (indices.empty() || indices.size() > previous * (1.0f - MESH_LOD_MIN_REDUCTION))
+                break;
+
+            MeshLOD& level = part.lods[part.num_lods++];
+            level.first_index = (uint32_t)mesh->indices.size();
+            level.num_indices = (uint32_t)indices.size();
+            level.error       = radius > 0.0f ? error / radius : 0.0f;
+            mesh->indices.insert(mesh->indices.end(), indices.begin(), indices.end());
+        }
+    }
+}
+
+// =========================================================================================
+//                                   OPTIMIZATION
+//==========================================================================================
+
+// Tipsify over one index range whose vertices are numbered [0, num_vertices)
+static void Tipsify(uint32_t* indices, size_t num_indices, size_t num_vertices, size_t cache_size)
+{
+    size_t num_triangles = num_indices / 3;
+    if (num_triangles == 0)
+        return;
+
+    // Triangles around every vertex
+    std::vector<uint32_t> offsets(num_vertices + 1, 0);
+    for (size_t i = 0; i < num_indices; ++i)
+        ++offsets[indices[i] + 1];
+    for (size_t v = 0; v < num_vertices; ++v)
+        offsets[v + 1] += offsets[v];
+
+    std::vector<uint32_t> adjacency(num_indices);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < num_indices; ++i)
+        adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+    std::vector<uint32_t> live(num_vertices);
+    for (size_t v = 0; v < num_vertices; ++v)
+        live[v] = offsets[v + 1] - offsets[v];
+
+    std::vector<uint32_t> stamp(num_vertices, 0); // Time each vertex entered the cache
+    std::vector<char>     emitted(num_triangles, 0);
+    std::vector<uint32_t> dead_end;               // Recently used vertices, to restart fans
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(num_indices);
+
+    uint32_t time = (uint32_t)cache_size + 1;
+    size_t   cursor = 0;
+    int64_t  fan = indices[0];
+    while (fan >= 0)
+    {
+        // Emit every triangle left around the fanning vertex
+        candidates.clear();
+        for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; ++a)
+        {
+            uint32_t t = adjacency[a];
+            if (emitted[t])
+                continue;
+            emitted[t] = 1;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t v = indices[3*t + k];
+                output.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - stamp[v] > cache_size)
+                    stamp[v] = time++;
+            }
+        }
+
+        // Next fan: the candidate longest in cache that will still be there once its
+        // remaining triangles are emitted
+        fan = -1;
+        int64_t best = -1;
+        for (size_t c = 0; c < candidates.size(); ++c)
+        {
+            uint32_t v = candidates[c];
+            if (live[v] == 0)
+                continue;
+            int64_t priority = time - stamp[v] + 2 * live[v] <= cache_size ? time - stamp[v] : 0;
+            if (priority > best)
+            {
+                best = priority;
+                fan = v;
+            }
+        }
+
+        // Dead end: the most recent vertex with triangles left, else the next one in order
+        while (fan < 0 && !dead_end.empty())
+        {
+            uint32_t v = dead_end.back();
+            dead_end.pop_back();
+            if (live[v] > 0)
+                fan = v;
+        }
+        for (; fan < 0 && cursor < num_vertices; ++cursor)
+            if (live[cursor] > 0)
+                fan = cursor;
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+// Reorders the triangles of every part and level for post-transform cache hits
+void Mesh_OptimizeVertexCache(Mesh* mesh, size_t cache_size)
+{
+    // Ranges are optimized in a local vertex numbering
+    std::vector<uint32_t> local(mesh->vertices.size(), UINT32_MAX);
+    std::vector<uint32_t> global;
+    std::vector<uint32_t> part_indices;
+
+    for (size_t p = 0; p < mesh->parts.size(); ++p)
+    for (size_t lod = 0; lod < mesh->parts[p].num_lods; ++lod)
+    {
+        size_t num_indices = mesh->parts[p].lods[lod].num_indices;
+        if (num_indices == 0)
+            continue;
+        uint32_t* indices = &mesh->indices[mesh->parts[p].lods[lod].first_index];
+
+        global.clear();
+        part_indices.resize(num_indices);
+        for (size_t i = 0; i < num_indices; ++i)
+        {
+            if (local[indices[i]] == UINT32_MAX)
+            {
+                local[indices[i]] = (uint32_t)global.size();
+                global.push_back(indices[i]);
+            }
+            part_indices[i] = local[indices[i]];
+        }
+
+        Tipsify(part_indices.data(), num_indices, global.size(), cache_size);
+
+        for (size_t i = 0; i < num_indices; ++i)
+            indices[i] = global[part_indices[i]];
+        for (size_t v = 0; v < global.size(); ++v)
+            local[global[v]] = UINT32_MAX;
+    }
+}
+
+// Renumbers vertices in order of first use; unused vertices are dropped
+void Mesh_OptimizeVertexFetch(Mesh* mesh)
+{
+    std::vector<uint32_t> remap(mesh->vertices.size(), UINT32_MAX);
+    std::vector<MeshVertex> vertices;
+    vertices.reserve(mesh->vertices.size());
+
+    for (size_t i = 0; i < mesh->indices.size(); ++i)
+    {
+        uint32_t& index = mesh->indices[i];
+        if (remap[index] == UINT32_MAX)
+        {
+            remap[index] = (uint32_t)vertices.size();
+            vertices.push_back(mesh->vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh->vertices.swap(vertices);
+}
+
+// =========================================================================================
+//                                     PACKING
+//==========================================================================================
+
+// Bounds of the vertex positions
+void Mesh_ComputeBounds(const Mesh& mesh, MeshBounds* bounds)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        bounds->min[i] = mesh.vertices.empty() ? 0.0f : INFINITY;
+        bounds->max[i] = mesh.vertices.empty() ? 0.0f : -INFINITY;
+    }
+    for (size_t v = 0; v < mesh.vertices.size(); ++v)
+        for (int i = 0; i < 3; ++i)
+        {
+            bounds->min[i] = std::min(bounds->min[i], mesh.vertices[v].position[i]);
+            bounds->max[i] = std::max(bounds->max[i], mesh.vertices[v].position[i]);
+        }
+}
+
+// IEEE 754 half precision, rounded to nearest even
+uint16_t Mesh_FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+
+    // NaN stays NaN, overflow and infinity become infinity
+    if (magnitude > 0x7F800000)
+        return (uint16_t)(sign | 0x7E00);
+    if (magnitude >= 0x477FF000)
+        return (uint16_t)(sign | 0x7C00);
+
+    // Subnormal halves: align the mantissa (with its implicit bit) to 2^-24 units
+    if (magnitude < 0x38800000)
+    {
+        int shift = 126 - (int)(magnitude >> 23);
+        if (shift > 24)
+            return (uint16_t)sign;
+        uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            ++half;
+        return (uint16_t)(sign | half);
+    }
+
+    // Normal halves: rebias the exponent, round the 13 dropped mantissa bits
+    uint32_t half = (magnitude - 0x38000000) >> 13;
+    uint32_t rest = magnitude & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        ++half;
+    return (uint16_t)(sign | half);
+}
+
+// Signed normalized 10 bit value
+static uint32_t PackSnorm10(float value)
+{
+    int32_t packed = (int32_t)std::floor(std::max(-1.0f, std::min(1.0f, value)) * 511.0f + 0.5f);
+    return (uint32_t)packed & 0x3FF;
+}
+
+// Quantizes the vertices into the interleaved GPU format
+void Mesh_Pack(const Mesh& mesh, const MeshBounds& bounds, std::vector<PackedVertex>* packed)
+{
+    float scale[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        float extent = bounds.max[i] - bounds.min[i];
+        scale[i] = extent > 0.0f ? 65535.0f / extent : 0.0f;
+    }
+
+    packed->resize(mesh.vertices.size());
+    for (size_t v = 0; v < mesh.vertices.size(); ++v)
+    {
+        const MeshVertex& vertex = mesh.vertices[v];
+        PackedVertex& out = (*packed)[v];
+
+        for (int i = 0; i < 3; ++i)
+        {
+            float q = (vertex.position[i] - bounds.min[i]) * scale[i] + 0.5f;
+            out.position[i] = (uint16_t)std::max(0.0f, std::min(65535.0f, q));
+        }
+        out.padding = 0;
+
+        out.normal = PackSnorm10(vertex.normal[0]) | PackSnorm10(vertex.normal[1]) << 10 | PackSnorm10(vertex.normal[2]) << 20;
+
+        out.texcoord[0] = Mesh_FloatToHalf(vertex.texcoord[0]);
+        out.texcoord[1] = Mesh_FloatToHalf(vertex.texcoord[1]);
+    }
+}
+
+// Average cache miss ratio of a FIFO cache
+float Mesh_ACMR(const std::vector<uint32_t>& indices, size_t num_vertices, size_t cache_size)
+{
+    if (indices.size() < 3)
+        return 0.0f;
+
+    // A vertex is in the cache while fewer than cache_size misses followed its own
+    std::vector<uint32_t> entered(num_vertices, 0);
+    uint32_t misses = 0;
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        uint32_t& at = entered[indices[i]];
+        if (at == 0 || misses - at >= cache_size)
+            at = ++misses;
+    }
+    return (float)misses / (indices.size() / 3);
+}
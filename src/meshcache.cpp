@@ -0,0 +1,243 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <sys/stat.h>
+
+#include "meshcache.h"
+
+// =========================================================================================
+//                                      LAYOUT
+//==========================================================================================
+
+static size_t AlignSection(size_t offset)
+{
+    return (offset + 63) & ~(size_t)63;
+}
+
+// Section offsets of a cache with the given header
+struct CacheLayout
+{
+    size_t strings, parts, vertices, indices, size;
+
+    CacheLayout(const MeshCacheHeader& header)
+    {
+        strings  = AlignSection(sizeof(MeshCacheHeader));
+        parts    = AlignSection(strings + header.strings_size);
+        vertices = AlignSection(parts + (size_t)header.num_parts * sizeof(MeshCachePart));
+        indices  = AlignSection(vertices + (size_t)header.num_vertices * sizeof(PackedVertex));
+        size     = indices + (size_t)header.num_indices * sizeof(uint32_t);
+    }
+};
+
+// Content hash of a file, a word at a time (FNV-1a style with an extra shift for the high bits)
+static uint64_t HashBytes(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; ++i)
+        hash = (hash ^ (uint8_t)data[i]) * 1099511628211ull;
+    return hash ^ (hash >> 29);
+}
+
+static bool HashFile(const char* filename, uint64_t* hash)
+{
+    MappedFile file;
+    if (!file.Open(filename))
+        return false;
+    *hash = HashBytes(file.data, file.size);
+    return true;
+}
+
+std::string MeshCache_Filename(const char* source)
+{
+    return std::string(source) + MESH_CACHE_EXTENSION;
+}
+
+// =========================================================================================
+//                                      WRITING
+//==========================================================================================
+
+static void WriteSection(FILE* out, size_t offset, const void* data, size_t size)
+{
+    fseek(out, (long)offset, SEEK_SET);
+    if (size > 0)
+        fwrite(data, 1, size, out);
+}
+
+// Writes the cache of a source file
+bool MeshCache_Write(const char* filename, const char* source, const PackedMesh& mesh)
+{
+    struct stat source_stat;
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    if (stat(source, &source_stat) != 0 || !HashFile(source, &header.source_hash))
+        return false;
+
+    std::string strings = source;
+    std::vector<MeshCachePart> parts(mesh.parts.size());
+    for (size_t p = 0; p < parts.size(); ++p)
+    {
+        parts[p].name_offset = (uint32_t)strings.size();
+        parts[p].name_length = (uint32_t)mesh.parts[p].name.size();
+        parts[p].num_lods    = mesh.parts[p].num_lods;
+        memcpy(parts[p].lods, mesh.parts[p].lods, sizeof(parts[p].lods));
+        strings += mesh.parts[p].name;
+    }
+
+    header.magic         = MESH_CACHE_MAGIC;
+    header.version       = MESH_CACHE_VERSION;
+    header.vertex_size   = sizeof(PackedVertex);
+    header.flags         = (mesh.has_normals ? MESH_CACHE_NORMALS : 0) | (mesh.has_texcoords ? MESH_CACHE_TEXCOORDS : 0);
+    header.source_size   = source_stat.st_size;
+    header.source_mtime  = source_stat.st_mtime;
+    header.bounds        = mesh.bounds;
+    header.num_vertices  = (uint32_t)mesh.num_vertices;
+    header.num_indices   = (uint32_t)mesh.num_indices;
+    header.num_parts     = (uint32_t)parts.size();
+    header.strings_size  = (uint32_t)strings.size();
+    header.source_length = (uint32_t)strlen(source);
+
+    // Written aside and renamed, so a crash never leaves a truncated cache behind
+    std::string temporary = std::string(filename) + ".tmp";
+    FILE* out = fopen(temporary.c_str(), "wb");
+    if (!out)
+    {
+        fprintf(stderr, "ERROR: Cannot write mesh cache \"%s\".\n", temporary.c_str());
+        return false;
+    }
+
+    CacheLayout layout(header);
+    WriteSection(out, 0, &header, sizeof(header));
+    WriteSection(out, layout.strings, strings.data(), strings.size());
+    WriteSection(out, layout.parts, parts.data(), parts.size() * sizeof(MeshCachePart));
+    WriteSection(out, layout.vertices, mesh.vertices, mesh.num_vertices * sizeof(PackedVertex));
+    WriteSection(out, layout.indices, mesh.indices, mesh.num_indices * sizeof(uint32_t));
+
+    bool ok = !ferror(out);
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), filename) != 0)
+    {
+        fprintf(stderr, "ERROR: Cannot write mesh cache \"%s\".\n", filename);
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// =========================================================================================
+//                                      LOOKUP
+//==========================================================================================
+
+// Brings the recorded mtime up to date once a touched source proved unchanged, so later
+// launches skip hashing it again. The mapped cache is copied aside and renamed over, so
+// the mapping in use is never modified.
+static void UpdateMtime(const char* filename, const MappedFile& file, int64_t mtime)
+{
+    MeshCacheHeader header;
+    memcpy(&header, file.data, sizeof(header));
+    header.source_mtime = mtime;
+
+    std::string temporary = std::string(filename) + ".tmp";
+    FILE* out = fopen(temporary.c_str(), "wb");
+    if (!out)
+        return;
+    WriteSection(out, 0, &header, sizeof(header));
+    WriteSection(out, sizeof(header), file.data + sizeof(header), file.size - sizeof(header));
+
+    bool ok = !ferror(out);
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), filename) != 0)
+        remove(temporary.c_str());
+}
+
+// Every index must name a vertex, they are drawn and rasterized without further checks
+static bool ValidIndices(const uint32_t* indices, size_t num_indices, uint32_t num_vertices)
+{
+    uint32_t highest = 0;
+    for (size_t i = 0; i < num_indices; ++i)
+        highest = std::max(highest, indices[i]);
+    return num_indices == 0 || highest < num_vertices;
+}
+
+// Maps the cache of a source file, checking its header, size and source
+bool MeshCache::Open(const char* filename, const char* source)
+{
+    Close();
+
+    struct stat source_stat;
+    if (stat(source, &source_stat) != 0 || !file.Open(filename))
+        return false;
+
+    const MeshCacheHeader* h = (const MeshCacheHeader*)file.data;
+    size_t source_length = strlen(source);
+    if (file.size < sizeof(MeshCacheHeader) || h->magic != MESH_CACHE_MAGIC || h->version != MESH_CACHE_VERSION
+        || h->vertex_size != sizeof(PackedVertex) || h->source_length > h->strings_size || file.size < CacheLayout(*h).size)
+    {
+        file.Close();
+        return false;
+    }
+
+    // Keyed by path, then by mtime, then by content
+    CacheLayout layout(*h);
+    const char* strings = file.data + layout.strings;
+    bool valid = h->source_length == source_length && memcmp(strings, source, source_length) == 0
+              && h->source_size == (uint64_t)source_stat.st_size;
+    bool touched = valid && h->source_mtime != (int64_t)source_stat.st_mtime;
+    if (touched)
+    {
+        uint64_t hash;
+        valid = HashFile(source, &hash) && hash == h->source_hash;
+    }
+
+    const MeshCachePart* parts = (const MeshCachePart*)(file.data + layout.parts);
+    for (uint32_t p = 0; p < h->num_parts && valid; ++p)
+    {
+        valid = parts[p].name_offset + (size_t)parts[p].name_length <= h->strings_size
+             && parts[p].num_lods >= 1 && parts[p].num_lods <= MESH_MAX_LODS;
+        for (uint32_t lod = 0; lod < parts[p].num_lods && valid; ++lod)
+            valid = parts[p].lods[lod].first_index + (size_t)parts[p].lods[lod].num_indices <= h->num_indices;
+    }
+    valid = valid && ValidIndices((const uint32_t*)(file.data + layout.indices), h->num_indices, h->num_vertices);
+
+    if (!valid)
+    {
+        file.Close();
+        return false;
+    }
+    if (touched)
+        UpdateMtime(filename, file, source_stat.st_mtime);
+
+    printf("Loading Mesh Cache \"%s\"... ", filename);
+
+    mesh.bounds        = h->bounds;
+    mesh.has_normals   = (h->flags & MESH_CACHE_NORMALS) != 0;
+    mesh.has_texcoords = (h->flags & MESH_CACHE_TEXCOORDS) != 0;
+    mesh.vertices      = (const PackedVertex*)(file.data + layout.vertices);
+    mesh.num_vertices  = h->num_vertices;
+    mesh.indices       = (const uint32_t*)(file.data + layout.indices);
+    mesh.num_indices   = h->num_indices;
+
+    mesh.parts.resize(h->num_parts);
+    for (uint32_t p = 0; p < h->num_parts; ++p)
+    {
+        mesh.parts[p].name.assign(strings + parts[p].name_offset, parts[p].name_length);
+        mesh.parts[p].num_lods = parts[p].num_lods;
+        memcpy(mesh.parts[p].lods, parts[p].lods, sizeof(parts[p].lods));
+    }
+
+    printf("OK. (%u vertices, %u indices)\n", h->num_vertices, h->num_indices);
+    return true;
+}
+
+void MeshCache::Close()
+{
+    file.Close();
+    mesh = PackedMesh();
+}
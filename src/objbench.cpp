@@ -0,0 +1,150 @@
+// OBJ loading throughput: tinyobj::LoadObj against the parallel loader.
+//
+// Loads the file with both parsers (best of a few runs each), prints their throughput and
+// checks that they produced the same attributes and shapes.
+//
+//   objbench [--runs N] [--threads N] file.obj
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <sys/stat.h>
+
+#include "objloader.h"
+
+struct ObjResult
+{
+    tinyobj::attrib_t                attrib;
+    std::vector<tinyobj::shape_t>    shapes;
+    std::vector<tinyobj::material_t> materials;
+};
+
+// Distance in units in the last place between two floats of the same sign
+static uint32_t UlpDistance(float a, float b)
+{
+    int32_t ia, ib;
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+    if ((ia < 0) != (ib < 0))
+        return a == b ? 0 : UINT32_MAX;
+    return (uint32_t)std::abs(ia - ib);
+}
+
+static uint32_t MaxUlpDistance(const std::vector<float>& a, const std::vector<float>& b)
+{
+    uint32_t worst = 0;
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i)
+        worst = std::max(worst, UlpDistance(a[i], b[i]));
+    return worst;
+}
+
+static bool SameIndices(const std::vector<tinyobj::index_t>& a, const std::vector<tinyobj::index_t>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (a[i].vertex_index != b[i].vertex_index || a[i].normal_index != b[i].normal_index || a[i].texcoord_index != b[i].texcoord_index)
+            return false;
+    return true;
+}
+
+// Compares the results, printing the first difference
+static bool Compare(const ObjResult& expected, const ObjResult& result)
+{
+    const tinyobj::attrib_t& a = expected.attrib;
+    const tinyobj::attrib_t& b = result.attrib;
+    if (a.vertices.size() != b.vertices.size() || a.normals.size() != b.normals.size() || a.texcoords.size() != b.texcoords.size())
+        return printf("attribute counts differ\n"), false;
+
+    // Both parsers round differently (tinyobj sums digit by digit); values must stay within an ulp or two
+    uint32_t ulps = std::max(MaxUlpDistance(a.vertices, b.vertices),
+                    std::max(MaxUlpDistance(a.normals, b.normals), MaxUlpDistance(a.texcoords, b.texcoords)));
+    printf("attributes: %u vertices, %u normals, %u texcoords, max difference %u ulp\n", (unsigned)a.vertices.size() / 3,
+           (unsigned)a.normals.size() / 3, (unsigned)a.texcoords.size() / 2, ulps);
+    if (ulps > 2)
+        return false;
+
+    if (expected.shapes.size() != result.shapes.size())
+        return printf("shape counts differ (%u, %u)\n", (unsigned)expected.shapes.size(), (unsigned)result.shapes.size()), false;
+
+    for (size_t s = 0; s < expected.shapes.size(); ++s)
+    {
+        const tinyobj::shape_t& x = expected.shapes[s];
+        const tinyobj::shape_t& y = result.shapes[s];
+        if (x.name != y.name || !SameIndices(x.mesh.indices, y.mesh.indices) || x.mesh.num_face_vertices != y.mesh.num_face_vertices
+            || x.mesh.material_ids != y.mesh.material_ids)
+            return printf("shape %u (\"%s\") differs\n", (unsigned)s, x.name.c_str()), false;
+    }
+    printf("shapes: %u, identical\n", (unsigned)expected.shapes.size());
+
+    if (expected.materials.size() != result.materials.size())
+        return printf("material counts differ\n"), false;
+    return true;
+}
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: objbench [--runs N] [--threads N] file.obj\n");
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int num_threads = 0;
+    size_t runs = 3;
+    const char* filename = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--runs" && has_value)
+            runs = std::max(1ul, strtoul(argv[++i], NULL, 10));
+        else if (arg == "--threads" && has_value)
+            num_threads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (arg.compare(0, 2, "--") == 0 || filename)
+            return PrintUsage(), EXIT_FAILURE;
+        else
+            filename = argv[i];
+    }
+
+    struct stat st;
+    if (!filename || stat(filename, &st) != 0)
+        return PrintUsage(), EXIT_FAILURE;
+    double megabytes = st.st_size / (1024.0*1024.0);
+
+    ThreadPool pool(num_threads);
+    ObjResult expected, result;
+    double tinyobj_seconds = 1e30, parallel_seconds = 1e30;
+
+    for (size_t run = 0; run < runs; ++run)
+    {
+        // Neither parser clears the materials
+        expected.materials.clear();
+        result.materials.clear();
+
+        std::string err;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!tinyobj::LoadObj(&expected.attrib, &expected.shapes, &expected.materials, &err, filename))
+            return fprintf(stderr, "ERROR: %s", err.c_str()), EXIT_FAILURE;
+        std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+        if (!Obj_LoadParallel(filename, &result.attrib, &result.shapes, &result.materials, &err, NULL, true, pool))
+            return fprintf(stderr, "ERROR: %s", err.c_str()), EXIT_FAILURE;
+        std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+
+        tinyobj_seconds  = std::min(tinyobj_seconds, std::chrono::duration<double>(middle - start).count());
+        parallel_seconds = std::min(parallel_seconds, std::chrono::duration<double>(stop - middle).count());
+    }
+
+    printf("file: \"%s\", %.1f MB, best of %u runs\n", filename, megabytes, (unsigned)runs);
+    printf("%-10s %10s %10s\n", "parser", "ms", "MB/s");
+    printf("%-10s %10.1f %10.1f\n", "tinyobj", tinyobj_seconds * 1e3, megabytes / tinyobj_seconds);
+    printf("%-10s %10.1f %10.1f  (%u threads, %.1fx)\n", "parallel", parallel_seconds * 1e3, megabytes / parallel_seconds,
+           pool.Size(), tinyobj_seconds / parallel_seconds);
+    printf("\n");
+
+    return Compare(expected, result) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,354 @@
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <atomic>
+#include <algorithm>
+
+#include "objloader.h"
+#include "mappedfile.h"
+#include "parseutils.h"
+
+// Tokens of one chunk of lines. Indices are resolved against the chunk's own attribute
+// counts; relative (negative) ones are listed, to be rebased once earlier chunks are known.
+struct ObjChunk
+{
+    // Statements that change the shape or material, after the first 'faces' faces of the chunk
+    struct Command
+    {
+        enum Type { OBJECT, MATERIAL, MATERIAL_LIBRARY } type;
+        size_t      faces;
+        std::string name;
+    };
+
+    std::vector<float>            vertices;
+    std::vector<float>            normals;
+    std::vector<float>            texcoords;
+    std::vector<tinyobj::index_t> corners;
+    std::vector<uint32_t>         face_sizes;
+    std::vector<size_t>           relative; // corner * 3 + component (0 vertex, 1 normal, 2 texcoord)
+    std::vector<Command>          commands;
+};
+
+// =========================================================================================
+//                                     TOKENIZING
+//==========================================================================================
+
+static bool IsSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Coordinate of a 'v', 'vn' or 'vt' line, read as tinyobj reads it: 0 when missing, when no
+// digit follows the sign (".5", "nan", "inf") or when the exponent is empty, and anything
+// after the number up to the next separator is ignored
+static float ParseCoordinate(const char*& p, const char* end)
+{
+    Parse_SkipSpaces(p, end);
+    const char* token_end = p;
+    while (token_end < end && !IsSeparator(*token_end))
+        ++token_end;
+
+    const char* digit = p < token_end && (*p == '-' || *p == '+') ? p + 1 : p;
+    float value;
+    if (!(digit < token_end && *digit >= '0' && *digit <= '9') || !Parse_Float(p, token_end, &value)
+        || (p < token_end && (*p == 'e' || *p == 'E')))
+        value = 0.0f;
+
+    p = token_end;
+    return value;
+}
+
+// One index of a face corner, up to the next '/' or separator
+static int ParseIndex(const char*& p, const char* end)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    int value = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        value = value*10 + (*p++ - '0');
+
+    while (p < end && *p != '/' && !IsSeparator(*p))
+        ++p;
+    return negative ? -value : value;
+}
+
+// Zero based index of a corner component (1 based or relative in the file)
+static int ResolveIndex(int index, size_t count, size_t slot, ObjChunk* chunk)
+{
+    if (index > 0)
+        return index - 1;
+    if (index == 0)
+        return 0;
+
+    chunk->relative.push_back(slot);
+    return (int)count + index;
+}
+
+// First word after a statement keyword
+static std::string ParseName(const char* p, const char* end)
+{
+    Parse_SkipSpaces(p, end);
+    const char* start = p;
+    while (p < end && !IsSeparator(*p))
+        ++p;
+    return std::string(start, p);
+}
+
+static void AddCommand(ObjChunk* chunk, ObjChunk::Command::Type type, const char* p, const char* end)
+{
+    ObjChunk::Command command;
+    command.type  = type;
+    command.faces = chunk->face_sizes.size();
+    command.name  = ParseName(p, end);
+    chunk->commands.push_back(command);
+}
+
+// Tokenizes the lines of [p, end)
+static void ParseChunk(const char* p, const char* end, ObjChunk* chunk)
+{
+    while (p < end)
+    {
+        const char* line_end = Parse_LineEnd(p, end);
+        Parse_SkipSpaces(p, line_end);
+
+        if (p + 1 < line_end && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            p += 2;
+            for (int i = 0; i < 3; ++i)
+                chunk->vertices.push_back(ParseCoordinate(p, line_end));
+        }
+        else if (p + 2 < line_end && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            p += 3;
+            for (int i = 0; i < 3; ++i)
+                chunk->normals.push_back(ParseCoordinate(p, line_end));
+        }
+        else if (p + 2 < line_end && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            p += 3;
+            for (int i = 0; i < 2; ++i)
+                chunk->texcoords.push_back(ParseCoordinate(p, line_end));
+        }
+        else if (p + 1 < line_end && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            p += 2;
+            Parse_SkipSpaces(p, line_end);
+
+            uint32_t size = 0;
+            while (p < line_end)
+            {
+                size_t slot = chunk->corners.size() * 3;
+                tinyobj::index_t corner = { -1, -1, -1 };
+                corner.vertex_index = ResolveIndex(ParseIndex(p, line_end), chunk->vertices.size() / 3, slot + 0, chunk);
+
+                // i, i/j, i//k or i/j/k
+                if (p < line_end && *p == '/')
+                {
+                    ++p;
+                    if (p < line_end && *p != '/')
+                        corner.texcoord_index = ResolveIndex(ParseIndex(p, line_end), chunk->texcoords.size() / 2, slot + 2, chunk);
+                    if (p < line_end && *p == '/')
+                    {
+                        ++p;
+                        corner.normal_index = ResolveIndex(ParseIndex(p, line_end), chunk->normals.size() / 3, slot + 1, chunk);
+                    }
+                }
+
+                chunk->corners.push_back(corner);
+                ++size;
+
+                while (p < line_end && (*p == ' ' || *p == '\t' || *p == '\r'))
+                    ++p;
+            }
+            chunk->face_sizes.push_back(size);
+        }
+        else if (Parse_IsToken(p, line_end, "usemtl", 6))
+            AddCommand(chunk, ObjChunk::Command::MATERIAL, p + 6, line_end);
+        else if (Parse_IsToken(p, line_end, "mtllib", 6))
+            AddCommand(chunk, ObjChunk::Command::MATERIAL_LIBRARY, p + 6, line_end);
+        else if (p + 1 < line_end && (p[0] == 'o' || p[0] == 'g') && (p[1] == ' ' || p[1] == '\t'))
+            AddCommand(chunk, ObjChunk::Command::OBJECT, p + 2, line_end);
+
+        // Comments and unknown statements are skipped
+        Parse_SkipLine(p, end);
+    }
+}
+
+// =========================================================================================
+//                                      MERGING
+//==========================================================================================
+
+// Appends faces [face, until) of a chunk to the shape
+static void AddFaces(const ObjChunk& chunk, size_t* face, size_t* corner, size_t until, int material, bool triangulate,
+                     tinyobj::shape_t* shape)
+{
+    tinyobj::mesh_t& mesh = shape->mesh;
+    for (; *face < until; ++*face)
+    {
+        uint32_t size = chunk.face_sizes[*face];
+        const tinyobj::index_t* f = &chunk.corners[*corner];
+        *corner += size;
+
+        if (triangulate)
+        {
+            // Polygon -> triangle fan
+            for (uint32_t k = 2; k < size; ++k)
+            {
+                mesh.indices.push_back(f[0]);
+                mesh.indices.push_back(f[k - 1]);
+                mesh.indices.push_back(f[k]);
+                mesh.num_face_vertices.push_back(3);
+                mesh.material_ids.push_back(material);
+            }
+        }
+        else
+        {
+            mesh.indices.insert(mesh.indices.end(), f, f + size);
+            mesh.num_face_vertices.push_back((unsigned char)size);
+            mesh.material_ids.push_back(material);
+        }
+    }
+}
+
+// Loads an OBJ file like tinyobj::LoadObj, parsing in parallel
+bool Obj_LoadParallel(const char* filename, tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                      std::vector<tinyobj::material_t>* materials, std::string* err, const char* mtl_basepath,
+                      bool triangulate, ThreadPool& pool)
+{
+    attrib->vertices.clear();
+    attrib->normals.clear();
+    attrib->texcoords.clear();
+    shapes->clear();
+
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        if (err)
+            *err = std::string("Cannot open file [") + filename + "]\n";
+        return false;
+    }
+
+    // Chunks end on line boundaries; a few per worker keep the pool balanced
+    size_t num_chunks = std::max((size_t)1, std::min(file.size / OBJ_MIN_CHUNK_SIZE, (size_t)pool.Size() * 4));
+    std::vector<size_t> bounds(num_chunks + 1, file.size);
+    bounds[0] = 0;
+    for (size_t c = 1; c < num_chunks; ++c)
+    {
+        const char* p = file.data + std::max(bounds[c - 1], file.size * c / num_chunks);
+        Parse_SkipLine(p, file.data + file.size);
+        bounds[c] = p - file.data;
+    }
+
+    std::vector<ObjChunk> chunks(num_chunks);
+    ParallelFor(pool, num_chunks, [&](size_t begin, size_t end)
+    {
+        for (size_t c = begin; c < end; ++c)
+            ParseChunk(file.data + bounds[c], file.data + bounds[c + 1], &chunks[c]);
+    });
+
+    // Attribute offsets of every chunk
+    std::vector<size_t> vertex_base(num_chunks + 1, 0), normal_base(num_chunks + 1, 0), texcoord_base(num_chunks + 1, 0);
+    for (size_t c = 0; c < num_chunks; ++c)
+    {
+        vertex_base[c + 1]   = vertex_base[c]   + chunks[c].vertices.size();
+        normal_base[c + 1]   = normal_base[c]   + chunks[c].normals.size();
+        texcoord_base[c + 1] = texcoord_base[c] + chunks[c].texcoords.size();
+    }
+    attrib->vertices.resize(vertex_base[num_chunks]);
+    attrib->normals.resize(normal_base[num_chunks]);
+    attrib->texcoords.resize(texcoord_base[num_chunks]);
+
+    // Copy the attributes into place and rebase the indices of every chunk
+    int num_vertices  = (int)(vertex_base[num_chunks] / 3);
+    int num_normals   = (int)(normal_base[num_chunks] / 3);
+    int num_texcoords = (int)(texcoord_base[num_chunks] / 2);
+    std::atomic<bool> bad_index(false);
+    ParallelFor(pool, num_chunks, [&](size_t begin, size_t end)
+    {
+        for (size_t c = begin; c < end; ++c)
+        {
+            ObjChunk& chunk = chunks[c];
+            std::copy(chunk.vertices.begin(), chunk.vertices.end(), attrib->vertices.begin() + vertex_base[c]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), attrib->normals.begin() + normal_base[c]);
+            std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib->texcoords.begin() + texcoord_base[c]);
+
+            int base[3] = { (int)(vertex_base[c] / 3), (int)(normal_base[c] / 3), (int)(texcoord_base[c] / 2) };
+            for (size_t i = 0; i < chunk.relative.size(); ++i)
+            {
+                tinyobj::index_t& corner = chunk.corners[chunk.relative[i] / 3];
+                int* index[3] = { &corner.vertex_index, &corner.normal_index, &corner.texcoord_index };
+                *index[chunk.relative[i] % 3] += base[chunk.relative[i] % 3];
+            }
+
+            for (size_t i = 0; i < chunk.corners.size(); ++i)
+            {
+                const tinyobj::index_t& corner = chunk.corners[i];
+                if (corner.vertex_index < 0 || corner.vertex_index >= num_vertices || corner.normal_index < -1
+                    || corner.normal_index >= num_normals || corner.texcoord_index < -1 || corner.texcoord_index >= num_texcoords)
+                    bad_index = true;
+            }
+        }
+    });
+
+    if (bad_index)
+    {
+        if (err)
+            *err = std::string("Index out of range in [") + filename + "]\n";
+        return false;
+    }
+
+    // Shapes and materials follow the statements in file order
+    tinyobj::MaterialFileReader material_reader(mtl_basepath ? mtl_basepath : "");
+    std::map<std::string, int> material_map;
+    int material = -1;
+
+    tinyobj::shape_t shape;
+    for (size_t c = 0; c < num_chunks; ++c)
+    {
+        const ObjChunk& chunk = chunks[c];
+        size_t face = 0, corner = 0;
+
+        for (size_t i = 0; i < chunk.commands.size(); ++i)
+        {
+            const ObjChunk::Command& command = chunk.commands[i];
+            AddFaces(chunk, &face, &corner, command.faces, material, triangulate, &shape);
+
+            if (command.type == ObjChunk::Command::OBJECT)
+            {
+                if (!shape.mesh.num_face_vertices.empty())
+                {
+                    shapes->push_back(tinyobj::shape_t());
+                    std::swap(shapes->back(), shape);
+                }
+                shape = tinyobj::shape_t();
+                shape.name = command.name;
+            }
+            else if (command.type == ObjChunk::Command::MATERIAL)
+            {
+                std::map<std::string, int>::const_iterator found = material_map.find(command.name);
+                material = found != material_map.end() ? found->second : -1;
+            }
+            else
+            {
+                std::string err_mtl;
+                bool ok = material_reader(command.name, materials, &material_map, &err_mtl);
+                if (err)
+                    *err += err_mtl;
+                if (!ok)
+                    return false;
+            }
+        }
+
+        AddFaces(chunk, &face, &corner, chunk.face_sizes.size(), material, triangulate, &shape);
+    }
+
+    if (!shape.mesh.num_face_vertices.empty())
+    {
+        shapes->push_back(tinyobj::shape_t());
+        std::swap(shapes->back(), shape);
+    }
+
+    return true;
+}
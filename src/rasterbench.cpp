@@ -0,0 +1,215 @@
+// Software rasterizer scaling: renders a grid of spinning instances of an OBJ model with
+// pools of 1, 2, 4, ... threads, and prints their frame times against one thread. Every
+// thread count must produce the same image.
+//
+//   rasterbench [--size WxH] [--frames N] [--instances N] [--threads N] [--output file.ppm] file.obj
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include "mesh.h"
+#include "objloader.h"
+#include "softraster.h"
+
+// Spinning grid of instances around the origin, seen from the front
+struct BenchScene
+{
+    const SoftRasterMesh* mesh;
+    uint32_t              num_indices;
+    glm::vec3             center;
+    float                 radius;
+    size_t                instances;
+};
+
+// Renders frame number frame of the scene
+static void RenderFrame(SoftRasterizer& raster, const BenchScene& scene, size_t frame)
+{
+    size_t columns = (size_t)std::ceil(std::sqrt((double)scene.instances));
+    size_t rows = (scene.instances + columns - 1) / columns;
+    float spacing = 2.2f * scene.radius;
+    float half_extent = 0.5f * spacing * std::max(columns, rows);
+
+    // 60 degree vertical field of view, as the viewer
+    float aspect = (float)raster.Width() / raster.Height();
+    float distance = half_extent / std::tan((float)M_PI / 6.0f) * std::max(1.0f, 1.0f / aspect) + scene.radius;
+
+    SoftRasterFrame constants;
+    constants.camera_position = glm::vec4(0.0f, 0.0f, distance, 1.0f);
+    constants.view = glm::lookAt(glm::vec3(constants.camera_position), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    constants.projection = glm::perspective((float)M_PI / 3.0f, aspect, 0.1f, 2.0f * distance + scene.radius);
+    constants.light_direction = glm::normalize(glm::vec4(1.0f, 1.0f, 0.5f, 0.0f));
+
+    raster.Begin(constants, glm::vec3(1.0f));
+    for (size_t i = 0; i < scene.instances; ++i)
+    {
+        glm::vec3 position(((float)(i % columns) - 0.5f * (columns - 1)) * spacing, ((float)(i / columns) - 0.5f * (rows - 1)) * spacing, 0.0f);
+        float angle = 0.05f * frame + 0.7f * i;
+
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+        model = glm::rotate(model, angle, glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::rotate(model, 0.5f * angle, glm::vec3(1.0f, 0.0f, 0.0f));
+        model = glm::translate(model, -scene.center);
+
+        raster.Draw(scene.mesh, 0, scene.num_indices, model, glm::mat3(glm::inverseTranspose(model)), 1);
+    }
+    raster.End();
+}
+
+// FNV-1a hash of the visible pixels
+static uint64_t ImageHash(const SoftRasterizer& raster)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (int y = 0; y < raster.Height(); ++y)
+    {
+        const unsigned char* row = (const unsigned char*)(raster.Pixels() + (size_t)y * raster.Stride());
+        for (size_t i = 0; i < (size_t)raster.Width() * 4; ++i)
+            hash = (hash ^ row[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Binary PPM, top row first
+static bool WritePPM(const char* filename, const SoftRasterizer& raster)
+{
+    FILE* out = fopen(filename, "wb");
+    if (!out)
+        return false;
+
+    fprintf(out, "P6\n%d %d\n255\n", raster.Width(), raster.Height());
+    std::vector<unsigned char> row(raster.Width() * 3);
+    for (int y = raster.Height() - 1; y >= 0; --y)
+    {
+        const uint32_t* pixels = raster.Pixels() + (size_t)y * raster.Stride();
+        for (int x = 0; x < raster.Width(); ++x)
+            for (int c = 0; c < 3; ++c)
+                row[3*x + c] = (unsigned char)(pixels[x] >> (8 * c));
+        fwrite(row.data(), 1, row.size(), out);
+    }
+    return fclose(out) == 0;
+}
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: rasterbench [--size WxH] [--frames N] [--instances N] [--threads N] [--output file.ppm] file.obj\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int width = 1920, height = 1080;
+    size_t frames = 20, instances = 16;
+    unsigned int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    const char* output = NULL;
+    const char* filename = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--size" && has_value && sscanf(argv[i + 1], "%dx%d", &width, &height) == 2)
+            ++i;
+        else if (arg == "--frames" && has_value)
+            frames = std::max(1ul, strtoul(argv[++i], NULL, 10));
+        else if (arg == "--instances" && has_value)
+            instances = std::max(1ul, strtoul(argv[++i], NULL, 10));
+        else if (arg == "--threads" && has_value)
+            max_threads = std::max(1ul, strtoul(argv[++i], NULL, 10));
+        else if (arg == "--output" && has_value)
+            output = argv[++i];
+        else if (arg.compare(0, 2, "--") == 0 || filename)
+            return PrintUsage(), EXIT_FAILURE;
+        else
+            filename = argv[i];
+    }
+    if (!filename)
+        return PrintUsage(), EXIT_FAILURE;
+
+    // The model as the viewer builds it (full detail only)
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    if (!Obj_LoadParallel(filename, &attrib, &shapes, &materials, &err))
+        return fprintf(stderr, "ERROR: %s", err.c_str()), EXIT_FAILURE;
+
+    Mesh mesh;
+    Mesh_Build(attrib, shapes, &mesh);
+    if (!mesh.has_normals)
+        return fprintf(stderr, "ERROR: \"%s\" has no normals.\n", filename), EXIT_FAILURE;
+    Mesh_OptimizeVertexCache(&mesh);
+    Mesh_OptimizeVertexFetch(&mesh);
+
+    MeshBounds bounds;
+    Mesh_ComputeBounds(mesh, &bounds);
+    SoftRasterMesh soft_mesh;
+    Mesh_Pack(mesh, bounds, &soft_mesh.vertices);
+    soft_mesh.indices = mesh.indices;
+    soft_mesh.position_offset = glm::vec3(bounds.min[0], bounds.min[1], bounds.min[2]);
+    soft_mesh.position_scale  = glm::vec3(bounds.max[0], bounds.max[1], bounds.max[2]) - soft_mesh.position_offset;
+
+    BenchScene scene;
+    scene.mesh        = &soft_mesh;
+    scene.num_indices = (uint32_t)soft_mesh.indices.size();
+    scene.center      = soft_mesh.position_offset + 0.5f * soft_mesh.position_scale;
+    scene.radius      = 0.5f * glm::length(soft_mesh.position_scale);
+    scene.instances   = instances;
+
+    printf("model: \"%s\", %u triangles, %u instances, %dx%d, %u frames\n", filename, scene.num_indices / 3,
+           (unsigned)instances, width, height, (unsigned)frames);
+    printf("%8s %10s %10s %9s %11s\n", "threads", "ms/frame", "fps", "speedup", "efficiency");
+
+    // 1, 2, 4, ... threads, and the maximum
+    std::vector<unsigned int> thread_counts;
+    for (unsigned int n = 1; n < max_threads; n *= 2)
+        thread_counts.push_back(n);
+    thread_counts.push_back(max_threads);
+
+    double single_ms = 0.0;
+    uint64_t expected_hash = 0;
+    bool identical = true;
+    SoftRasterStats stats = { 0, 0, 0, 0, 0 };
+    for (size_t t = 0; t < thread_counts.size(); ++t)
+    {
+        ThreadPool pool(thread_counts[t]);
+        SoftRasterizer raster(pool);
+        if (!raster.Resize(width, height))
+            return fprintf(stderr, "ERROR: Bad framebuffer size %dx%d.\n", width, height), EXIT_FAILURE;
+
+        // First frame grows the buffers
+        RenderFrame(raster, scene, 0);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t frame = 1; frame <= frames; ++frame)
+            RenderFrame(raster, scene, frame);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+
+        if (t == 0)
+        {
+            single_ms = ms;
+            expected_hash = ImageHash(raster);
+            stats = raster.Stats();
+            if (output && !WritePPM(output, raster))
+                fprintf(stderr, "ERROR: Cannot write \"%s\".\n", output);
+        }
+        else if (ImageHash(raster) != expected_hash)
+            identical = false;
+
+        printf("%8u %10.2f %10.1f %8.2fx %10.0f%%\n", thread_counts[t], ms, 1000.0 / ms, single_ms / ms,
+               100.0 * single_ms / ms / thread_counts[t]);
+    }
+
+    printf("\nlast frame: %u triangles, %u culled, %u clipped, %u bin entries, %u pixels\n", (unsigned)stats.triangles,
+           (unsigned)stats.culled, (unsigned)stats.clipped, (unsigned)stats.bin_entries, (unsigned)stats.pixels);
+    printf("images: %s (%016llx)\n", identical ? "identical" : "DIFFERENT", (unsigned long long)expected_hash);
+    return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -6,66 +6,101 @@
 
 int main(int argc, char* argv[])
 {
-
-    // Start thread for managing wiimote sensor update events
-    std::thread controller_manager(ControllerHandlerThread);
-
-    // Connect to wiimotes
-    g_Wii.connectedWiimotes = ConnectWiimotes();
-    if (!g_Wii.connectedWiimotes)
+    // Parse options: [--headless] [--software] [--renderer gpu|cpu] [--pacing] [--frames N]
+    // [--size WxH] [--input synthetic|LOG] [--timings FILE] [model.obj]
+    bool headless = false, software = false, cpu_renderer = false, pacing = false;
+    int num_frames = 600, width = 800, height = 600;
+    const char* input = "synthetic";
+    const char* timings = "headless_timings.csv";
+    const char* model_file = NULL;
+    for (int i = 1; i < argc; ++i)
     {
-        glfwTerminate();
-        fprintf(stderr, "ERROR: ConnectWiimotes() failed.\n");
-        controller_manager.join();
+        if (strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if (strcmp(argv[i], "--software") == 0)
+            software = true;
+        else if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc && (strcmp(argv[i + 1], "gpu") == 0 || strcmp(argv[i + 1], "cpu") == 0))
+            cpu_renderer = strcmp(argv[++i], "cpu") == 0;
+        else if (strcmp(argv[i], "--pacing") == 0)
+            pacing = true;
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            num_frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &width, &height) == 2)
+            ++i;
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+            input = argv[++i];
+        else if (strcmp(argv[i], "--timings") == 0 && i + 1 < argc)
+            timings = argv[++i];
+        else if (argv[i][0] != '-' && !model_file)
+            model_file = argv[i];
+        else
+        {
+            fprintf(stderr, "ERROR: Bad option \"%s\".\n", argv[i]);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    if (num_frames <= 0 || width <= 0 || height <= 0)
+    {
+        fprintf(stderr, "ERROR: Bad frame count or size.\n");
         std::exit(EXIT_FAILURE);
     }
-
-    // Initialize GLFW
-    int success = glfwInit();
-    if (!success)
+    if (cpu_renderer && (width > SOFTRASTER_MAX_SIZE || height > SOFTRASTER_MAX_SIZE))
     {
-        fprintf(stderr, "ERROR: glfwInit() failed.\n");
+        fprintf(stderr, "ERROR: The CPU renderer draws at most %dx%d pixels.\n", SOFTRASTER_MAX_SIZE, SOFTRASTER_MAX_SIZE);
         std::exit(EXIT_FAILURE);
     }
 
-    // Set error callback
-    glfwSetErrorCallback(ErrorCallback);
+    // Load gesture templates (before the sensor thread starts feeding the spotter)
+    GestureLibrary_Update(GESTURES_DIRECTORY, GESTURES_LIBRARY);
+    if (g_GestureLibrary.Open(GESTURES_LIBRARY))
+        g_GestureSpotter.AddLibrary(g_GestureLibrary);
 
-    // Set OpenGL 3
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    // Initial pose, until the first report publishes one
+    g_PoseLatch.Publish(0, placed_wiimote.quaternion.w, placed_wiimote.quaternion.x,
+                        placed_wiimote.quaternion.y, placed_wiimote.quaternion.z);
 
-    #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    #endif
-
-    // Set core profile (Modern functions)
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    // Create window
-    GLFWwindow* window;
-    window = glfwCreateWindow(800, 600, "Render", NULL, NULL);
-    if (!window)
+    std::thread controller_manager;
+    GLFWwindow* window = NULL;
+    HeadlessInput headless_input;
+    FramePacer frame_pacer;
+    if (headless)
     {
-        glfwTerminate();
-        fprintf(stderr, "ERROR: glfwCreateWindow() failed.\n");
-        std::exit(EXIT_FAILURE);
+        // Synthetic or replayed reports instead of wiimotes, an EGL framebuffer instead of a window
+        if (!headless_input.Open(input) || !Headless_Init(width, height, software))
+            std::exit(EXIT_FAILURE);
     }
+    else
+    {
+        // Start thread for managing wiimote sensor update events
+        controller_manager = std::thread(ControllerHandlerThread);
 
-    // Set input callback functions
-    glfwSetKeyCallback(window, KeyCallback);
-    glfwSetMouseButtonCallback(window, MouseButtonCallback);
-    glfwSetCursorPosCallback(window, CursorPosCallback);
+        // Connect to wiimotes
+        g_Wii.connectedWiimotes = ConnectWiimotes();
+        if (!g_Wii.connectedWiimotes)
+        {
+            fprintf(stderr, "ERROR: ConnectWiimotes() failed.\n");
+            controller_manager.join();
+            std::exit(EXIT_FAILURE);
+        }
 
-    // Set current context to window
-    glfwMakeContextCurrent(window);
+        // Create window and its OpenGL context
+        window = CreateRenderWindow(width, height);
 
-    // Load OpenGL 3.3 functions
-    gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+        // Paced frames: swaps wait for the refresh, and frames start as late as that allows
+        if (pacing)
+        {
+            glfwSwapInterval(1);
+            const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+            if (mode && mode->refreshRate > 0)
+                frame_pacer.SetInterval(1000000 / mode->refreshRate);
+        }
+    }
 
-    // Set window resize callback
-    glfwSetFramebufferSizeCallback(window, FramebufferSizeCallback);
-    FramebufferSizeCallback(window, 800, 600);
+    // CPU renderer: scenes are rasterized in tiles over the global thread pool, and blitted into
+    // the framebuffer under the text
+    if (cpu_renderer)
+        g_SoftRasterizer = new SoftRasterizer();
+    FramebufferSizeCallback(window, width, height);
 
     // Print GPU info
     const GLubyte *vendor      = glGetString(GL_VENDOR);
@@ -74,23 +109,36 @@ int main(int argc, char* argv[])
     const GLubyte *glslversion = glGetString(GL_SHADING_LANGUAGE_VERSION);
 
     printf("GPU: %s, %s, OpenGL %s, GLSL %s\n", vendor, renderer, glversion, glslversion);
+    if (g_SoftRasterizer)
+        printf("Renderer: CPU, %u worker threads\n", ThreadPool::Global().Size());
 
     // Load vertex and fragment shaders
     LoadShadersFromFiles();
+    CreateUniformBuffers();
 
     // Object 1 - Wiimote
 
-    // Load object
-    ObjModel wiimoteModel("../../data/wiimote.obj");
-    ComputeNormals(&wiimoteModel);
-    BuildTrianglesAndAddToVirtualScene(&wiimoteModel);
+    // Load object (through its mesh cache)
+    LoadModelAndAddToVirtualScene("../../data/wiimote.obj");
+
+    if (model_file)
+        LoadModelAndAddToVirtualScene(model_file);
 
-    if ( argc > 1 )
+    // Resolve drawn objects once
+    SceneHandle wiimote_object = FindVirtualObject("wiimote");
+    if (wiimote_object == INVALID_SCENE_HANDLE)
     {
-        ObjModel model(argv[1]);
-        BuildTrianglesAndAddToVirtualScene(&model);
+        fprintf(stderr, "ERROR: Object \"wiimote\" not found.\n");
+        std::exit(EXIT_FAILURE);
     }
 
+    // Place instances in the culling hierarchy, moved every frame
+    #define WIIMOTE 1
+    InstanceHandle wiimote_instance = AddSceneInstance(wiimote_object, Matrix_Identity(), WIIMOTE);
+
+    // The wiimote is drawn at the pose latched right before the draw
+    g_PoseInstance = wiimote_instance;
+
     // Initialize text rendering
     TextRendering_Init();
 
@@ -102,9 +150,35 @@ int main(int argc, char* argv[])
     glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
 
-    // Main window loop
-    while (!glfwWindowShouldClose(window))
+    // Headless runs: simulated time, and the time taken by every frame
+    uint64_t simulated_time = 0, last_report_time = 0;
+    std::vector<HeadlessFrame> frame_timings;
+    frame_timings.reserve(num_frames);
+
+    // Main window loop (a fixed number of frames when headless)
+    while (headless ? frame_timings.size() < (size_t)num_frames : !glfwWindowShouldClose(window))
     {
+        // Paced frames sleep until the latest start that still makes the next refresh
+        uint64_t waited = frame_pacer.WaitForDeadline();
+
+        // Record frame start
+        uint64_t frame_start = FlightRecorder_Now();
+        FlightRecorder_RecordFrame(frame_start);
+
+        // Feed the reports due by this frame, one frame interval of simulated time after the last
+        if (headless)
+        {
+            simulated_time += HEADLESS_FRAME_INTERVAL;
+            HeadlessReport report;
+            while (headless_input.Next(simulated_time, &report))
+            {
+                float delta_t = last_report_time ? (report.timestamp - last_report_time) / 1e6f : HEADLESS_REPORT_INTERVAL / 1e6f;
+                last_report_time = report.timestamp;
+                HandleReport(report.timestamp, report.roll_rate, report.pitch_rate, report.yaw_rate,
+                             report.accel_x, report.accel_y, report.accel_z, delta_t);
+            }
+        }
+
         // Framebuffer background
         glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 
@@ -128,25 +202,30 @@ int main(int argc, char* argv[])
         glm::mat4 projection = Matrix_Perspective(field_of_view, g_ScreenRatio, nearplane, farplane);
         glm::mat4 model = Matrix_Identity();
 
-        // Send view and projection matrix to GPU
-        glUniformMatrix4fv(view_uniform       , 1 , GL_FALSE , glm::value_ptr(view));
-        glUniformMatrix4fv(projection_uniform , 1 , GL_FALSE , glm::value_ptr(projection));
+        // Send the per-frame block to GPU (camera position and light are no longer derived per fragment)
+        FrameUniforms frame;
+        frame.view            = view;
+        frame.projection      = projection;
+        frame.camera_position = g_Camera.camera_position;
+        frame.light_direction = glm::normalize(glm::vec4(1.0f, 1.0f, 0.5f, 0.0f));
+        glBindBuffer(GL_UNIFORM_BUFFER, g_FrameUniformBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-        // Draw objects
+        // Place objects
 
-        // Wiimote
-        #define WIIMOTE 1
-        
-        // Get rotation matrix based on object orientation quaternion
-        glm::mat4 RotationMatrix = glm::toMat4(placed_wiimote.quaternion);
+        // Wiimote, at the pose published so far (culling and HUD); the draw latches a fresher one
+        float pose[4];
+        g_PoseLatch.Read(pose);
+        glm::quat orientation(pose[0], pose[1], pose[2], pose[3]);
+        model = WiimoteModel(orientation);
 
-        model = Matrix_Translate(placed_wiimote.positionX, placed_wiimote.positionY, placed_wiimote.positionZ)
-        * RotationMatrix
-        * Matrix_Scale(placed_wiimote.scaleX,placed_wiimote.scaleY,placed_wiimote.scaleZ);
+        MoveSceneInstance(wiimote_instance, model);
 
-        glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-        glUniform1i(object_id_uniform, WIIMOTE);
-        DrawVirtualObject("wiimote");
+        // Queue the instances crossing the view frustum at their level of detail, drawn once the
+        // rest of the frame's CPU work is done
+        CullStats cull_stats = { 0, 0, 0 };
+        QueueVisibleSceneInstances(view, projection, (float)g_FramebufferHeight, &cull_stats);
 
         // Write FPS Coutner
         TextRendering_ShowFramesPerSecond(window);
@@ -154,26 +233,123 @@ int main(int argc, char* argv[])
         // Write orientation quaternion for the wiimote object
         char buffer[128];
         int numchars = snprintf(buffer,128,"Orientation = [ %.2f, %.2f, %.2f, %.2f ]",
-                placed_wiimote.quaternion.x,
-                placed_wiimote.quaternion.y,
-                placed_wiimote.quaternion.z,
-                placed_wiimote.quaternion.w);
+                orientation.x,
+                orientation.y,
+                orientation.z,
+                orientation.w);
         TextRendering_PrintString(window, buffer, (numchars + 1)*TextRendering_CharWidth(window) - 1.0f, 1.0f-TextRendering_LineHeight(window), 1.0f);
 
+        // Show spotted gestures
+        static char gesture_buffer[64] = "";
+        GestureEvent gesture;
+        while (g_GestureSpotter.Poll(&gesture))
+        {
+            snprintf(gesture_buffer, 64, "Gesture: %s (%.0f%%)", g_GestureSpotter.names[gesture.label].c_str(), gesture.confidence * 100.0f);
+            printf("%s, %.0f ms\n", gesture_buffer, (gesture.end - gesture.start) / 1000.0);
+        }
+        if (gesture_buffer[0])
+            TextRendering_PrintString(window, gesture_buffer, -1.0f, 1.0f-2.0f*TextRendering_LineHeight(window), 1.0f);
+
+        // Show button edges, with how long they waited for this frame
+        static char button_buffer[64] = "";
+        ButtonEvent button;
+        while (g_ButtonEvents.Poll(&button))
+        {
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            double age = ((uint64_t)now.tv_sec * 1000000 + now.tv_usec - button.timestamp) / 1000.0;
+            snprintf(button_buffer, 64, "Button: %s %s on wiimote %d (%.1f ms ago)", Button_Name(button.button), button.pressed ? "down" : "up",
+                     button.controller, age);
+        }
+        if (button_buffer[0])
+            TextRendering_PrintString(window, button_buffer, -1.0f, 1.0f-3.0f*TextRendering_LineHeight(window), 1.0f);
+
+        // Show culling counters
+        char cull_buffer[96];
+        snprintf(cull_buffer, 96, "Culling: %u tested, %u culled, %u drawn", (unsigned)cull_stats.tested,
+                 (unsigned)cull_stats.culled, (unsigned)cull_stats.drawn);
+        TextRendering_PrintString(window, cull_buffer, -1.0f, 1.0f-4.0f*TextRendering_LineHeight(window), 1.0f);
+
+        // Show the wiimote level of detail
+        const SceneObject& wiimote_mesh = g_VirtualScene[wiimote_object];
+        uint32_t wiimote_lod = g_SceneInstances[wiimote_instance].lod;
+        char lod_buffer[96];
+        snprintf(lod_buffer, 96, "Wiimote LOD: %u of %u (%u triangles)", wiimote_lod, wiimote_mesh.num_lods,
+                 wiimote_mesh.lods[wiimote_lod].num_indices / 3);
+        TextRendering_PrintString(window, lod_buffer, -1.0f, 1.0f-5.0f*TextRendering_LineHeight(window), 1.0f);
+
+        // Show the CPU renderer counters
+        if (g_SoftRasterizer)
+        {
+            const SoftRasterStats& raster_stats = g_SoftRasterizer->Stats();
+            char raster_buffer[128];
+            snprintf(raster_buffer, 128, "CPU raster: %u triangles, %u culled, %u binned, %u pixels", (unsigned)raster_stats.triangles,
+                     (unsigned)raster_stats.culled, (unsigned)raster_stats.bin_entries, (unsigned)raster_stats.pixels);
+            TextRendering_PrintString(window, raster_buffer, -1.0f, 1.0f-6.0f*TextRendering_LineHeight(window), 1.0f);
+        }
+
+        // Show how old the pose drawn last was when it was latched (live reports only)
+        if (!headless && g_LatchedPoseTimestamp)
+        {
+            char pose_buffer[96];
+            snprintf(pose_buffer, 96, "Pose: %.1f ms old at draw, frame start delayed %.1f ms",
+                     (double)(int64_t)(g_LatchedPoseTime - g_LatchedPoseTimestamp) / 1000.0, waited / 1000.0);
+            TextRendering_PrintString(window, pose_buffer, -1.0f, 1.0f-7.0f*TextRendering_LineHeight(window), 1.0f);
+        }
+
+        // Draw the queued instances instanced, grouped by object and level, latching the freshest
+        // pose right before the draws
+        if (g_SoftRasterizer)
+        {
+            SoftRasterFrame constants = { frame.view, frame.projection, frame.camera_position, frame.light_direction };
+            DrawQueuedObjectsSoftware(constants);
+        }
+        else
+            DrawQueuedObjects();
+
+        // Draw the text of the whole frame at once, over the scene
+        TextRendering_Flush();
+
+        if (headless)
+        {
+            // Nothing is presented: the frame ends when the GPU has finished drawing it
+            uint64_t submitted = FlightRecorder_Now();
+            glFinish();
+            HeadlessFrame frame_timing = { (submitted - frame_start) / 1000.0, (FlightRecorder_Now() - frame_start) / 1000.0 };
+            frame_timings.push_back(frame_timing);
+            continue;
+        }
+
         // Swap buffers (Show all that was rendered above)
+        uint64_t submitted = FlightRecorder_Now();
         glfwSwapBuffers(window);
+        frame_pacer.FramePresented(frame_start, submitted, FlightRecorder_Now());
 
         // Poll system for user input events
         glfwPollEvents();
 
     }
 
-    // Stop operating system resource usage
-    glfwTerminate();
+    delete g_SoftRasterizer;
+    g_SoftRasterizer = NULL;
+
+    if (headless)
+    {
+        Headless_WriteTimings(timings, frame_timings);
+        Headless_Shutdown();
+    }
+    else
+    {
+        // Stop operating system resource usage
+        glfwTerminate();
+
+        // Wait for controller event handler thread to exit
+        controller_manager.join();
+    }
+
+    // Stop flight recorder dump thread
+    FlightRecorder_Stop();
 
-    // Wait for controller event handler thread to exit
-    controller_manager.join();
-    
     return 0;
 }
 
@@ -181,18 +357,273 @@ int main(int argc, char* argv[])
 //                           OBJECT BUILDING AND DRAWING
 //==========================================================================================
 
-// Draws an object stored in g_VirtualScene
-void DrawVirtualObject(const char* object_name)
+// Resolves an object name to its handle (INVALID_SCENE_HANDLE if there is none)
+SceneHandle FindVirtualObject(const char* object_name)
+{
+    std::map<std::string, SceneHandle>::const_iterator it = g_VirtualSceneNames.find(object_name);
+    return it != g_VirtualSceneNames.end() ? it->second : INVALID_SCENE_HANDLE;
+}
+
+// Places an instance of an object in the scene, indexed by the culling hierarchy
+InstanceHandle AddSceneInstance(SceneHandle object, const glm::mat4& model, int material_id)
+{
+    SceneInstance instance;
+    instance.object      = object;
+    instance.model       = model;
+    instance.material_id = material_id;
+    instance.lod         = 0;
+    instance.leaf        = g_SceneBVH.Insert(BVH_Transform(g_VirtualScene[object].bounds, model), (uint32_t)g_SceneInstances.size());
+
+    g_SceneInstances.push_back(instance);
+    return (InstanceHandle)(g_SceneInstances.size() - 1);
+}
+
+// Moves an instance (its hierarchy leaf is only reinserted once it leaves its enlarged bounds)
+void MoveSceneInstance(InstanceHandle instance, const glm::mat4& model)
+{
+    SceneInstance& theinstance = g_SceneInstances[instance];
+    theinstance.model = model;
+    g_SceneBVH.Move(theinstance.leaf, BVH_Transform(g_VirtualScene[theinstance.object].bounds, model));
+}
+
+// Picks the level of detail of an object whose bounds cover projected_radius pixels. Errors
+// are relative to the bounds radius, so a level's error on screen is error * projected_radius.
+static uint32_t SelectLevelOfDetail(const SceneObject& theobject, float projected_radius, uint32_t current_lod)
+{
+    uint32_t lod = 0;
+    for (uint32_t level = 1; level < theobject.num_lods; ++level)
+    {
+        // Coarser levels than the current one must get under the band, finer ones are only
+        // left once their error rises over it
+        float threshold = LOD_PIXEL_ERROR * (level > current_lod ? 1.0f - LOD_HYSTERESIS : 1.0f + LOD_HYSTERESIS);
+        if (theobject.lods[level].error * projected_radius > threshold)
+            break;
+        lod = level;
+    }
+    return lod;
+}
+
+// Queues the scene instances crossing the view frustum for DrawQueuedObjects(), picking their
+// level of detail from their projected size (viewport_height in pixels)
+void QueueVisibleSceneInstances(const glm::mat4& view, const glm::mat4& projection, float viewport_height, CullStats* stats)
+{
+    Frustum frustum;
+    Frustum_FromMatrix(projection * view, &frustum);
+
+    static std::vector<uint32_t> visible;
+    visible.clear();
+    g_SceneBVH.Query(frustum, &visible, stats);
+
+    // Pixels per unit of radius at unit distance
+    float pixels_per_unit = std::fabs(projection[1][1]) * viewport_height * 0.5f;
+
+    for (size_t i = 0; i < visible.size(); ++i)
+    {
+        SceneInstance& instance = g_SceneInstances[visible[i]];
+        const SceneObject& theobject = g_VirtualScene[instance.object];
+
+        // Bounding sphere of the world bounds; the full mesh while the camera is inside it
+        BVHBounds bounds = BVH_Transform(theobject.bounds, instance.model);
+        float radius = 0.5f * glm::length(bounds.max - bounds.min);
+        float depth  = -(view * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f)).z;
+        float projected_radius = depth > radius ? radius / depth * pixels_per_unit : std::numeric_limits<float>::max();
+
+        instance.lod = SelectLevelOfDetail(theobject, projected_radius, instance.lod);
+        if (visible[i] == g_PoseInstance)
+            g_QueuedPoseSlot = g_QueuedInstances.size();
+        QueueVirtualObject(instance.object, instance.model, instance.material_id, instance.lod);
+    }
+}
+
+// Queues one instance of an object for DrawQueuedObjects(), with its normal matrix computed once here
+void QueueVirtualObject(SceneHandle object, const glm::mat4& model, int material_id, uint32_t lod)
+{
+    InstanceData instance;
+    instance.model         = model;
+    instance.normal_matrix = glm::mat3(glm::inverseTranspose(model));
+    instance.material_id   = material_id;
+
+    g_QueuedObjects.push_back(std::make_pair(object, lod));
+    g_QueuedInstances.push_back(instance);
+}
+
+// Model matrix of the wiimote at an orientation, at its placement otherwise
+glm::mat4 WiimoteModel(const glm::quat& orientation)
 {
+    return Matrix_Translate(placed_wiimote.positionX, placed_wiimote.positionY, placed_wiimote.positionZ)
+         * glm::toMat4(orientation)
+         * Matrix_Scale(placed_wiimote.scaleX, placed_wiimote.scaleY, placed_wiimote.scaleZ);
+}
+
+// Late latching: rebuilds the instance following the wiimote from the freshest pose published,
+// right before it is drawn. Culling used the pose of the frame start.
+void LatchPoseInstance(InstanceData* instance)
+{
+    float pose[4];
+    g_LatchedPoseTimestamp = g_PoseLatch.Read(pose);
+    g_LatchedPoseTime      = FlightRecorder_Now();
+
+    instance->model         = WiimoteModel(glm::quat(pose[0], pose[1], pose[2], pose[3]));
+    instance->normal_matrix = glm::mat3(glm::inverseTranspose(instance->model));
+}
+
+// Queues the per-object block of a draw, returns its slot
+size_t PushObjectUniforms(SceneHandle object)
+{
+    const SceneObject& theobject = g_VirtualScene[object];
+
+    ObjectUniforms block;
+    block.position_offset = glm::vec4(theobject.position_offset, 0.0f);
+    block.position_scale  = glm::vec4(theobject.position_scale, 0.0f);
+
+    size_t slot = g_ObjectUniformBlocks.size() / g_ObjectUniformStride;
+    g_ObjectUniformBlocks.resize(g_ObjectUniformBlocks.size() + g_ObjectUniformStride);
+    memcpy(&g_ObjectUniformBlocks[slot * g_ObjectUniformStride], &block, sizeof(block));
+    return slot;
+}
+
+// Sends every queued per-object block to the GPU in one update
+void UploadObjectUniforms()
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, g_ObjectUniformBuffer);
+
+    // Orphan the previous storage, so the update does not wait for last frame's draws
+    glBufferData(GL_UNIFORM_BUFFER, g_ObjectUniformBlocks.size(), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, g_ObjectUniformBlocks.size(), g_ObjectUniformBlocks.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Draws every queued instance: one instanced draw per distinct object and level of detail, whatever
+// the instance count
+void DrawQueuedObjects()
+{
+    size_t count = g_QueuedObjects.size();
+    if (count == 0)
+        return;
+
+    // Group instances by object and level, keeping their queue order inside each group
+    std::vector<uint32_t> order(count);
+    for (size_t i = 0; i < count; ++i)
+        order[i] = (uint32_t)i;
+    std::stable_sort(order.begin(), order.end(), [](uint32_t a, uint32_t b) { return g_QueuedObjects[a] < g_QueuedObjects[b]; });
+
+    std::vector<InstanceData> instances(count);
+    size_t pose_position = count; // Of the instance following the pose
+    for (size_t i = 0; i < count; ++i)
+    {
+        instances[i] = g_QueuedInstances[order[i]];
+        if (order[i] == g_QueuedPoseSlot)
+            pose_position = i;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_InstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), instances.data());
+
+    // Per-object blocks of every group, sent in one update
+    std::vector<size_t> groups; // Start of each group in instances[], then count
+    g_ObjectUniformBlocks.clear();
+    for (size_t i = 0; i < count; ++i)
+        if (i == 0 || g_QueuedObjects[order[i]] != g_QueuedObjects[order[i - 1]])
+        {
+            groups.push_back(i);
+            PushObjectUniforms(g_QueuedObjects[order[i]].first);
+        }
+    groups.push_back(count);
+    UploadObjectUniforms();
+
+    // Late latching: the instance following the pose is rebuilt from the freshest one, one
+    // instance update right before the draws
+    if (pose_position < count)
+    {
+        LatchPoseInstance(&instances[pose_position]);
+        glBufferSubData(GL_ARRAY_BUFFER, pose_position * sizeof(InstanceData), sizeof(InstanceData), &instances[pose_position]);
+    }
+
+    for (size_t group = 0; group + 1 < groups.size(); ++group)
+    {
+        const std::pair<SceneHandle, uint32_t>& key = g_QueuedObjects[order[groups[group]]];
+        DrawVirtualObject(key.first, key.second, group, groups[group], groups[group + 1] - groups[group]);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    g_QueuedObjects.clear();
+    g_QueuedInstances.clear();
+    g_QueuedPoseSlot = (size_t)-1;
+}
+
+// Renders every queued instance at its level of detail with the CPU renderer, then blits the
+// image into the framebuffer drawn to (the window or the headless framebuffer object)
+void DrawQueuedObjectsSoftware(const SoftRasterFrame& frame)
+{
+    SoftRasterizer& raster = *g_SoftRasterizer;
+
+    // Same background as the GPU path
+    raster.Begin(frame, glm::vec3(1.0f, 1.0f, 1.0f));
+    for (size_t i = 0; i < g_QueuedObjects.size(); ++i)
+    {
+        const SceneObject& theobject = g_VirtualScene[g_QueuedObjects[i].first];
+        const MeshLOD& level = theobject.lods[g_QueuedObjects[i].second];
+        InstanceData instance = g_QueuedInstances[i];
+        if (i == g_QueuedPoseSlot)
+            LatchPoseInstance(&instance);
+        raster.Draw(&g_SoftRasterMeshes[theobject.soft_mesh], level.first_index, level.num_indices,
+                    instance.model, instance.normal_matrix, instance.material_id);
+    }
+    raster.End();
+
+    g_QueuedObjects.clear();
+    g_QueuedInstances.clear();
+    g_QueuedPoseSlot = (size_t)-1;
+
+    // Rows are already bottom up, Stride() pixels apart. Unit 0: the text keeps its font bound on
+    // its own unit.
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, g_SoftRasterTexture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, raster.Stride());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, raster.Width(), raster.Height(), GL_RGBA, GL_UNSIGNED_BYTE, raster.Pixels());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint read_framebuffer;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, g_SoftRasterFramebuffer);
+    glBlitFramebuffer(0, 0, raster.Width(), raster.Height(), 0, 0, g_FramebufferWidth, g_FramebufferHeight,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
+}
+
+// Draws instances [first_instance, first_instance + num_instances) of the instance buffer
+// with a level of detail of an object stored in g_VirtualScene. The instance buffer must be bound.
+void DrawVirtualObject(SceneHandle object, uint32_t lod, size_t slot, size_t first_instance, size_t num_instances)
+{
+    const SceneObject& theobject = g_VirtualScene[object];
+    const MeshLOD& level = theobject.lods[lod];
+
+    // Per-object block of this draw
+    glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_UNIFORMS_BINDING, g_ObjectUniformBuffer, slot * g_ObjectUniformStride, sizeof(ObjectUniforms));
+
     // Enable VAO (Use vertex attributes stored in VAO)
-    glBindVertexArray(g_VirtualScene[object_name].vertex_array_object_id);
+    glBindVertexArray(theobject.vertex_array_object_id);
+
+    // Point the per-instance attributes at the first instance of this draw
+    // (no base instance in OpenGL 3.3)
+    size_t base = first_instance * sizeof(InstanceData);
+    for (GLuint column = 0; column < 4; ++column)
+        glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void*)(base + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+    for (GLuint column = 0; column < 3; ++column)
+        glVertexAttribPointer(INSTANCE_NORMAL_MATRIX_LOCATION + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void*)(base + offsetof(InstanceData, normal_matrix) + column * sizeof(glm::vec3)));
+    glVertexAttribIPointer(INSTANCE_MATERIAL_ID_LOCATION, 1, GL_INT, sizeof(InstanceData), (void*)(base + offsetof(InstanceData, material_id)));
 
     // Draw Object
-    glDrawElements(
-        g_VirtualScene[object_name].rendering_mode,
-        g_VirtualScene[object_name].num_indices,
+    glDrawElementsInstanced(
+        theobject.rendering_mode,
+        level.num_indices,
         GL_UNSIGNED_INT,
-        (void*)(g_VirtualScene[object_name].first_index * sizeof(GLuint))
+        (void*)(level.first_index * sizeof(GLuint)),
+        (GLsizei)num_instances
     );
 
     // Disable VAO to stop next operations from editing it
@@ -213,10 +644,27 @@ void LoadShadersFromFiles()
     program_id = CreateGpuProgram(vertex_shader_id, fragment_shader_id);
 
     // Search for vertex shader address
-    model_uniform           = glGetUniformLocation(program_id, "model");      // "model" matrix variable
-    view_uniform            = glGetUniformLocation(program_id, "view");       // "view" matrix variable (vertex shader)
-    projection_uniform      = glGetUniformLocation(program_id, "projection"); // "projection" matrix variable (vertex shader)
-    object_id_uniform       = glGetUniformLocation(program_id, "object_id");  // "object_id" variable (fragment shader)
+    // Uniform blocks (both shaders)
+    glUniformBlockBinding(program_id, glGetUniformBlockIndex(program_id, "FrameUniforms"), FRAME_UNIFORMS_BINDING);
+    glUniformBlockBinding(program_id, glGetUniformBlockIndex(program_id, "ObjectUniforms"), OBJECT_UNIFORMS_BINDING);
+}
+
+// Create the per-frame and per-object uniform buffers
+void CreateUniformBuffers()
+{
+    glGenBuffers(1, &g_FrameUniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, g_FrameUniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, g_FrameUniformBuffer);
+
+    // Per-object blocks start on the offsets glBindBufferRange accepts
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    g_ObjectUniformStride = (sizeof(ObjectUniforms) + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &g_ObjectUniformBuffer);
+    glGenBuffers(1, &g_InstanceBuffer);
 }
 
 // Compute normals for an ObjModel if they were not specified
@@ -279,122 +727,183 @@ void ComputeNormals(ObjModel* model)
     }
 }
 
-// Build triangles for an ObjModel for future rastering
-void BuildTrianglesAndAddToVirtualScene(ObjModel* model)
+// Load a model from its mesh cache, or parse, build and cache it when the cache is missing or outdated
+SceneHandle LoadModelAndAddToVirtualScene(const char* filename)
 {
-    GLuint vertex_array_object_id;
-    glGenVertexArrays(1, &vertex_array_object_id);
-    glBindVertexArray(vertex_array_object_id);
+    std::string cache_filename = MeshCache_Filename(filename);
 
-    std::vector<GLuint> indices;
-    std::vector<float>  model_coefficients;
-    std::vector<float>  normal_coefficients;
-    std::vector<float>  texture_coefficients;
+    MeshCache cache;
+    if (cache.Open(cache_filename.c_str(), filename))
+        return AddPackedMeshToVirtualScene(cache.mesh);
 
-    for (size_t shape = 0; shape < model->shapes.size(); ++shape)
-    {
-        size_t first_index = indices.size();
-        size_t num_triangles = model->shapes[shape].mesh.num_face_vertices.size();
+    ObjModel model(filename);
+    ComputeNormals(&model);
+    return BuildTrianglesAndAddToVirtualScene(&model, filename);
+}
 
-        for (size_t triangle = 0; triangle < num_triangles; ++triangle)
-        {
-            assert(model->shapes[shape].mesh.num_face_vertices[triangle] == 3);
+// ACMR of the full detail level of every part, drawn one after the other
+static float FullDetailACMR(const Mesh& mesh)
+{
+    std::vector<uint32_t> indices;
+    for (size_t part = 0; part < mesh.parts.size(); ++part)
+    {
+        const MeshLOD& lod = mesh.parts[part].lods[0];
+        indices.insert(indices.end(), mesh.indices.begin() + lod.first_index, mesh.indices.begin() + lod.first_index + lod.num_indices);
+    }
+    return Mesh_ACMR(indices, mesh.vertices.size());
+}
 
-            for (size_t vertex = 0; vertex < 3; ++vertex)
-            {
-                tinyobj::index_t idx = model->shapes[shape].mesh.indices[3*triangle + vertex];
+// Build triangles for an ObjModel for future rastering. Its shapes get consecutive handles.
+// The packed streams are cached for the model's source file, when given.
+SceneHandle BuildTrianglesAndAddToVirtualScene(ObjModel* model, const char* source)
+{
+    // Weld identical corners, simplify, then order triangles for the vertex cache and vertices for fetching
+    Mesh mesh;
+    Mesh_Build(model->attrib, model->shapes, &mesh);
+    size_t corners = mesh.indices.size();
+    float acmr_before = FullDetailACMR(mesh);
+    Mesh_BuildLODs(&mesh);
+    Mesh_OptimizeVertexCache(&mesh);
+    Mesh_OptimizeVertexFetch(&mesh);
+
+    printf("Building Mesh: %u corners -> %u vertices, ACMR %.3f -> %.3f\n", (unsigned)corners,
+           (unsigned)mesh.vertices.size(), acmr_before, FullDetailACMR(mesh));
+
+    // Triangles of every level, all parts together
+    uint32_t lod_triangles[MESH_MAX_LODS] = { 0 };
+    for (size_t part = 0; part < mesh.parts.size(); ++part)
+        for (uint32_t lod = 0; lod < MESH_MAX_LODS; ++lod)
+            lod_triangles[lod] += mesh.parts[part].lods[std::min(lod, mesh.parts[part].num_lods - 1)].num_indices / 3;
+    printf("Building Mesh LODs:");
+    for (uint32_t lod = 0; lod < MESH_MAX_LODS; ++lod)
+        printf(lod ? " / %u" : " %u", lod_triangles[lod]);
+    printf(" triangles\n");
+
+    // Quantize into one interleaved vertex buffer
+    std::vector<PackedVertex> vertices;
+    PackedMesh packed;
+    Mesh_ComputeBounds(mesh, &packed.bounds);
+    Mesh_Pack(mesh, packed.bounds, &vertices);
+
+    packed.has_normals   = mesh.has_normals;
+    packed.has_texcoords = mesh.has_texcoords;
+    packed.vertices      = vertices.data();
+    packed.num_vertices  = vertices.size();
+    packed.indices       = mesh.indices.data();
+    packed.num_indices   = mesh.indices.size();
+    packed.parts         = mesh.parts;
+
+    printf("Packing Mesh: %u KB of vertices (%u bytes each)\n", (unsigned)(vertices.size() * sizeof(PackedVertex) / 1024),
+           (unsigned)sizeof(PackedVertex));
+
+    if ( source )
+    {
+        std::string cache_filename = MeshCache_Filename(source);
+        printf("Writing Mesh Cache \"%s\"... ", cache_filename.c_str());
+        fflush(stdout);
+        if (MeshCache_Write(cache_filename.c_str(), source, packed))
+            printf("OK.\n");
+    }
 
-                indices.push_back(first_index + 3*triangle + vertex);
+    return AddPackedMeshToVirtualScene(packed);
+}
 
-                const float vx = model->attrib.vertices[3*idx.vertex_index + 0];
-                const float vy = model->attrib.vertices[3*idx.vertex_index + 1];
-                const float vz = model->attrib.vertices[3*idx.vertex_index + 2];
+// Upload packed vertex and index streams, one scene object per part
+SceneHandle AddPackedMeshToVirtualScene(const PackedMesh& mesh)
+{
+    SceneHandle first_handle = (SceneHandle)g_VirtualScene.size();
+    GLuint vertex_array_object_id;
+    glGenVertexArrays(1, &vertex_array_object_id);
+    glBindVertexArray(vertex_array_object_id);
 
-                model_coefficients.push_back( vx ); // X
-                model_coefficients.push_back( vy ); // Y
-                model_coefficients.push_back( vz ); // Z
-                model_coefficients.push_back( 1.0f ); // W
+    const MeshBounds& bounds = mesh.bounds;
+    glm::vec3 position_offset(bounds.min[0], bounds.min[1], bounds.min[2]);
+    glm::vec3 position_scale(bounds.max[0] - bounds.min[0], bounds.max[1] - bounds.min[1], bounds.max[2] - bounds.min[2]);
 
-                if ( idx.normal_index != -1 )
-                {
-                    const float nx = model->attrib.normals[3*idx.normal_index + 0];
-                    const float ny = model->attrib.normals[3*idx.normal_index + 1];
-                    const float nz = model->attrib.normals[3*idx.normal_index + 2];
-                    normal_coefficients.push_back( nx ); // X
-                    normal_coefficients.push_back( ny ); // Y
-                    normal_coefficients.push_back( nz ); // Z
-                    normal_coefficients.push_back( 0.0f ); // W
-                }
+    // The CPU renderer keeps its own copy of the streams (cached ones point into a mapping)
+    uint32_t soft_mesh = (uint32_t)g_SoftRasterMeshes.size();
+    if (g_SoftRasterizer)
+    {
+        g_SoftRasterMeshes.push_back(SoftRasterMesh());
+        SoftRasterMesh& copy = g_SoftRasterMeshes.back();
+        copy.vertices.assign(mesh.vertices, mesh.vertices + mesh.num_vertices);
+        copy.indices.assign(mesh.indices, mesh.indices + mesh.num_indices);
+        copy.position_offset = position_offset;
+        copy.position_scale  = position_scale;
+    }
 
-                if ( idx.texcoord_index != -1 )
-                {
-                    const float u = model->attrib.texcoords[2*idx.texcoord_index + 0];
-                    const float v = model->attrib.texcoords[2*idx.texcoord_index + 1];
-                    texture_coefficients.push_back( u );
-                    texture_coefficients.push_back( v );
-                }
+    for (size_t part = 0; part < mesh.parts.size(); ++part)
+    {
+        // Local bounds of the part, from the positions as the shader reconstructs them
+        uint16_t low[3] = { 65535, 65535, 65535 }, high[3] = { 0, 0, 0 };
+        const uint32_t* indices = mesh.indices + mesh.parts[part].lods[0].first_index;
+        for (size_t i = 0; i < mesh.parts[part].lods[0].num_indices; ++i)
+        {
+            const uint16_t* position = mesh.vertices[indices[i]].position;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                low[axis]  = std::min(low[axis], position[axis]);
+                high[axis] = std::max(high[axis], position[axis]);
             }
         }
 
-        size_t last_index = indices.size() - 1;
-
         SceneObject theobject;
-        theobject.name           = model->shapes[shape].name;
-        theobject.first_index    = first_index;
-        theobject.num_indices    = last_index - first_index + 1;
+        theobject.name           = mesh.parts[part].name;
+        theobject.num_lods       = mesh.parts[part].num_lods;
+        std::copy(mesh.parts[part].lods, mesh.parts[part].lods + MESH_MAX_LODS, theobject.lods);
         theobject.rendering_mode = GL_TRIANGLES;
         theobject.vertex_array_object_id = vertex_array_object_id;
-
-        g_VirtualScene[model->shapes[shape].name] = theobject;
+        theobject.position_offset = position_offset;
+        theobject.position_scale  = position_scale;
+        theobject.soft_mesh       = soft_mesh;
+        theobject.bounds.min = position_offset + position_scale * glm::vec3(low[0], low[1], low[2]) / 65535.0f;
+        theobject.bounds.max = position_offset + position_scale * glm::vec3(high[0], high[1], high[2]) / 65535.0f;
+
+        // A later object with the same name takes over the name
+        g_VirtualSceneNames[theobject.name] = (SceneHandle)g_VirtualScene.size();
+        g_VirtualScene.push_back(theobject);
     }
 
-    GLuint VBO_model_coefficients_id;
-    glGenBuffers(1, &VBO_model_coefficients_id);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_model_coefficients_id);
-    glBufferData(GL_ARRAY_BUFFER, model_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, model_coefficients.size() * sizeof(float), model_coefficients.data());
-    GLuint location = 0;
-    GLint  number_of_dimensions = 4;
-    glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(location);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GLuint VBO_vertices_id;
+    glGenBuffers(1, &VBO_vertices_id);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_vertices_id);
+    glBufferData(GL_ARRAY_BUFFER, mesh.num_vertices * sizeof(PackedVertex), mesh.vertices, GL_STATIC_DRAW);
+
+    // Position: unsigned normalized within the bounds
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(0);
 
-    if ( !normal_coefficients.empty() )
+    // Normal: signed normalized 10 bit components
+    if ( mesh.has_normals )
     {
-        GLuint VBO_normal_coefficients_id;
-        glGenBuffers(1, &VBO_normal_coefficients_id);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_normal_coefficients_id);
-        glBufferData(GL_ARRAY_BUFFER, normal_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, normal_coefficients.size() * sizeof(float), normal_coefficients.data());
-        location = 1;
-        number_of_dimensions = 4;
-        glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(location);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+        glEnableVertexAttribArray(1);
     }
 
-    if ( !texture_coefficients.empty() )
+    // Texture coordinates: half floats
+    if ( mesh.has_texcoords )
+    {
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texcoord));
+        glEnableVertexAttribArray(2);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Per-instance attributes, pointed into the instance buffer at draw time
+    for (GLuint location = INSTANCE_MODEL_LOCATION; location <= INSTANCE_MATERIAL_ID_LOCATION; ++location)
     {
-        GLuint VBO_texture_coefficients_id;
-        glGenBuffers(1, &VBO_texture_coefficients_id);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_texture_coefficients_id);
-        glBufferData(GL_ARRAY_BUFFER, texture_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, texture_coefficients.size() * sizeof(float), texture_coefficients.data());
-        location = 2;
-        number_of_dimensions = 2;
-        glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
         glEnableVertexAttribArray(location);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glVertexAttribDivisor(location, 1);
     }
 
     GLuint indices_id;
     glGenBuffers(1, &indices_id);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_id);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), NULL, GL_STATIC_DRAW);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(GLuint), indices.data());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.num_indices * sizeof(GLuint), mesh.indices, GL_STATIC_DRAW);
 
     glBindVertexArray(0);
+
+    return first_handle;
 }
 
 // =========================================================================================
@@ -537,6 +1046,62 @@ GLuint CreateGpuProgram(GLuint vertex_shader_id, GLuint fragment_shader_id)
     return program_id;
 }
 
+// =========================================================================================
+//                                      WINDOW
+//==========================================================================================
+
+// Creates the window and makes its OpenGL 3.3 context current
+GLFWwindow* CreateRenderWindow(int width, int height)
+{
+    // Initialize GLFW
+    int success = glfwInit();
+    if (!success)
+    {
+        fprintf(stderr, "ERROR: glfwInit() failed.\n");
+        std::exit(EXIT_FAILURE);
+    }
+
+    // Set error callback
+    glfwSetErrorCallback(ErrorCallback);
+
+    // Set OpenGL 3
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+
+    #ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    #endif
+
+    // Set core profile (Modern functions)
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    // Create window
+    GLFWwindow* window;
+    window = glfwCreateWindow(width, height, "Render", NULL, NULL);
+    if (!window)
+    {
+        glfwTerminate();
+        fprintf(stderr, "ERROR: glfwCreateWindow() failed.\n");
+        std::exit(EXIT_FAILURE);
+    }
+
+    // Set input callback functions
+    glfwSetKeyCallback(window, KeyCallback);
+    glfwSetMouseButtonCallback(window, MouseButtonCallback);
+    glfwSetCursorPosCallback(window, CursorPosCallback);
+
+    // Set current context to window
+    glfwMakeContextCurrent(window);
+
+    // Load OpenGL 3.3 functions
+    gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+
+    // Set window resize callback
+    glfwSetFramebufferSizeCallback(window, FramebufferSizeCallback);
+
+    return window;
+}
+
 // =========================================================================================
 //                                    CALLBACKS
 //==========================================================================================
@@ -546,7 +1111,34 @@ void FramebufferSizeCallback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
 
+    g_FramebufferWidth  = width;
+    g_FramebufferHeight = height;
     g_ScreenRatio = (float)width / height;
+
+    TextRendering_SetViewport(width, height);
+
+    // CPU renderer: images of the new size, and the texture they are blitted from. Sizes it
+    // cannot draw keep the last image, scaled by the blit.
+    if (g_SoftRasterizer && g_SoftRasterizer->Resize(width, height))
+    {
+        if (!g_SoftRasterTexture)
+        {
+            glGenTextures(1, &g_SoftRasterTexture);
+            glGenFramebuffers(1, &g_SoftRasterFramebuffer);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, g_SoftRasterTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        GLint read_framebuffer;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, g_SoftRasterFramebuffer);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, g_SoftRasterTexture, 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
+    }
 }
 
 // Last cursor position
@@ -636,6 +1228,10 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mod)
         placed_wiimote.SetPosition(0.0f,0.0f,0.0f);
     }
 
+    // Dump flight recorder on F12 press
+    if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+        FlightRecorder_TriggerDump("hotkey");
+
 
     // Projection vectors for free camera
     glm::vec4 view_projection = g_Camera.camera_view_vector;
@@ -698,6 +1294,10 @@ int ConnectWiimotes()
             wiimote.Accelerometer.SetAccelThreshold(0);
         }
 
+        // Track and record the first wiimote
+        g_Wii.trackedWiimote = wiimotes[0].GetID();
+        FlightRecorder_Start(wiimotes[0].GetAddress());
+
         return wiimotes.size();
     }
 }
@@ -727,6 +1327,17 @@ void ControllerHandlerThread()
         {
             wiimotes = g_Wii.wii.GetWiimotes();
             reload_wiimotes = 0;
+
+            // Track the first wiimote left when the tracked one is gone; gesture spotting
+            // restarts on its stream
+            bool tracked_found = false;
+            for (i = wiimotes.begin(); i != wiimotes.end(); ++i)
+                tracked_found = tracked_found || i->GetID() == g_Wii.trackedWiimote;
+            if (!tracked_found && !wiimotes.empty())
+            {
+                g_Wii.trackedWiimote = wiimotes[0].GetID();
+                g_GestureSpotter.Restart();
+            }
         }
 
         // Poll for events
@@ -760,12 +1371,41 @@ void ControllerHandlerThread()
 // Handles a sensor update event
 void HandleEvent(CWiimote &wm)
 {
-    // Handle Gyroscope
+    // Report timestamp (usec)
+    struct timeval report_time = wm.GetTimestamp();
+    uint64_t timestamp = (uint64_t)report_time.tv_sec * 1000000 + report_time.tv_usec;
+
+    // Handle buttons first, edges keep the report time
+    g_ButtonEvents.Feed(timestamp, wm.GetID(), wm.mpWiimotePtr->btns, wm.mpWiimotePtr->btns_held, wm.mpWiimotePtr->btns_released);
+
+    // Motion of the tracked wiimote only: the pose, the flight recorder (labelled with its
+    // address) and the gesture spotter follow a single stream
+    if (wm.GetID() != g_Wii.trackedWiimote)
+        return;
 
     // Get pitch, roll and yaw rates
     float roll_rate, pitch_rate, yaw_rate;
     wm.ExpansionDevice.MotionPlus.Gyroscope.GetRates(roll_rate, pitch_rate, yaw_rate);
 
+    // Get acceleration vector
+    float accel_x, accel_y, accel_z;
+    wm.Accelerometer.GetGravityVector(accel_z,accel_x,accel_y);
+
+    HandleReport(timestamp, roll_rate, pitch_rate, yaw_rate, accel_x, accel_y, accel_z, current_time - previous_time);
+}
+
+// Handles the motion of a report, from a wiimote or a headless input
+void HandleReport(uint64_t timestamp, float roll_rate, float pitch_rate, float yaw_rate,
+                  float accel_x, float accel_y, float accel_z, float delta_t)
+{
+    // Handle Gyroscope
+    float raw_roll_rate = roll_rate, raw_pitch_rate = pitch_rate, raw_yaw_rate = yaw_rate;
+
+    // Remove the rest bias
+    roll_rate  -= GYROSCOPE_BIAS_ROLL;
+    pitch_rate -= GYROSCOPE_BIAS_PITCH;
+    yaw_rate   -= GYROSCOPE_BIAS_YAW;
+
     // Update gyroscope
     g_Wii.UpdateGyro(yaw_rate, roll_rate, pitch_rate);
 
@@ -778,13 +1418,23 @@ void HandleEvent(CWiimote &wm)
     pitch_rate =  pitch_rate * M_PI / 180.0f;
 
     // Update model orientation
-    placed_wiimote.UpdateOrientation(yaw_rate, roll_rate, pitch_rate, current_time  - previous_time);
+    placed_wiimote.UpdateOrientation(yaw_rate, roll_rate, pitch_rate, delta_t);
+
+    // Publish it for the render loop to latch
+    g_PoseLatch.Publish(timestamp, placed_wiimote.quaternion.w, placed_wiimote.quaternion.x,
+                        placed_wiimote.quaternion.y, placed_wiimote.quaternion.z);
+
+    // Record fused pose
+    FlightRecorder_RecordPose(timestamp, placed_wiimote.quaternion.w, placed_wiimote.quaternion.x,
+                              placed_wiimote.quaternion.y, placed_wiimote.quaternion.z);
 
     // Handle accelerometer
 
-    // Get acceleration vector
-    float accel_x, accel_y, accel_z;
-    wm.Accelerometer.GetGravityVector(accel_z,accel_x,accel_y);
+    // Record raw report
+    FlightRecorder_RecordReport(timestamp, raw_roll_rate, raw_pitch_rate, raw_yaw_rate, accel_x, accel_y, accel_z);
+
+    // Spot gestures on the raw report
+    g_GestureSpotter.Feed(timestamp, accel_x, accel_y, accel_z, raw_roll_rate, raw_pitch_rate, raw_yaw_rate);
 
     // Update accelerometer
     g_Wii.UpdateAccel(accel_x, accel_y, accel_z);
@@ -795,7 +1445,7 @@ void HandleEvent(CWiimote &wm)
     // TODO Process these values
 
     // Update model position
-    //placed_wiimote.UpdatePosition(accel_x,accel_y,accel_z, current_time - previous_time);
+    //placed_wiimote.UpdatePosition(accel_x,accel_y,accel_z, delta_t);
 }
 
 // =========================================================================================
@@ -806,16 +1456,16 @@ void HandleEvent(CWiimote &wm)
 void TextRendering_ShowFramesPerSecond(GLFWwindow* window)
 {
 
-    static float old_seconds = (float)glfwGetTime();
+    static double old_seconds = FlightRecorder_Now() / 1e6;
     static int   ellapsed_frames = 0;
     static char  buffer[20] = "?? fps";
     static int   numchars = 7;
 
     ellapsed_frames += 1;
 
-    float seconds = (float)glfwGetTime();
+    double seconds = FlightRecorder_Now() / 1e6;
 
-    float ellapsed_seconds = seconds - old_seconds;
+    float ellapsed_seconds = (float)(seconds - old_seconds);
 
     if ( ellapsed_seconds > 1.0f )
     {
@@ -7,23 +7,27 @@
 in vec4 position_world;
 in vec4 normal;
 
-// Matrizes computadas no código C++ e enviadas para a GPU
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Identificador que define qual material está sendo desenhado no momento,
+// vindo dos atributos de cada instância (veja "shader_vertex.glsl")
+flat in int material_id;
 
-// Identificador que define qual objeto está sendo desenhado no momento
-uniform int object_id;
+// Dados compartilhados por todo o quadro, computados uma única vez no código
+// C++ (veja FrameUniforms em "render.h")
+layout (std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec4 camera_position;
+    vec4 light_direction;
+};
 
 // O valor de saída ("out") de um Fragment Shader é a cor final do fragmento.
 out vec3 color;
 
 void main()
 {
-    // Obtemos a posição da câmera utilizando a inversa da matriz que define o
-    // sistema de coordenadas da câmera.
-    vec4 origin = vec4(0.0, 0.0, 0.0, 1.0);
-    vec4 camera_position = inverse(view) * origin;
+    // A posição da câmera já chega computada em FrameUniforms, sem precisar
+    // inverter a matriz view a cada fragmento.
 
     // O fragmento atual é coberto por um ponto que percente à superfície de um
     // dos objetos virtuais da cena. Este ponto, p, possui uma posição no
@@ -37,7 +41,7 @@ void main()
     vec4 n = normalize(normal);
 
     // Vetor que define o sentido da fonte de luz em relação ao ponto atual.
-    vec4 l = normalize(vec4(1.0,1.0,0.5,0.0));
+    vec4 l = light_direction;
 
     // Vetor que define o sentido da câmera em relação ao ponto atual.
     vec4 v = normalize(camera_position - p);
@@ -51,7 +55,7 @@ void main()
     vec3 Ka; // Refletância ambiente
     float q; // Expoente especular para o modelo de iluminação de Phong
 
-    if ( object_id == 1 )
+    if ( material_id == 1 )
     {
         Kd = vec3(0.8,0.4,0.08);
         Ks = vec3(0.0,0.0,0.0);
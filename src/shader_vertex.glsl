@@ -2,14 +2,38 @@
 
 // Atributos de vrtice recebidos como entrada ("in") pelo Vertex Shader.
 // Veja a funo BuildTrianglesAndAddToVirtualScene() em "main.cpp".
-layout (location = 0) in vec4 model_coefficients;
+// Os atributos chegam compactados em um nico buffer intercalado: posies em
+// 16 bits normalizados dentro da caixa envolvente do modelo, normais em 10 bits
+// por coeficiente e coordenadas de textura em meia preciso. Veja Mesh_Pack()
+// em "mesh.cpp".
+layout (location = 0) in vec3 model_coefficients;
 layout (location = 1) in vec4 normal_coefficients;
 layout (location = 2) in vec2 texture_coefficients;
 
-// Matrizes computadas no cdigo C++ e enviadas para a GPU
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Atributos de cada instncia (avanam uma vez por instncia, no por vrtice),
+// com a matriz das normais j invertida na CPU. Veja InstanceData em "render.h"
+// e DrawQueuedObjects() em "render.cpp".
+layout (location = 3) in mat4 model;
+layout (location = 7) in mat3 normal_matrix;
+layout (location = 10) in int instance_material_id;
+
+// Dados compartilhados por todo o quadro, computados uma nica vez no cdigo
+// C++ (veja FrameUniforms em "render.h")
+layout (std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec4 camera_position;
+    vec4 light_direction;
+};
+
+// Dados do objeto sendo desenhado, compartilhados por todas as suas instncias
+// (veja ObjectUniforms em "render.h")
+layout (std140) uniform ObjectUniforms
+{
+    vec4 position_offset;
+    vec4 position_scale;
+};
 
 // Atributos de vrtice que sero gerados como sada ("out") pelo Vertex Shader.
 // ** Estes sero interpolados pelo rasterizador! ** gerando, assim, valores
@@ -18,6 +42,9 @@ uniform mat4 projection;
 out vec4 position_world;
 out vec4 normal;
 
+// Material da instncia, repassado sem interpolao
+flat out int material_id;
+
 void main()
 {
     // A varivel gl_Position define a posio final de cada vrtice
@@ -32,7 +59,10 @@ void main()
     // deste Vertex Shader, a placa de vdeo (GPU) far a diviso por W. Veja
     // slide 189 do documento "Aula_09_Projecoes.pdf".
 
-    gl_Position = projection * view * model * model_coefficients;
+    // As posies so recuperadas a partir da caixa envolvente do modelo
+    vec4 position_model = vec4(position_offset.xyz + position_scale.xyz * model_coefficients, 1.0);
+
+    gl_Position = projection * view * model * position_model;
 
     // Como as variveis acima  (tipo vec4) so vetores com 4 coeficientes,
     // tambm  possvel acessar e modificar cada coeficiente de maneira
@@ -49,11 +79,12 @@ void main()
     // rasterizador para gerar atributos nicos para cada fragmento gerado.
 
     // Posio do vrtice atual no sistema de coordenadas global (World).
-    position_world = model * model_coefficients;
+    position_world = model * position_model;
 
     // Normal do vrtice atual no sistema de coordenadas global (World).
     // Veja slide 107 do documento "Aula_07_Transformacoes_Geometricas_3D.pdf".
-    normal = inverse(transpose(model)) * normal_coefficients;
-    normal.w = 0.0;
+    normal = vec4(normal_matrix * normal_coefficients.xyz, 0.0);
+
+    material_id = instance_material_id;
 }
 
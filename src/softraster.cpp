@@ -0,0 +1,701 @@
+#include <cmath>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "softraster.h"
+
+#define SUBPIXEL       (1 << SOFTRASTER_SUBPIXEL_BITS)
+#define HALF_SUBPIXEL  (SUBPIXEL / 2)
+
+// Snapped coordinates are kept within a pixel guard band around the largest framebuffer
+#define GUARD_BAND     (16 * SUBPIXEL)
+
+// Edge values at the start of a span are clamped to this: no edge moves more than 2^28
+// inside a tile, so clamping keeps their sign over the tile and the lanes never overflow
+#define EDGE_CLAMP     (1 << 30)
+
+// Gamma correction table over linear [0, 1]
+#define GAMMA_TABLE_SIZE (1 << 14)
+
+// =========================================================================================
+//                                        LANES
+//==========================================================================================
+
+// 4 pixel spans: SSE2 registers, or arrays of 4 on other targets. Masks are all ones lanes.
+#ifdef __SSE2__
+typedef __m128  Float4;
+typedef __m128i Int4;
+
+static inline Float4 Float4_Set(float v)                               { return _mm_set1_ps(v); }
+static inline Float4 Float4_Ramp()                                     { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+static inline Float4 Float4_Load(const float* p)                       { return _mm_loadu_ps(p); }
+static inline void   Float4_Store(float* p, Float4 v)                  { _mm_storeu_ps(p, v); }
+static inline Float4 Float4_Add(Float4 a, Float4 b)                    { return _mm_add_ps(a, b); }
+static inline Float4 Float4_Sub(Float4 a, Float4 b)                    { return _mm_sub_ps(a, b); }
+static inline Float4 Float4_Mul(Float4 a, Float4 b)                    { return _mm_mul_ps(a, b); }
+static inline Float4 Float4_Div(Float4 a, Float4 b)                    { return _mm_div_ps(a, b); }
+static inline Float4 Float4_Max(Float4 a, Float4 b)                    { return _mm_max_ps(a, b); }
+static inline Float4 Float4_Sqrt(Float4 a)                             { return _mm_sqrt_ps(a); }
+static inline Float4 Float4_Less(Float4 a, Float4 b)                   { return _mm_cmplt_ps(a, b); }
+static inline Float4 Float4_And(Float4 a, Float4 b)                    { return _mm_and_ps(a, b); }
+static inline Float4 Float4_Select(Float4 mask, Float4 a, Float4 b)    { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline int    Float4_Mask(Float4 mask)                          { return _mm_movemask_ps(mask); }
+
+static inline Int4   Int4_Set(int32_t v)                               { return _mm_set1_epi32(v); }
+static inline Int4   Int4_Ramp(int32_t step)                           { return _mm_setr_epi32(0, step, 2 * step, 3 * step); }
+static inline Int4   Int4_Load(const uint32_t* p)                      { return _mm_loadu_si128((const __m128i*)p); }
+static inline void   Int4_Store(uint32_t* p, Int4 v)                   { _mm_storeu_si128((__m128i*)p, v); }
+static inline Int4   Int4_Add(Int4 a, Int4 b)                          { return _mm_add_epi32(a, b); }
+static inline Int4   Int4_Select(Float4 mask, Int4 a, Int4 b)
+{
+    __m128i m = _mm_castps_si128(mask);
+    return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+// Lanes where the three edge values are all >= 0
+static inline Float4 Int4_Inside(Int4 e0, Int4 e1, Int4 e2)
+{
+    return _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(e0, e1), e2), _mm_set1_epi32(-1)));
+}
+#else
+struct Float4 { float v[4]; };
+struct Int4   { int32_t v[4]; };
+
+#define LANES(expression) for (int k = 0; k < 4; ++k) { expression; }
+
+static inline Float4 Float4_Set(float v)                               { Float4 r; LANES(r.v[k] = v) return r; }
+static inline Float4 Float4_Ramp()                                     { Float4 r; LANES(r.v[k] = (float)k) return r; }
+static inline Float4 Float4_Load(const float* p)                       { Float4 r; LANES(r.v[k] = p[k]) return r; }
+static inline void   Float4_Store(float* p, Float4 v)                  { LANES(p[k] = v.v[k]) }
+static inline Float4 Float4_Add(Float4 a, Float4 b)                    { LANES(a.v[k] += b.v[k]) return a; }
+static inline Float4 Float4_Sub(Float4 a, Float4 b)                    { LANES(a.v[k] -= b.v[k]) return a; }
+static inline Float4 Float4_Mul(Float4 a, Float4 b)                    { LANES(a.v[k] *= b.v[k]) return a; }
+static inline Float4 Float4_Div(Float4 a, Float4 b)                    { LANES(a.v[k] /= b.v[k]) return a; }
+static inline Float4 Float4_Max(Float4 a, Float4 b)                    { LANES(a.v[k] = b.v[k] < a.v[k] ? a.v[k] : b.v[k]) return a; }
+static inline Float4 Float4_Sqrt(Float4 a)                             { LANES(a.v[k] = std::sqrt(a.v[k])) return a; }
+
+static inline uint32_t Lane_Bits(float v)    { uint32_t bits; memcpy(&bits, &v, sizeof(bits)); return bits; }
+static inline float    Lane_Mask(bool value) { uint32_t bits = value ? 0xFFFFFFFFu : 0u; float v; memcpy(&v, &bits, sizeof(v)); return v; }
+
+static inline Float4 Float4_Less(Float4 a, Float4 b)                   { LANES(a.v[k] = Lane_Mask(a.v[k] < b.v[k])) return a; }
+static inline Float4 Float4_And(Float4 a, Float4 b)                    { LANES(a.v[k] = Lane_Mask(Lane_Bits(a.v[k]) && Lane_Bits(b.v[k]))) return a; }
+static inline Float4 Float4_Select(Float4 mask, Float4 a, Float4 b)    { LANES(a.v[k] = Lane_Bits(mask.v[k]) ? a.v[k] : b.v[k]) return a; }
+static inline int    Float4_Mask(Float4 mask)                          { int m = 0; LANES(m |= (Lane_Bits(mask.v[k]) != 0) << k) return m; }
+
+static inline Int4   Int4_Set(int32_t v)                               { Int4 r; LANES(r.v[k] = v) return r; }
+static inline Int4   Int4_Ramp(int32_t step)                           { Int4 r; LANES(r.v[k] = k * step) return r; }
+static inline Int4   Int4_Load(const uint32_t* p)                      { Int4 r; LANES(r.v[k] = (int32_t)p[k]) return r; }
+static inline void   Int4_Store(uint32_t* p, Int4 v)                   { LANES(p[k] = (uint32_t)v.v[k]) }
+static inline Int4   Int4_Add(Int4 a, Int4 b)                          { LANES(a.v[k] += b.v[k]) return a; }
+static inline Int4   Int4_Select(Float4 mask, Int4 a, Int4 b)          { LANES(a.v[k] = Lane_Bits(mask.v[k]) ? a.v[k] : b.v[k]) return a; }
+static inline Float4 Int4_Inside(Int4 e0, Int4 e1, Int4 e2)            { Float4 r; LANES(r.v[k] = Lane_Mask((e0.v[k] | e1.v[k] | e2.v[k]) >= 0)) return r; }
+
+#undef LANES
+#endif
+
+// =========================================================================================
+//                                       SHADING
+//==========================================================================================
+
+// Reflectances of shader_fragment.glsl by material id; unknown materials are black
+struct SoftMaterial
+{
+    float kd[3]; // Diffuse
+    float ks[3]; // Specular
+    float ka[3]; // Ambient
+    float q;     // Phong exponent
+};
+
+static const SoftMaterial g_SoftMaterials[] =
+{
+    { { 0.0f, 0.0f, 0.0f  }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f  }, 1.0f }, // Unknown
+    { { 0.8f, 0.4f, 0.08f }, { 0.0f, 0.0f, 0.0f }, { 0.4f, 0.2f, 0.04f }, 1.0f }, // 1, wiimote
+};
+
+// Light and ambient spectra of the shader
+#define LIGHT_INTENSITY   1.0f
+#define AMBIENT_INTENSITY 0.2f
+
+static const SoftMaterial& Material(int material_id)
+{
+    int count = (int)(sizeof(g_SoftMaterials) / sizeof(g_SoftMaterials[0]));
+    return g_SoftMaterials[material_id > 0 && material_id < count ? material_id : 0];
+}
+
+// 8 bit sRGB-like encoding (pow(color, 1/2.2)) of linear values
+struct GammaTable
+{
+    uint8_t values[GAMMA_TABLE_SIZE];
+
+    GammaTable()
+    {
+        for (int i = 0; i < GAMMA_TABLE_SIZE; ++i)
+            values[i] = (uint8_t)std::floor(std::pow(i / (float)(GAMMA_TABLE_SIZE - 1), 1.0f / 2.2f) * 255.0f + 0.5f);
+    }
+};
+
+static const GammaTable& Gamma()
+{
+    static GammaTable table;
+    return table;
+}
+
+static inline uint32_t Encode(const GammaTable& gamma, float value)
+{
+    float index = value * (GAMMA_TABLE_SIZE - 1) + 0.5f;
+    return gamma.values[index < 0.0f ? 0 : index >= GAMMA_TABLE_SIZE - 1 ? GAMMA_TABLE_SIZE - 1 : (int)index];
+}
+
+static inline uint32_t PackColor(const GammaTable& gamma, float r, float g, float b)
+{
+    return Encode(gamma, r) | Encode(gamma, g) << 8 | Encode(gamma, b) << 16 | 0xFF000000u;
+}
+
+// 1 / length, 0 for zero vectors (as an unset normal attribute gives no diffuse light)
+static inline Float4 InverseLength(Float4 x, Float4 y, Float4 z)
+{
+    Float4 length2 = Float4_Add(Float4_Add(Float4_Mul(x, x), Float4_Mul(y, y)), Float4_Mul(z, z));
+    Float4 zero = Float4_Set(0.0f);
+    Float4 nonzero = Float4_Less(zero, length2);
+    return Float4_Select(nonzero, Float4_Div(Float4_Set(1.0f), Float4_Sqrt(Float4_Select(nonzero, length2, Float4_Set(1.0f)))), zero);
+}
+
+// Colors of 4 pixels from their interpolated world position and normal: Lambert diffuse,
+// ambient and Phong specular terms, gamma corrected
+static inline Int4 ShadeSpan(const SoftRasterFrame& frame, const SoftMaterial& material, const GammaTable& gamma,
+                             const Float4 position[3], const Float4 normal[3])
+{
+    Float4 n_scale = InverseLength(normal[0], normal[1], normal[2]);
+    Float4 n[3], l[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        n[i] = Float4_Mul(normal[i], n_scale);
+        l[i] = Float4_Set(frame.light_direction[i]);
+    }
+
+    Float4 n_dot_l = Float4_Add(Float4_Add(Float4_Mul(n[0], l[0]), Float4_Mul(n[1], l[1])), Float4_Mul(n[2], l[2]));
+    Float4 diffuse = Float4_Max(Float4_Set(0.0f), n_dot_l);
+
+    float lanes_specular[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    if (material.ks[0] != 0.0f || material.ks[1] != 0.0f || material.ks[2] != 0.0f)
+    {
+        // r . v, with r = -l + 2 n (n . l) and v towards the camera
+        Float4 v[3];
+        for (int i = 0; i < 3; ++i)
+            v[i] = Float4_Sub(Float4_Set(frame.camera_position[i]), position[i]);
+        Float4 v_scale = InverseLength(v[0], v[1], v[2]);
+        Float4 l_dot_v = Float4_Add(Float4_Add(Float4_Mul(l[0], v[0]), Float4_Mul(l[1], v[1])), Float4_Mul(l[2], v[2]));
+        Float4 n_dot_v = Float4_Add(Float4_Add(Float4_Mul(n[0], v[0]), Float4_Mul(n[1], v[1])), Float4_Mul(n[2], v[2]));
+        Float4 r_dot_v = Float4_Mul(Float4_Sub(Float4_Mul(Float4_Set(2.0f), Float4_Mul(n_dot_l, n_dot_v)), l_dot_v), v_scale);
+
+        Float4_Store(lanes_specular, Float4_Max(Float4_Set(0.0f), r_dot_v));
+        for (int k = 0; k < 4; ++k)
+            lanes_specular[k] = std::pow(lanes_specular[k], material.q);
+    }
+    Float4 specular = Float4_Load(lanes_specular);
+
+    float lanes[3][4];
+    for (int c = 0; c < 3; ++c)
+    {
+        Float4 color = Float4_Add(Float4_Add(Float4_Mul(Float4_Set(material.kd[c] * LIGHT_INTENSITY), diffuse),
+                                             Float4_Set(material.ka[c] * AMBIENT_INTENSITY)),
+                                  Float4_Mul(Float4_Set(material.ks[c] * LIGHT_INTENSITY), specular));
+        Float4_Store(lanes[c], color);
+    }
+
+    uint32_t packed[4];
+    for (int k = 0; k < 4; ++k)
+        packed[k] = PackColor(gamma, lanes[0][k], lanes[1][k], lanes[2][k]);
+    return Int4_Load(packed);
+}
+
+// =========================================================================================
+//                                      FRAMEBUFFER
+//==========================================================================================
+
+SoftRasterizer::SoftRasterizer(ThreadPool& pool) : pool(pool), width(0), height(0), tiles_x(0), tiles_y(0), clear_color(0)
+{
+    memset(&stats, 0, sizeof(stats));
+    blocks.resize(SOFTRASTER_SETUP_BLOCKS);
+    Gamma();
+}
+
+// Sets the framebuffer size, rounded up to whole tiles in memory
+bool SoftRasterizer::Resize(int new_width, int new_height)
+{
+    if (new_width <= 0 || new_height <= 0 || new_width > SOFTRASTER_MAX_SIZE || new_height > SOFTRASTER_MAX_SIZE)
+        return false;
+
+    width   = new_width;
+    height  = new_height;
+    tiles_x = (width + SOFTRASTER_TILE_SIZE - 1) / SOFTRASTER_TILE_SIZE;
+    tiles_y = (height + SOFTRASTER_TILE_SIZE - 1) / SOFTRASTER_TILE_SIZE;
+
+    size_t num_tiles = (size_t)tiles_x * tiles_y;
+    color.assign(num_tiles * SOFTRASTER_TILE_SIZE * SOFTRASTER_TILE_SIZE, 0);
+    depth.assign(num_tiles * SOFTRASTER_TILE_SIZE * SOFTRASTER_TILE_SIZE, 1.0f);
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        blocks[b].bins.clear();
+        blocks[b].bins.resize(num_tiles);
+    }
+    tile_order.resize(num_tiles);
+    tile_costs.resize(num_tiles);
+    tile_pixels.resize(num_tiles);
+    return true;
+}
+
+// Starts a frame cleared to a color (tiles are cleared as they are rasterized)
+void SoftRasterizer::Begin(const SoftRasterFrame& new_frame, const glm::vec3& new_clear_color)
+{
+    frame = new_frame;
+    view_projection = frame.projection * frame.view;
+    // Cleared values are written as they are, as glClear does
+    clear_color = 0xFF000000u;
+    for (int c = 0; c < 3; ++c)
+        clear_color |= (uint32_t)std::floor(glm::clamp(new_clear_color[c], 0.0f, 1.0f) * 255.0f + 0.5f) << (8 * c);
+    draws.clear();
+}
+
+// Queues a draw, with the range of vertices its indices use
+void SoftRasterizer::Draw(const SoftRasterMesh* mesh, uint32_t first_index, uint32_t num_indices,
+                          const glm::mat4& model, const glm::mat3& normal_matrix, int material_id)
+{
+    num_indices -= num_indices % 3;
+    if (num_indices == 0)
+        return;
+
+    DrawCall draw;
+    draw.mesh          = mesh;
+    draw.first_index   = first_index;
+    draw.num_indices   = num_indices;
+    draw.model         = model;
+    draw.normal_matrix = normal_matrix;
+    draw.material_id   = material_id;
+
+    const uint32_t* indices = mesh->indices.data() + first_index;
+    draw.min_vertex = *std::min_element(indices, indices + num_indices);
+    draw.max_vertex = *std::max_element(indices, indices + num_indices);
+    draw.first_vertex = draws.empty() ? 0 : draws.back().first_vertex + (draws.back().max_vertex - draws.back().min_vertex + 1);
+
+    draws.push_back(draw);
+}
+
+// Renders the queued draws: vertices, then triangle setup and binning, then tiles
+void SoftRasterizer::End()
+{
+    memset(&stats, 0, sizeof(stats));
+    if (tiles_x == 0)
+        return;
+
+    draw_triangles.resize(draws.size() + 1);
+    draw_triangles[0] = 0;
+    for (size_t d = 0; d < draws.size(); ++d)
+        draw_triangles[d + 1] = draw_triangles[d] + draws[d].num_indices / 3;
+    vertices.resize(draws.empty() ? 0 : draws.back().first_vertex + (draws.back().max_vertex - draws.back().min_vertex + 1));
+
+    RunOnPool(draws.size(), &SoftRasterizer::TransformDraw);
+    RunOnPool(blocks.size(), &SoftRasterizer::SetupBlockTriangles);
+
+    // Busiest tiles first, so no core is left with a heavy tile at the end of the frame
+    size_t num_tiles = tile_order.size();
+    for (size_t tile = 0; tile < num_tiles; ++tile)
+    {
+        tile_order[tile] = (uint32_t)tile;
+        tile_costs[tile] = 0;
+        for (size_t b = 0; b < blocks.size(); ++b)
+            tile_costs[tile] += blocks[b].bins[tile].size();
+    }
+    std::stable_sort(tile_order.begin(), tile_order.end(), [this](uint32_t a, uint32_t b) { return tile_costs[a] > tile_costs[b]; });
+
+    RunOnPool(num_tiles, &SoftRasterizer::RasterTile);
+
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        stats.triangles   += blocks[b].stats.triangles;
+        stats.culled      += blocks[b].stats.culled;
+        stats.clipped     += blocks[b].stats.clipped;
+        stats.bin_entries += blocks[b].stats.bin_entries;
+    }
+    for (size_t tile = 0; tile < num_tiles; ++tile)
+        stats.pixels += tile_pixels[tile];
+
+    draws.clear();
+}
+
+// Runs task(0..count) on the pool, one worker per core taking items from a shared counter
+void SoftRasterizer::RunOnPool(size_t count, void (SoftRasterizer::*task)(size_t))
+{
+    std::atomic<size_t> next(0);
+    ParallelFor(pool, std::min<size_t>(pool.Size(), count), [this, task, count, &next](size_t, size_t)
+    {
+        for (size_t item = next++; item < count; item = next++)
+            (this->*task)(item);
+    });
+}
+
+// =========================================================================================
+//                                       VERTICES
+//==========================================================================================
+
+// Signed normalized 10 bit value (GL_INT_2_10_10_10_REV)
+static inline float UnpackSnorm10(uint32_t bits)
+{
+    int32_t value = (int32_t)(bits << 22) >> 22;
+    return std::max(value / 511.0f, -1.0f);
+}
+
+// Vertex stage of one draw, as shader_vertex.glsl
+void SoftRasterizer::TransformDraw(size_t index)
+{
+    const DrawCall& draw = draws[index];
+    const SoftRasterMesh& mesh = *draw.mesh;
+    glm::vec3 scale = mesh.position_scale / 65535.0f;
+    glm::mat4 model_view_projection = view_projection * draw.model;
+
+    for (uint32_t v = draw.min_vertex; v <= draw.max_vertex; ++v)
+    {
+        const PackedVertex& packed = mesh.vertices[v];
+        glm::vec4 position_model(mesh.position_offset + scale * glm::vec3(packed.position[0], packed.position[1], packed.position[2]), 1.0f);
+        glm::vec3 normal(UnpackSnorm10(packed.normal), UnpackSnorm10(packed.normal >> 10), UnpackSnorm10(packed.normal >> 20));
+
+        Vertex& out = vertices[draw.first_vertex + (v - draw.min_vertex)];
+        out.clip   = model_view_projection * position_model;
+        out.world  = glm::vec3(draw.model * position_model);
+        out.normal = draw.normal_matrix * normal;
+    }
+}
+
+// =========================================================================================
+//                                   TRIANGLE SETUP
+//==========================================================================================
+
+// Frustum planes a clip space vertex is outside of (-w <= x, y, z <= w inside)
+static inline uint32_t OutCode(const glm::vec4& clip)
+{
+    return (clip.x < -clip.w) << 0 | (clip.x > clip.w) << 1 |
+           (clip.y < -clip.w) << 2 | (clip.y > clip.w) << 3 |
+           (clip.z < -clip.w) << 4 | (clip.z > clip.w) << 5;
+}
+
+// Signed distance of a vertex to frustum plane p (inside >= 0)
+static inline float PlaneDistance(const glm::vec4& clip, int p)
+{
+    float coordinate = clip[p / 2];
+    return p & 1 ? clip.w - coordinate : clip.w + coordinate;
+}
+
+// Sets up and bins the triangles of one block of the frame's triangle numbering
+void SoftRasterizer::SetupBlockTriangles(size_t index)
+{
+    SetupBlock& block = blocks[index];
+    block.triangles.clear();
+    for (size_t tile = 0; tile < block.bins.size(); ++tile)
+        block.bins[tile].clear();
+    memset(&block.stats, 0, sizeof(block.stats));
+
+    size_t total = draw_triangles.back();
+    size_t begin = total * index / blocks.size();
+    size_t end   = total * (index + 1) / blocks.size();
+    if (begin == end)
+        return;
+
+    size_t d = std::upper_bound(draw_triangles.begin(), draw_triangles.end(), begin) - draw_triangles.begin() - 1;
+    for (size_t t = begin; t < end; ++t)
+    {
+        while (t >= draw_triangles[d + 1])
+            ++d;
+        const DrawCall& draw = draws[d];
+        const uint32_t* indices = draw.mesh->indices.data() + draw.first_index + 3 * (t - draw_triangles[d]);
+
+        const Vertex* corners[3];
+        uint32_t outside_all = 0x3F, outside_any = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            corners[k] = &vertices[draw.first_vertex + (indices[k] - draw.min_vertex)];
+            uint32_t code = OutCode(corners[k]->clip);
+            outside_all &= code;
+            outside_any |= code;
+        }
+        ++block.stats.triangles;
+
+        if (outside_all)
+        {
+            ++block.stats.culled;
+            continue;
+        }
+        if (!outside_any)
+        {
+            if (!SetupTriangle(block, corners, draw.material_id))
+                ++block.stats.culled;
+            continue;
+        }
+
+        // Crossing the frustum: clip against every plane it crosses (Sutherland-Hodgman), then fan
+        ++block.stats.clipped;
+        Vertex polygon[2][9];
+        int count = 3;
+        for (int k = 0; k < 3; ++k)
+            polygon[0][k] = *corners[k];
+
+        int current = 0;
+        for (int p = 0; p < 6 && count > 0; ++p)
+        {
+            if (!(outside_any & (1u << p)))
+                continue;
+
+            const Vertex* in = polygon[current];
+            Vertex* out = polygon[current ^ 1];
+            int out_count = 0;
+            for (int k = 0; k < count; ++k)
+            {
+                const Vertex& a = in[k];
+                const Vertex& b = in[(k + 1) % count];
+                float da = PlaneDistance(a.clip, p);
+                float db = PlaneDistance(b.clip, p);
+                if (da >= 0.0f)
+                    out[out_count++] = a;
+                if ((da >= 0.0f) != (db >= 0.0f))
+                {
+                    float s = da / (da - db);
+                    Vertex& v = out[out_count++];
+                    v.clip   = glm::mix(a.clip, b.clip, s);
+                    v.world  = glm::mix(a.world, b.world, s);
+                    v.normal = glm::mix(a.normal, b.normal, s);
+                }
+            }
+            count = out_count;
+            current ^= 1;
+        }
+
+        bool drawn = false;
+        for (int k = 1; k + 1 < count; ++k)
+        {
+            const Vertex* fan[3] = { &polygon[current][0], &polygon[current][k], &polygon[current][k + 1] };
+            drawn |= SetupTriangle(block, fan, draw.material_id);
+        }
+        if (!drawn)
+            ++block.stats.culled;
+    }
+}
+
+// Snaps a triangle inside the frustum to fixed point, culls it if it faces away or covers
+// no pixel center, and bins it. Returns whether it was binned.
+bool SoftRasterizer::SetupTriangle(SetupBlock& block, const Vertex* corners[3], int material_id)
+{
+    int32_t x[3], y[3];
+    double sx[3], sy[3], attributes[3][8];
+    for (int k = 0; k < 3; ++k)
+    {
+        const Vertex& v = *corners[k];
+        double inv_w = 1.0 / v.clip.w;
+
+        // Viewport transform (glViewport(0, 0, width, height), glDepthRange(0, 1))
+        double px = (v.clip.x * inv_w * 0.5 + 0.5) * width;
+        double py = (v.clip.y * inv_w * 0.5 + 0.5) * height;
+        x[k] = (int32_t)glm::clamp(std::floor(px * SUBPIXEL + 0.5), (double)-GUARD_BAND, (double)(SOFTRASTER_MAX_SIZE * SUBPIXEL + GUARD_BAND));
+        y[k] = (int32_t)glm::clamp(std::floor(py * SUBPIXEL + 0.5), (double)-GUARD_BAND, (double)(SOFTRASTER_MAX_SIZE * SUBPIXEL + GUARD_BAND));
+        sx[k] = x[k] / (double)SUBPIXEL;
+        sy[k] = y[k] / (double)SUBPIXEL;
+
+        attributes[k][0] = v.clip.z * inv_w * 0.5 + 0.5;
+        attributes[k][1] = inv_w;
+        for (int i = 0; i < 3; ++i)
+        {
+            attributes[k][2 + i] = v.world[i] * inv_w;
+            attributes[k][5 + i] = v.normal[i] * inv_w;
+        }
+    }
+
+    // Counter clockwise triangles are front facing (glFrontFace(GL_CCW)), y up
+    int64_t area = (int64_t)(x[1] - x[0]) * (y[2] - y[0]) - (int64_t)(x[2] - x[0]) * (y[1] - y[0]);
+    if (area <= 0)
+        return false;
+
+    // Pixels whose centers (x + 1/2, y + 1/2) are inside the bounds
+    int32_t min_x = std::min(x[0], std::min(x[1], x[2])), max_x = std::max(x[0], std::max(x[1], x[2]));
+    int32_t min_y = std::min(y[0], std::min(y[1], y[2])), max_y = std::max(y[0], std::max(y[1], y[2]));
+    Triangle triangle;
+    triangle.min_x = std::max(0, (min_x - HALF_SUBPIXEL + SUBPIXEL - 1 + GUARD_BAND) / SUBPIXEL - GUARD_BAND / SUBPIXEL);
+    triangle.min_y = std::max(0, (min_y - HALF_SUBPIXEL + SUBPIXEL - 1 + GUARD_BAND) / SUBPIXEL - GUARD_BAND / SUBPIXEL);
+    triangle.max_x = std::min(width - 1, (max_x - HALF_SUBPIXEL + GUARD_BAND) / SUBPIXEL - GUARD_BAND / SUBPIXEL);
+    triangle.max_y = std::min(height - 1, (max_y - HALF_SUBPIXEL + GUARD_BAND) / SUBPIXEL - GUARD_BAND / SUBPIXEL);
+    if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y)
+        return false;
+
+    // Edge i runs between the other two corners. Top and left edges own the pixel centers
+    // on them, the others leave them to their neighbours (bias -1 on >= 0).
+    for (int i = 0; i < 3; ++i)
+    {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        int32_t a = y[j] - y[k];
+        int32_t b = x[k] - x[j];
+        bool top_left = a > 0 || (a == 0 && b < 0);
+        triangle.a[i] = a;
+        triangle.b[i] = b;
+        triangle.c[i] = -((int64_t)a * x[j] + (int64_t)b * y[j]) - (top_left ? 0 : 1);
+    }
+
+    // Attribute planes over pixel offsets from (min_x, min_y), from the snapped corners
+    double d = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+    double ox = triangle.min_x + 0.5 - sx[0], oy = triangle.min_y + 0.5 - sy[0];
+    for (int i = 0; i < 8; ++i)
+    {
+        double d1 = attributes[1][i] - attributes[0][i];
+        double d2 = attributes[2][i] - attributes[0][i];
+        double a = (d1 * (sy[2] - sy[0]) - d2 * (sy[1] - sy[0])) / d;
+        double b = (d2 * (sx[1] - sx[0]) - d1 * (sx[2] - sx[0])) / d;
+        triangle.plane_a[i] = (float)a;
+        triangle.plane_b[i] = (float)b;
+        triangle.plane_c[i] = (float)(attributes[0][i] + a * ox + b * oy);
+    }
+    triangle.material_id = material_id;
+
+    size_t before = block.stats.bin_entries;
+    block.triangles.push_back(triangle);
+    BinTriangle(block, (uint32_t)(block.triangles.size() - 1));
+    if (block.stats.bin_entries != before)
+        return true;
+
+    block.triangles.pop_back();
+    return false;
+}
+
+// Adds a triangle to the bins of the tiles its edges leave some pixel center of
+void SoftRasterizer::BinTriangle(SetupBlock& block, uint32_t index)
+{
+    const Triangle& triangle = block.triangles[index];
+    int first_x = triangle.min_x / SOFTRASTER_TILE_SIZE, last_x = triangle.max_x / SOFTRASTER_TILE_SIZE;
+    int first_y = triangle.min_y / SOFTRASTER_TILE_SIZE, last_y = triangle.max_y / SOFTRASTER_TILE_SIZE;
+
+    for (int ty = first_y; ty <= last_y; ++ty)
+        for (int tx = first_x; tx <= last_x; ++tx)
+        {
+            // Pixels of the bounds in this tile: rejected when an edge is negative at every corner
+            int x0 = std::max(triangle.min_x, tx * SOFTRASTER_TILE_SIZE), x1 = std::min(triangle.max_x, tx * SOFTRASTER_TILE_SIZE + SOFTRASTER_TILE_SIZE - 1);
+            int y0 = std::max(triangle.min_y, ty * SOFTRASTER_TILE_SIZE), y1 = std::min(triangle.max_y, ty * SOFTRASTER_TILE_SIZE + SOFTRASTER_TILE_SIZE - 1);
+
+            bool outside = false;
+            for (int i = 0; i < 3 && !outside; ++i)
+            {
+                int64_t a = triangle.a[i], b = triangle.b[i];
+                int64_t corner = a * (x0 * SUBPIXEL + HALF_SUBPIXEL) + b * (y0 * SUBPIXEL + HALF_SUBPIXEL) + triangle.c[i];
+                int64_t highest = corner + std::max<int64_t>(0, a * SUBPIXEL * (x1 - x0)) + std::max<int64_t>(0, b * SUBPIXEL * (y1 - y0));
+                outside = highest < 0;
+            }
+            if (outside)
+                continue;
+
+            block.bins[(size_t)ty * tiles_x + tx].push_back(index);
+            ++block.stats.bin_entries;
+        }
+}
+
+// =========================================================================================
+//                                    RASTERIZATION
+//==========================================================================================
+
+// Clears a tile, then draws its triangles in submission order
+void SoftRasterizer::RasterTile(size_t order)
+{
+    uint32_t tile = tile_order[order];
+    int tile_x = (int)(tile % tiles_x) * SOFTRASTER_TILE_SIZE;
+    int tile_y = (int)(tile / tiles_x) * SOFTRASTER_TILE_SIZE;
+    size_t stride = Stride();
+
+    for (int y = tile_y; y < tile_y + SOFTRASTER_TILE_SIZE; ++y)
+    {
+        std::fill_n(&color[y * stride + tile_x], SOFTRASTER_TILE_SIZE, clear_color);
+        std::fill_n(&depth[y * stride + tile_x], SOFTRASTER_TILE_SIZE, 1.0f);
+    }
+
+    size_t pixels = 0;
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        const std::vector<uint32_t>& bin = blocks[b].bins[tile];
+        for (size_t i = 0; i < bin.size(); ++i)
+            pixels += RasterTriangle(blocks[b].triangles[bin[i]], tile_x, tile_y);
+    }
+    tile_pixels[tile] = pixels;
+}
+
+// Draws the part of a triangle inside a tile, 4 pixels at a time. Returns the pixels written.
+size_t SoftRasterizer::RasterTriangle(const Triangle& triangle, int tile_x, int tile_y)
+{
+    // Spans start on multiples of 4 (tiles do), and never leave the tile
+    int x0 = std::max(triangle.min_x, tile_x) & ~3, x1 = std::min(triangle.max_x, tile_x + SOFTRASTER_TILE_SIZE - 1);
+    int y0 = std::max(triangle.min_y, tile_y),      y1 = std::min(triangle.max_y, tile_y + SOFTRASTER_TILE_SIZE - 1);
+
+    int32_t row_edge[3], row_step[3], span_step[3];
+    Int4 lane_offset[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        int64_t edge = (int64_t)triangle.a[i] * (x0 * SUBPIXEL + HALF_SUBPIXEL) + (int64_t)triangle.b[i] * (y0 * SUBPIXEL + HALF_SUBPIXEL) + triangle.c[i];
+        row_edge[i]    = (int32_t)std::max<int64_t>(-EDGE_CLAMP, std::min<int64_t>(EDGE_CLAMP, edge));
+        row_step[i]    = triangle.b[i] * SUBPIXEL;
+        span_step[i]   = triangle.a[i] * SUBPIXEL * 4;
+        lane_offset[i] = Int4_Ramp(triangle.a[i] * SUBPIXEL);
+    }
+
+    const SoftMaterial& material = Material(triangle.material_id);
+    const GammaTable& gamma = Gamma();
+    size_t stride = Stride();
+    size_t pixels = 0;
+
+    for (int y = y0; y <= y1; ++y)
+    {
+        Int4 e0 = Int4_Add(Int4_Set(row_edge[0]), lane_offset[0]);
+        Int4 e1 = Int4_Add(Int4_Set(row_edge[1]), lane_offset[1]);
+        Int4 e2 = Int4_Add(Int4_Set(row_edge[2]), lane_offset[2]);
+        Float4 dy = Float4_Set((float)(y - triangle.min_y));
+
+        for (int x = x0; x <= x1; x += 4)
+        {
+            Float4 mask = Int4_Inside(e0, e1, e2);
+            e0 = Int4_Add(e0, Int4_Set(span_step[0]));
+            e1 = Int4_Add(e1, Int4_Set(span_step[1]));
+            e2 = Int4_Add(e2, Int4_Set(span_step[2]));
+            if (!Float4_Mask(mask))
+                continue;
+
+            // Depth test (GL_LESS) and write
+            Float4 dx = Float4_Add(Float4_Set((float)(x - triangle.min_x)), Float4_Ramp());
+            Float4 attribute[8];
+            attribute[0] = Float4_Add(Float4_Add(Float4_Mul(Float4_Set(triangle.plane_a[0]), dx), Float4_Mul(Float4_Set(triangle.plane_b[0]), dy)), Float4_Set(triangle.plane_c[0]));
+
+            float* depth_span = &depth[y * stride + x];
+            Float4 old_depth = Float4_Load(depth_span);
+            mask = Float4_And(mask, Float4_Less(attribute[0], old_depth));
+            int covered = Float4_Mask(mask);
+            if (!covered)
+                continue;
+            Float4_Store(depth_span, Float4_Select(mask, attribute[0], old_depth));
+            pixels += __builtin_popcount(covered);
+
+            // Perspective correct world position and normal
+            for (int i = 1; i < 8; ++i)
+                attribute[i] = Float4_Add(Float4_Add(Float4_Mul(Float4_Set(triangle.plane_a[i]), dx), Float4_Mul(Float4_Set(triangle.plane_b[i]), dy)), Float4_Set(triangle.plane_c[i]));
+            Float4 w = Float4_Div(Float4_Set(1.0f), attribute[1]);
+            Float4 position[3], normal[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                position[i] = Float4_Mul(attribute[2 + i], w);
+                normal[i]   = Float4_Mul(attribute[5 + i], w);
+            }
+
+            uint32_t* color_span = &color[y * stride + x];
+            Int4_Store(color_span, Int4_Select(mask, ShadeSpan(frame, material, gamma, position, normal), Int4_Load(color_span)));
+        }
+
+        for (int i = 0; i < 3; ++i)
+            row_edge[i] += row_step[i];
+    }
+    return pixels;
+}
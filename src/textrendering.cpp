@@ -1,6 +1,10 @@
 // Based on http://hamelot.io/visualization/opengl-text-without-any-external-libraries/
 //   and on https://github.com/rougier/freetype-gl
 #include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <algorithm>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -87,10 +91,106 @@ GLuint textVBO;
 GLuint textprogram_id;
 GLuint texttexture_id;
 
+// Text layouts: the glyph quads of every printed string stay in textVBO across frames, and are
+// only laid out again when the string, its placement or the viewport changes. The layouts
+// printed during a frame are drawn together by TextRendering_Flush().
+struct TextVertex
+{
+    float x, y, s, t;
+};
+
+struct TextLayoutKey
+{
+    std::string text;
+    float       x, y, scale;
+    int         width, height; // Viewport the quads were laid out for
+
+    bool operator<(const TextLayoutKey& other) const
+    {
+        return std::tie(x, y, scale, width, height, text) < std::tie(other.x, other.y, other.scale, other.width, other.height, other.text);
+    }
+};
+
+struct TextLayout
+{
+    std::vector<TextVertex> vertices;
+    GLint                   first;      // First vertex in textVBO, -1 while not uploaded
+    uint32_t                last_frame; // Last frame it was printed in
+};
+
+std::map<TextLayoutKey, TextLayout> textlayouts;
+std::vector<TextLayout*> textframe_layouts; // Printed since the last flush
+uint32_t textframe = 0;
+size_t textVBO_used = 0;     // Vertices uploaded to textVBO
+size_t textVBO_capacity = 0; // Vertices textVBO has room for
+
+// Viewport size, set by TextRendering_SetViewport()
+int textviewport_width = 1;
+int textviewport_height = 1;
+
+// Glyph index, built once by TextRendering_Init(): what the layout needs of every font glyph,
+// found directly for ASCII and Latin-1 and by binary search for other codepoints
+struct TextGlyph
+{
+    uint32_t codepoint;
+    float    kerning;          // Added to the pen before the glyph
+    float    offset_x, offset_y;
+    float    width, height;
+    float    advance_x;
+    float    s0, t0, s1, t1;   // Texture coordinates, moved half a texel
+};
+std::vector<TextGlyph> textglyphs;  // Sorted by codepoint
+int32_t textglyph_table[256];       // Index in textglyphs of codepoints below 256, -1 if missing
+
+static void TextRendering_BuildGlyphIndex()
+{
+    textglyphs.clear();
+    for (size_t j = 0; j < dejavufont.glyphs_count; ++j)
+    {
+        const texture_glyph_t& glyph = dejavufont.glyphs[j];
+
+        TextGlyph entry;
+        entry.codepoint = glyph.codepoint;
+        entry.kerning   = glyph.kerning[0].kerning;
+        entry.offset_x  = (float)glyph.offset_x;
+        entry.offset_y  = (float)glyph.offset_y;
+        entry.width     = (float)glyph.width;
+        entry.height    = (float)glyph.height;
+        entry.advance_x = glyph.advance_x;
+        entry.s0 = glyph.s0 - 0.5f/dejavufont.tex_width;
+        entry.t0 = glyph.t0 - 0.5f/dejavufont.tex_height;
+        entry.s1 = glyph.s1 - 0.5f/dejavufont.tex_width;
+        entry.t1 = glyph.t1 - 0.5f/dejavufont.tex_height;
+        textglyphs.push_back(entry);
+    }
+
+    // The first glyph of a codepoint wins, as with the old linear search
+    std::stable_sort(textglyphs.begin(), textglyphs.end(),
+                     [](const TextGlyph& a, const TextGlyph& b) { return a.codepoint < b.codepoint; });
+
+    std::fill(textglyph_table, textglyph_table + 256, -1);
+    for (size_t j = textglyphs.size(); j-- > 0; )
+        if (textglyphs[j].codepoint < 256)
+            textglyph_table[textglyphs[j].codepoint] = (int32_t)j;
+}
+
+// Glyph of a codepoint, NULL when the font has none
+static inline const TextGlyph* TextRendering_FindGlyph(uint32_t codepoint)
+{
+    if (codepoint < 256)
+        return textglyph_table[codepoint] >= 0 ? &textglyphs[textglyph_table[codepoint]] : NULL;
+
+    std::vector<TextGlyph>::const_iterator it = std::lower_bound(textglyphs.begin(), textglyphs.end(), codepoint,
+        [](const TextGlyph& glyph, uint32_t value) { return glyph.codepoint < value; });
+    return it != textglyphs.end() && it->codepoint == codepoint ? &*it : NULL;
+}
+
 void TextRendering_Init()
 {
     GLuint sampler;
 
+    TextRendering_BuildGlyphIndex();
+
     glGenBuffers(1, &textVBO);
     glGenVertexArrays(1, &textVAO);
     glGenTextures(1, &texttexture_id);
@@ -126,9 +226,11 @@ void TextRendering_Init()
 
     glBindVertexArray(textVAO);
 
+    // Room for a few HUD lines; grown by TextRendering_Flush() when the layouts need more
+    textVBO_capacity = 256 * 6;
     glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-    glBufferData(GL_ARRAY_BUFFER, 24 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    glBufferData(GL_ARRAY_BUFFER, textVBO_capacity * sizeof(TextVertex), NULL, GL_DYNAMIC_DRAW);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), 0);
     glEnableVertexAttribArray(0);
     glCheckError();
 
@@ -144,41 +246,30 @@ void TextRendering_Init()
 
 float textscale = 1.5f;
 
-void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f)
+// Glyph quads of a string, in normalized device coordinates
+static void TextRendering_Layout(const std::string &str, float x, float y, float scale, std::vector<TextVertex>* vertices)
 {
     scale *= textscale;
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    float sx = scale / width;
-    float sy = scale / height;
+    float sx = scale / textviewport_width;
+    float sy = scale / textviewport_height;
 
+    // Strings are Latin-1: every byte is a codepoint of the direct table
     for (size_t i = 0; i < str.size(); i++)
     {
-        // Find the glyph for the character we are looking for
-        texture_glyph_t *glyph = 0;
-        for (size_t j = 0; j < dejavufont.glyphs_count; ++j)
-        {
-            if (dejavufont.glyphs[j].codepoint == (uint32_t)str[i])
-            {
-                glyph = &dejavufont.glyphs[j];
-                break;
-            }
-        }
-        if (!glyph) {
+        const TextGlyph* glyph = TextRendering_FindGlyph((unsigned char)str[i]);
+        if (!glyph)
             continue;
-        }
-        x += glyph->kerning[0].kerning;
-        float x0 = (float) (x + glyph->offset_x * sx);
-        float y0 = (float) (y + glyph->offset_y * sy);
-        float x1 = (float) (x0 + glyph->width * sx);
-        float y1 = (float) (y0 - glyph->height * sy);
-
-        float s0 = glyph->s0 - 0.5f/dejavufont.tex_width;
-        float t0 = glyph->t0 - 0.5f/dejavufont.tex_height;
-        float s1 = glyph->s1 - 0.5f/dejavufont.tex_width;
-        float t1 = glyph->t1 - 0.5f/dejavufont.tex_height;
-
-        struct {float x, y, s, t;} data[6] = {
+
+        x += glyph->kerning;
+        float x0 = x + glyph->offset_x * sx;
+        float y0 = y + glyph->offset_y * sy;
+        float x1 = x0 + glyph->width * sx;
+        float y1 = y0 - glyph->height * sy;
+
+        float s0 = glyph->s0, t0 = glyph->t0;
+        float s1 = glyph->s1, t1 = glyph->t1;
+
+        TextVertex quad[6] = {
             { x0, y0, s0, t0 },
             { x0, y1, s0, t1 },
             { x1, y1, s1, t1 },
@@ -186,43 +277,131 @@ void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float
             { x1, y1, s1, t1 },
             { x1, y0, s1, t0 }
         };
+        vertices->insert(vertices->end(), quad, quad + 6);
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        x += (glyph->advance_x * sx);
+    }
+}
 
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glDepthFunc(GL_ALWAYS);
-        glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, 24 * sizeof(float), data);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+// Queues a string for this frame's text draw, laying it out unless an identical print was
+// laid out before
+void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f)
+{
+    TextLayoutKey key = { str, x, y, scale, textviewport_width, textviewport_height };
+    std::map<TextLayoutKey, TextLayout>::iterator it = textlayouts.find(key);
+    if (it == textlayouts.end())
+    {
+        it = textlayouts.insert(std::make_pair(key, TextLayout())).first;
+        TextRendering_Layout(str, x, y, scale, &it->second.vertices);
+        it->second.first = -1;
+        it->second.last_frame = textframe - 1;
+    }
 
-        glUseProgram(textprogram_id);
-        glBindVertexArray(textVAO);
+    TextLayout& layout = it->second;
+    if (layout.last_frame != textframe)
+    {
+        layout.last_frame = textframe;
+        textframe_layouts.push_back(&layout);
+    }
+}
 
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+// Draws the layouts printed since the last flush with one call, uploading the new ones
+void TextRendering_Flush()
+{
+    size_t pending = 0;
+    for (size_t i = 0; i < textframe_layouts.size(); ++i)
+        if (textframe_layouts[i]->first < 0)
+            pending += textframe_layouts[i]->vertices.size();
 
-        glBindVertexArray(0);
-        glUseProgram(0);
-        glDepthFunc(GL_LESS);
+    glBindBuffer(GL_ARRAY_BUFFER, textVBO);
+
+    // Out of room: drop the layouts not printed this frame and start over in fresh storage
+    if (textVBO_used + pending > textVBO_capacity)
+    {
+        size_t live = 0;
+        for (std::map<TextLayoutKey, TextLayout>::iterator it = textlayouts.begin(); it != textlayouts.end(); )
+        {
+            if (it->second.last_frame != textframe)
+                it = textlayouts.erase(it);
+            else
+            {
+                it->second.first = -1;
+                live += it->second.vertices.size();
+                ++it;
+            }
+        }
 
-        glDisable(GL_BLEND);
+        pending = live;
+        textVBO_used = 0;
+        textVBO_capacity = std::max(textVBO_capacity, 2 * live);
+        glBufferData(GL_ARRAY_BUFFER, textVBO_capacity * sizeof(TextVertex), NULL, GL_DYNAMIC_DRAW);
+    }
 
-        x += (glyph->advance_x * sx);
+    // New layouts go after the resident ones, in one update
+    if (pending > 0)
+    {
+        std::vector<TextVertex> staging;
+        staging.reserve(pending);
+        for (size_t i = 0; i < textframe_layouts.size(); ++i)
+        {
+            TextLayout* layout = textframe_layouts[i];
+            if (layout->first >= 0)
+                continue;
+            layout->first = (GLint)(textVBO_used + staging.size());
+            staging.insert(staging.end(), layout->vertices.begin(), layout->vertices.end());
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, textVBO_used * sizeof(TextVertex), staging.size() * sizeof(TextVertex), staging.data());
+        textVBO_used += staging.size();
     }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    std::vector<GLint>   firsts;
+    std::vector<GLsizei> counts;
+    for (size_t i = 0; i < textframe_layouts.size(); ++i)
+        if (!textframe_layouts[i]->vertices.empty())
+        {
+            firsts.push_back(textframe_layouts[i]->first);
+            counts.push_back((GLsizei)textframe_layouts[i]->vertices.size());
+        }
+    textframe_layouts.clear();
+    ++textframe;
+
+    if (firsts.empty())
+        return;
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glDepthFunc(GL_ALWAYS);
+
+    glUseProgram(textprogram_id);
+    glBindVertexArray(textVAO);
+
+    glMultiDrawArrays(GL_TRIANGLES, firsts.data(), counts.data(), (GLsizei)firsts.size());
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glDepthFunc(GL_LESS);
+
+    glDisable(GL_BLEND);
+}
+
+// Viewport size text is laid out for (layouts made for another size are not reused)
+void TextRendering_SetViewport(int width, int height)
+{
+    textviewport_width  = std::max(width, 1);
+    textviewport_height = std::max(height, 1);
 }
 
 float TextRendering_LineHeight(GLFWwindow* window)
 {
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    return dejavufont.height / height * textscale;
+    return dejavufont.height / textviewport_height * textscale;
 }
 
 float TextRendering_CharWidth(GLFWwindow* window)
 {
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    return dejavufont.glyphs[32].advance_x / width * textscale;
+    return dejavufont.glyphs[32].advance_x / textviewport_width * textscale;
 }
 
 void TextRendering_PrintMatrix(GLFWwindow* window, glm::mat4 M, float x, float y, float scale = 1.0f)
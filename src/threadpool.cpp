@@ -0,0 +1,186 @@
+#include <chrono>
+
+#include "threadpool.h"
+
+// Pool and deque of the calling thread, when it is a worker
+static thread_local ThreadPool* t_pool = NULL;
+static thread_local size_t t_queue = 0;
+
+ThreadPool::ThreadPool(unsigned int num_threads) : queuedTasks(0), pendingTasks(0), nextQueue(0), stopping(false)
+{
+    if (num_threads == 0)
+        num_threads = std::thread::hardware_concurrency();
+    if (num_threads == 0)
+        num_threads = 1;
+
+    for (unsigned int i = 0; i < num_threads; ++i)
+        queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    for (unsigned int i = 0; i < num_threads; ++i)
+        workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, (size_t)i));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    tasksAvailable.notify_all();
+
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+void ThreadPool::Submit(const std::function<void()>& task)
+{
+    // Counted before it is visible, so a thief never finishes an uncounted task
+    ++pendingTasks;
+    ++queuedTasks;
+
+    size_t index = t_pool == this ? t_queue : nextQueue++ % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(task);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    tasksAvailable.notify_one();
+}
+
+bool ThreadPool::RunPendingTask()
+{
+    std::function<void()> task;
+    if (!PopTask(t_pool == this ? t_queue : queues.size(), &task))
+        return false;
+
+    task();
+    FinishTask();
+    return true;
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    tasksDone.wait(lock, [this] { return pendingTasks == 0; });
+}
+
+ThreadPool& ThreadPool::Global()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+// Newest task of the own deque (index, if it is one), else the oldest task of another deque
+bool ThreadPool::PopTask(size_t index, std::function<void()>* task)
+{
+    if (queuedTasks == 0)
+        return false;
+
+    if (index < queues.size())
+    {
+        WorkQueue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            *task = queue.tasks.back();
+            queue.tasks.pop_back();
+            --queuedTasks;
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i <= queues.size(); ++i)
+    {
+        WorkQueue& queue = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            *task = queue.tasks.front();
+            queue.tasks.pop_front();
+            --queuedTasks;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::FinishTask()
+{
+    if (--pendingTasks == 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        tasksDone.notify_all();
+    }
+}
+
+void ThreadPool::WorkerLoop(size_t index)
+{
+    t_pool = this;
+    t_queue = index;
+
+    for (;;)
+    {
+        std::function<void()> task;
+        if (PopTask(index, &task))
+        {
+            task();
+            FinishTask();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        tasksAvailable.wait(lock, [this] { return stopping || queuedTasks > 0; });
+        if (stopping && queuedTasks == 0)
+            return;
+    }
+}
+
+void ParallelFor(ThreadPool& pool, size_t count, const std::function<void(size_t, size_t)>& body, size_t min_block)
+{
+    if (count == 0)
+        return;
+
+    // A few blocks per worker keeps cores busy when blocks have uneven cost
+    size_t blocks = pool.Size() * 4;
+    size_t block_size = (count + blocks - 1) / blocks;
+    if (block_size < min_block)
+        block_size = min_block;
+
+    // Small inputs are not worth the hand-off
+    if (block_size >= count)
+    {
+        body(0, count);
+        return;
+    }
+
+    // Completion latch local to this call, so unrelated pool work is not waited on
+    std::mutex done_mutex;
+    std::condition_variable done;
+    size_t remaining = (count + block_size - 1) / block_size;
+
+    for (size_t begin = 0; begin < count; begin += block_size)
+    {
+        size_t end = begin + block_size < count ? begin + block_size : count;
+        pool.Submit([&body, &done_mutex, &done, &remaining, begin, end]
+        {
+            body(begin, end);
+
+            std::lock_guard<std::mutex> lock(done_mutex);
+            if (--remaining == 0)
+                done.notify_one();
+        });
+    }
+
+    // Help instead of blocking a worker; sleep only while the last blocks run elsewhere
+    std::unique_lock<std::mutex> lock(done_mutex);
+    while (remaining > 0)
+    {
+        lock.unlock();
+        bool ran = pool.RunPendingTask();
+        lock.lock();
+        if (!ran && remaining > 0)
+            done.wait_for(lock, std::chrono::milliseconds(1));
+    }
+}
@@ -0,0 +1,125 @@
+#include <ctime>
+#include <cstring>
+
+#include "wiiclog.h"
+#include "parseutils.h"
+
+// =========================================================================================
+//                                   LOG PARSING
+//==========================================================================================
+
+// Parses the header at the start of a log
+bool WiicLog_ParseHeader(const char* data, size_t size, WiicLogHeader* header)
+{
+    const char* p   = data;
+    const char* end = data + size;
+
+    // "WiiC <version>"
+    if (!Parse_IsToken(p, end, "WiiC", 4))
+        return false;
+    p += 4;
+    if (!Parse_Float(p, end, &header->version))
+        return false;
+    Parse_SkipLine(p, end);
+
+    // Date
+    const char* line_end = Parse_LineEnd(p, end);
+    header->date.assign(p, line_end);
+    Parse_SkipLine(p, end);
+
+    // Device address
+    line_end = Parse_LineEnd(p, end);
+    header->address.assign(p, line_end);
+    Parse_SkipLine(p, end);
+
+    header->body_offset = p - data;
+    return true;
+}
+
+// Finds every START/END block after offset
+bool WiicLog_FindTrainings(const char* data, size_t size, size_t offset, std::vector<WiicLogTraining>* trainings)
+{
+    const char* p   = data + offset;
+    const char* end = data + size;
+
+    bool inside = false;
+    WiicLogTraining training;
+
+    while (p < end)
+    {
+        const char* line = p;
+        Parse_SkipLine(p, end);
+
+        if (Parse_IsToken(line, end, "START", 5))
+        {
+            if (inside)
+                return false;
+
+            const char* ts = line + 5;
+            training.timestamp = 0;
+            Parse_Unsigned(ts, end, &training.timestamp);
+            training.begin = p - data;
+            training.num_samples = 0;
+            inside = true;
+        }
+        else if (Parse_IsToken(line, end, "END", 3))
+        {
+            if (!inside)
+                return false;
+
+            training.end = line - data;
+            trainings->push_back(training);
+            inside = false;
+        }
+        else if (inside && *line != '\n' && *line != '\r')
+        {
+            ++training.num_samples;
+        }
+    }
+
+    return !inside;
+}
+
+// Parses the sample line at p and moves p to the next line
+bool WiicLog_ParseSample(const char*& p, const char* end, WiicLogSample* sample)
+{
+    const char* line_end = Parse_LineEnd(p, end);
+    const char* q = p;
+    Parse_SkipLine(p, end);
+
+    Parse_SkipSpaces(q, line_end);
+    if (q == line_end)
+    {
+        sample->type = WIIC_LOG_NONE;
+        return true;
+    }
+
+    if (Parse_IsToken(q, line_end, "ACC", 3))
+    {
+        sample->type = WIIC_LOG_ACC;
+        q += 3;
+    }
+    else if (Parse_IsToken(q, line_end, "GYRO", 4))
+    {
+        sample->type = WIIC_LOG_GYRO;
+        q += 4;
+    }
+    else
+        return false;
+
+    return Parse_Unsigned(q, line_end, &sample->timestamp)
+        && Parse_Float(q, line_end, &sample->values[0])
+        && Parse_Float(q, line_end, &sample->values[1])
+        && Parse_Float(q, line_end, &sample->values[2]);
+}
+
+// Writes a header identical to the one of Dataset::save()
+void WiicLog_WriteHeader(FILE* out, const char* address)
+{
+    time_t now = time(NULL);
+    char date[64] = "";
+    ctime_r(&now, date);
+    date[strcspn(date, "\n")] = '\0';
+
+    fprintf(out, "WiiC %d\n%s\n%s\n", WIICLOG_VERSION, date, address);
+}